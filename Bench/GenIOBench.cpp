@@ -0,0 +1,1198 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// GenIOBench.cpp : generates synthetic GenIO files of a configurable shape, then measures
+// how quickly the stream backends can write and read them back.
+//
+// Usage: GenIOBench [options]
+//   -depth n         nesting depth of each synthetic object (default 3)
+//   -fanout n        children per interior node, leaves per bottom node (default 4)
+//   -objects n       number of top-level objects (default 1000)
+//   -minpayload n    smallest leaf payload, in bytes (default 16)
+//   -maxpayload n    largest leaf payload, in bytes (default 1024)
+//   -dist u|e        leaf payload size distribution; uniform or exponential (default u)
+//   -strings f       fraction of leaves that are strings, 0..1 (default 0.25)
+//   -arrays f        fraction of leaves that are arrays, 0..1 (default 0.25)
+//   -samples n       samples per series in the telemetry scenarios, rows per table in the table scenario (default 4096)
+//   -seed n          random seed (default 1)
+//   -iterations n    number of times each scenario is run (default 3)
+//   -scenario s      synthetic, readme, telemetry, telemetry-raw, table, smallfiles or all (default all)
+//   -backend s       name of the backend to run (file, segmented, pool), or all (default all); smallfiles only runs on pool
+//   -file path       scratch file that streams are written to (default genio_bench.dat)
+//   -results path    machine-readable (JSON) results file (default genio_bench.json)
+
+#include <GenIO.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <math.h>
+#include <stdlib.h>
+#include <new>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+typedef std::basic_string<TCHAR, std::char_traits<TCHAR>, std::allocator<TCHAR> > tstring;
+
+
+// ************************************************************************
+// Heap allocation counting - the library is linked statically, so its allocations come through here too
+
+static uint64_t s_HeapAllocs = 0;
+
+void *operator new(size_t size)
+{
+	s_HeapAllocs++;
+
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t size) noexcept
+{
+	free(p);
+}
+
+
+// ************************************************************************
+// Timing and random numbers
+
+static double BenchSeconds()
+{
+	static LARGE_INTEGER freq = { 0 };
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+
+	return (double)now.QuadPart / (double)freq.QuadPart;
+}
+
+
+// xorshift64* - deterministic, so a given seed always generates the same file
+class CBenchRandom
+{
+public:
+	CBenchRandom(uint64_t seed) { m_State = seed ? seed : 0x9E3779B97F4A7C15ULL; }
+
+	uint64_t Next()
+	{
+		m_State ^= m_State >> 12;
+		m_State ^= m_State << 25;
+		m_State ^= m_State >> 27;
+		return m_State * 0x2545F4914F6CDD1DULL;
+	}
+
+	// returns a value in [0, 1)
+	double NextUnit() { return (double)(Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+protected:
+	uint64_t m_State;
+};
+
+
+// ************************************************************************
+// Benchmark configuration and results
+
+enum EPayloadDist
+{
+	PD_UNIFORM = 0,
+	PD_EXPONENTIAL
+};
+
+struct SBenchShape
+{
+	uint32_t m_Depth;
+	uint32_t m_Fanout;
+	uint32_t m_Objects;
+	uint32_t m_MinPayload;
+	uint32_t m_MaxPayload;
+	EPayloadDist m_Dist;
+	double m_StringRatio;
+	double m_ArrayRatio;
+	uint32_t m_Samples;
+	uint64_t m_Seed;
+};
+
+struct SBenchPhase
+{
+	double m_Seconds;
+	uint64_t m_Bytes;
+	uint64_t m_Blocks;
+	uint64_t m_Allocs;
+	genio::SStreamStats m_Stats;
+};
+
+
+static double SyscallsPerBlock(const SBenchPhase &phase)
+{
+	uint64_t calls = phase.m_Stats.m_OSReads + phase.m_Stats.m_OSWrites + phase.m_Stats.m_OSSeeks;
+
+	return phase.m_Blocks ? (double)calls / (double)phase.m_Blocks : 0;
+}
+
+static void AccumulateStats(genio::SStreamStats &total, const genio::SStreamStats &stats)
+{
+	total.m_BytesRead += stats.m_BytesRead;
+	total.m_BytesWritten += stats.m_BytesWritten;
+	total.m_OSReads += stats.m_OSReads;
+	total.m_OSWrites += stats.m_OSWrites;
+	total.m_OSSeeks += stats.m_OSSeeks;
+	total.m_BlocksBegun += stats.m_BlocksBegun;
+	total.m_BlocksEnded += stats.m_BlocksEnded;
+	total.m_MaxDepth = std::max(total.m_MaxDepth, stats.m_MaxDepth);
+	total.m_OSMicroseconds += stats.m_OSMicroseconds;
+}
+
+struct SBenchResult
+{
+	const TCHAR *m_Scenario;
+	const TCHAR *m_Backend;
+	uint32_t m_Iteration;
+	SBenchPhase m_Write;
+	SBenchPhase m_Read;
+};
+
+
+// ************************************************************************
+// Backends - every stream implementation that can be benchmarked is listed here
+
+typedef genio::IOutputStream *(*BENCH_CREATEOUTPUT)(const TCHAR *filename);
+typedef genio::IInputStream *(*BENCH_CREATEINPUT)(const TCHAR *filename);
+typedef void (*BENCH_REMOVE)(const TCHAR *filename);
+
+static genio::IOutputStream *CreateFileOutput(const TCHAR *filename)
+{
+	genio::IOutputStream *os = genio::IOutputStream::Create();
+	if (os && os->Assign(filename) && os->Open())
+		return os;
+
+	if (os)
+		os->Release();
+
+	return nullptr;
+}
+
+static genio::IInputStream *CreateFileInput(const TCHAR *filename)
+{
+	genio::IInputStream *is = genio::IInputStream::Create();
+	if (is && is->Assign(filename) && is->Open())
+		return is;
+
+	if (is)
+		is->Release();
+
+	return nullptr;
+}
+
+static void RemoveFile(const TCHAR *filename)
+{
+	DeleteFile(filename);
+}
+
+// Segments are kept small so that even the default scenarios roll over a few times
+#define BENCH_SEGMENTSIZE		(16 << 20)
+
+static genio::IOutputStream *CreateSegmentedOutput(const TCHAR *filename)
+{
+	genio::ISegmentedOutputStream *os = genio::ISegmentedOutputStream::Create(BENCH_SEGMENTSIZE);
+	if (os && os->Assign(filename) && os->Open())
+		return os;
+
+	if (os)
+		os->Release();
+
+	return nullptr;
+}
+
+static genio::IInputStream *CreateSegmentedInput(const TCHAR *filename)
+{
+	genio::ISegmentedInputStream *is = genio::ISegmentedInputStream::Create();
+	if (is && is->Assign(filename) && is->Open())
+		return is;
+
+	if (is)
+		is->Release();
+
+	return nullptr;
+}
+
+static void RemoveSegmented(const TCHAR *filename)
+{
+	DeleteFile(filename);
+
+	for (uint32_t i = 0; ; i++)
+	{
+		TCHAR segname[MAX_PATH];
+		_stprintf_s(segname, _T("%s.%03u"), filename, i);
+		if (!DeleteFile(segname))
+			break;
+	}
+}
+
+struct SBenchBackend
+{
+	const TCHAR *m_Name;
+	BENCH_CREATEOUTPUT m_CreateOutput;
+	BENCH_CREATEINPUT m_CreateInput;
+	BENCH_REMOVE m_Remove;
+};
+
+static const SBenchBackend s_Backends[] =
+{
+	{ _T("file"), CreateFileOutput, CreateFileInput, RemoveFile },
+	{ _T("segmented"), CreateSegmentedOutput, CreateSegmentedInput, RemoveSegmented },
+};
+
+
+// ************************************************************************
+// Synthetic object graph scenario
+//
+// Each top-level object is a tree of 'NOD0' blocks, 'depth' levels deep, with 'fanout' children
+// per node. Every node starts with an 'INF0' leaf and the bottom level carries 'fanout' payload
+// leaves, each of which is sized raw bytes ('RAW0'), a wide string ('STR0') or an array of uint32_t
+// ('ARR0'). All nodes are closed with a terminator block, just like the README save pattern.
+
+class CSyntheticScenario
+{
+public:
+	CSyntheticScenario(const SBenchShape &shape) : m_Shape(shape), m_Random(shape.m_Seed)
+	{
+		m_Scratch.resize(m_Shape.m_MaxPayload + sizeof(wchar_t));
+	}
+
+	void Write(genio::IOutputStream *os, SBenchPhase &phase)
+	{
+		m_Random = CBenchRandom(m_Shape.m_Seed);
+
+		for (uint32_t i = 0; i < m_Shape.m_Objects; i++)
+			WriteNode(os, 1, phase);
+	}
+
+	void Read(genio::IInputStream *is, SBenchPhase &phase)
+	{
+		while (is->NextBlockId() == 'NOD0')
+		{
+			if (!ReadNode(is, phase))
+				break;
+		}
+	}
+
+protected:
+	uint32_t PayloadSize()
+	{
+		uint32_t range = m_Shape.m_MaxPayload - m_Shape.m_MinPayload;
+
+		double u = m_Random.NextUnit();
+		if (m_Shape.m_Dist == PD_EXPONENTIAL)
+		{
+			// mean at roughly 1/8th of the range, clamped to the maximum
+			u = -log(1.0 - u) / 8.0;
+			if (u > 1.0)
+				u = 1.0;
+		}
+
+		return m_Shape.m_MinPayload + (uint32_t)(u * range);
+	}
+
+	void WriteLeaf(genio::IOutputStream *os, SBenchPhase &phase)
+	{
+		uint32_t size = PayloadSize();
+		double kind = m_Random.NextUnit();
+
+		if (kind < m_Shape.m_StringRatio)
+		{
+			os->BeginBlock('STR0');
+
+			uint16_t len = (uint16_t)std::min<uint32_t>(size / sizeof(wchar_t), 0xFFFE);
+			wchar_t *s = (wchar_t *)m_Scratch.data();
+			for (uint16_t c = 0; c < len; c++)
+				s[c] = L'a' + (wchar_t)(m_Random.Next() % 26);
+			s[len] = L'\0';
+
+			os->WriteUINT16(len);
+			os->WriteStringW(s);
+			phase.m_Bytes += sizeof(uint16_t) + (len + 1) * sizeof(wchar_t);
+		}
+		else if (kind < (m_Shape.m_StringRatio + m_Shape.m_ArrayRatio))
+		{
+			os->BeginBlock('ARR0');
+
+			uint32_t count = size / sizeof(uint32_t);
+			uint32_t *a = (uint32_t *)m_Scratch.data();
+			for (uint32_t c = 0; c < count; c++)
+				a[c] = (uint32_t)m_Random.Next();
+
+			os->WriteUINT32(count);
+			os->Write(a, sizeof(uint32_t), count);
+			phase.m_Bytes += sizeof(uint32_t) + count * sizeof(uint32_t);
+		}
+		else
+		{
+			os->BeginBlock('RAW0');
+
+			for (uint32_t c = 0; c < size; c++)
+				m_Scratch[c] = (uint8_t)m_Random.Next();
+
+			os->WriteUINT32(size);
+			os->Write(m_Scratch.data(), size);
+			phase.m_Bytes += sizeof(uint32_t) + size;
+		}
+
+		os->EndBlock();
+		phase.m_Blocks++;
+	}
+
+	void WriteNode(genio::IOutputStream *os, uint32_t level, SBenchPhase &phase)
+	{
+		os->BeginBlock('NOD0');
+		phase.m_Blocks++;
+
+		os->BeginBlock('INF0');
+		os->WriteUINT64(m_Random.Next());
+		os->WriteUINT32(level);
+		os->EndBlock();
+		phase.m_Blocks++;
+		phase.m_Bytes += sizeof(uint64_t) + sizeof(uint32_t);
+
+		for (uint32_t i = 0; i < m_Shape.m_Fanout; i++)
+		{
+			if (level < m_Shape.m_Depth)
+				WriteNode(os, level + 1, phase);
+			else
+				WriteLeaf(os, phase);
+		}
+
+		os->BeginBlock(genio::IStream::ENDBLOCKID);
+		os->EndBlock();
+		phase.m_Blocks++;
+
+		os->EndBlock();
+	}
+
+	bool ReadNode(genio::IInputStream *is, SBenchPhase &phase)
+	{
+		if (!is->BeginBlock('NOD0'))
+			return false;
+
+		phase.m_Blocks++;
+
+		genio::FOURCHARCODE blockid;
+		while ((blockid = is->NextBlockId()) != genio::IStream::ENDBLOCKID)
+		{
+			if (blockid == 'NOD0')
+			{
+				if (!ReadNode(is, phase))
+					return false;
+
+				continue;
+			}
+
+			if (!is->BeginBlock(blockid))
+				return false;
+
+			phase.m_Blocks++;
+
+			switch (blockid)
+			{
+				case 'INF0':
+				{
+					uint64_t guid;
+					uint32_t level;
+					is->ReadUINT64(guid);
+					is->ReadUINT32(level);
+					phase.m_Bytes += sizeof(uint64_t) + sizeof(uint32_t);
+					break;
+				}
+
+				case 'STR0':
+				{
+					uint16_t len;
+					is->ReadUINT16(len);
+					if (((size_t)len + 1) * sizeof(wchar_t) > m_Scratch.size())
+						m_Scratch.resize(((size_t)len + 1) * sizeof(wchar_t));
+					is->ReadStringW((wchar_t *)m_Scratch.data());
+					phase.m_Bytes += sizeof(uint16_t) + (len + 1) * sizeof(wchar_t);
+					break;
+				}
+
+				case 'ARR0':
+				{
+					uint32_t count;
+					is->ReadUINT32(count);
+					if (count * sizeof(uint32_t) > m_Scratch.size())
+						m_Scratch.resize(count * sizeof(uint32_t));
+					is->Read(m_Scratch.data(), sizeof(uint32_t), count);
+					phase.m_Bytes += sizeof(uint32_t) + count * sizeof(uint32_t);
+					break;
+				}
+
+				case 'RAW0':
+				{
+					uint32_t size;
+					is->ReadUINT32(size);
+					if (size > m_Scratch.size())
+						m_Scratch.resize(size);
+					is->Read(m_Scratch.data(), size);
+					phase.m_Bytes += sizeof(uint32_t) + size;
+					break;
+				}
+			}
+
+			is->EndBlock();
+		}
+
+		is->BeginBlock(genio::IStream::ENDBLOCKID);
+		is->EndBlock();
+		phase.m_Blocks++;
+
+		is->EndBlock();
+
+		return true;
+	}
+
+	SBenchShape m_Shape;
+	CBenchRandom m_Random;
+	std::vector<uint8_t> m_Scratch;
+};
+
+
+// ************************************************************************
+// README scenario - the load / save pattern straight out of the README, applied to
+// a flat list of objects whose names and flags are generated from the shape's seed
+
+class CReadmeObject
+{
+public:
+	CReadmeObject() : m_Guid(0), m_Flags(0) { }
+
+	bool Save(genio::IOutputStream *os, SBenchPhase &phase)
+	{
+		if (os->BeginBlock('OBJ0'))
+		{
+			if (os->BeginBlock('INF0'))
+			{
+				os->WriteUINT64(m_Guid);
+				os->WriteUINT32(m_Flags);
+				os->EndBlock();
+			}
+
+			if (os->BeginBlock('INF1'))
+			{
+				os->WriteUINT16((uint16_t)m_Name.length());
+				os->WriteStringW(m_Name.c_str());
+				os->EndBlock();
+			}
+
+			os->BeginBlock(genio::IStream::ENDBLOCKID);
+			os->EndBlock();
+
+			os->EndBlock();
+
+			phase.m_Blocks += 4;
+			phase.m_Bytes += sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t) + (m_Name.length() + 1) * sizeof(wchar_t);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Load(genio::IInputStream *is, SBenchPhase &phase)
+	{
+		genio::FOURCHARCODE blockid;
+
+		if (is->BeginBlock('OBJ0'))
+		{
+			while ((blockid = is->NextBlockId()) != genio::IStream::ENDBLOCKID)
+			{
+				is->BeginBlock(blockid);
+
+				switch (blockid)
+				{
+					case 'INF0':
+					{
+						is->ReadUINT64(m_Guid);
+						is->ReadUINT32(m_Flags);
+						break;
+					}
+
+					case 'INF1':
+					{
+						uint16_t len;
+						is->ReadUINT16(len);
+
+						m_Name.resize(len);
+						is->ReadStringW((wchar_t *)m_Name.data());
+						break;
+					}
+				}
+
+				is->EndBlock();
+			}
+
+			is->BeginBlock(genio::IStream::ENDBLOCKID);
+			is->EndBlock();
+
+			is->EndBlock();
+
+			phase.m_Blocks += 4;
+			phase.m_Bytes += sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t) + (m_Name.length() + 1) * sizeof(wchar_t);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	uint64_t m_Guid;
+	uint32_t m_Flags;
+	std::wstring m_Name;
+};
+
+class CReadmeScenario
+{
+public:
+	CReadmeScenario(const SBenchShape &shape) : m_Shape(shape)
+	{
+		CBenchRandom r(shape.m_Seed);
+
+		m_Objects.resize(shape.m_Objects);
+		for (auto &o : m_Objects)
+		{
+			o.m_Guid = r.Next();
+			o.m_Flags = (uint32_t)r.Next();
+
+			size_t len = 4 + (size_t)(r.Next() % 28);
+			o.m_Name.resize(len);
+			for (size_t c = 0; c < len; c++)
+				o.m_Name[c] = L'A' + (wchar_t)(r.Next() % 26);
+		}
+	}
+
+	void Write(genio::IOutputStream *os, SBenchPhase &phase)
+	{
+		for (auto &o : m_Objects)
+			o.Save(os, phase);
+	}
+
+	void Read(genio::IInputStream *is, SBenchPhase &phase)
+	{
+		CReadmeObject o;
+		while (is->NextBlockId() == 'OBJ0')
+		{
+			if (!o.Load(is, phase))
+				break;
+		}
+	}
+
+protected:
+	SBenchShape m_Shape;
+	std::vector<CReadmeObject> m_Objects;
+};
+
+
+// ************************************************************************
+// Small files scenario - the README objects again, but each one is saved to and loaded from a file
+// of its own through a stream pool, like a server that opens and closes lots of small files. Once
+// the pool has been warmed up, none of this should allocate
+
+class CSmallFilesScenario : public CReadmeScenario
+{
+public:
+	CSmallFilesScenario(const SBenchShape &shape) : CReadmeScenario(shape)
+	{
+		// longer than any generated name, so that loading never has to grow it
+		m_Loaded.m_Name.reserve(32);
+	}
+
+	size_t Count() const { return m_Objects.size(); }
+
+	bool Save(genio::IStreamPool *pool, const TCHAR *filename, size_t index, SBenchPhase &phase)
+	{
+		genio::IOutputStream *os = pool->AcquireOutputStream();
+		bool ret = os->Assign(filename) && os->Open() && m_Objects[index].Save(os, phase);
+		os->Close();
+
+		genio::SStreamStats stats;
+		if (os->GetStats(stats))
+			AccumulateStats(phase.m_Stats, stats);
+
+		os->Release();
+
+		return ret;
+	}
+
+	bool Load(genio::IStreamPool *pool, const TCHAR *filename, SBenchPhase &phase)
+	{
+		genio::IInputStream *is = pool->AcquireInputStream();
+		bool ret = is->Assign(filename) && is->Open() && m_Loaded.Load(is, phase);
+		is->Close();
+
+		genio::SStreamStats stats;
+		if (is->GetStats(stats))
+			AccumulateStats(phase.m_Stats, stats);
+
+		is->Release();
+
+		return ret;
+	}
+
+protected:
+	CReadmeObject m_Loaded;
+};
+
+
+// ************************************************************************
+// Telemetry scenario
+//
+// Each top-level 'TLM0' block is one series of 'samples' readings: a 'TIME' array of timestamps
+// (nanoseconds, one per millisecond with a little jitter) and a 'VALU' array of doubles that wander
+// slowly and are rounded to two decimal places, like most sensor data. The "telemetry" scenario
+// writes them with the array codecs, "telemetry-raw" writes the same data uncompressed.
+
+class CTelemetryScenario
+{
+public:
+	CTelemetryScenario(const SBenchShape &shape, bool raw) : m_Shape(shape), m_Raw(raw)
+	{
+		m_Times.resize(shape.m_Samples);
+		m_Values.resize(shape.m_Samples);
+	}
+
+	void Write(genio::IOutputStream *os, SBenchPhase &phase)
+	{
+		CBenchRandom r(m_Shape.m_Seed);
+
+		int64_t t = 1600000000000000000LL;
+		for (uint32_t i = 0; i < m_Shape.m_Objects; i++)
+		{
+			double v = (double)(r.Next() % 1000);
+			for (uint32_t s = 0; s < m_Shape.m_Samples; s++)
+			{
+				t += 1000000 + (int64_t)(r.Next() % 64) - 32;
+				m_Times[s] = t;
+
+				v += ((double)(r.Next() % 201) - 100.0) / 1000.0;
+				m_Values[s] = floor((v * 100.0) + 0.5) / 100.0;
+			}
+
+			os->BeginBlock('TLM0');
+			os->WriteArrayINT64('TIME', m_Times.data(), m_Times.size(), m_Raw ? genio::IStream::AC_RAW : genio::IStream::AC_DELTADELTA);
+			os->WriteArrayDouble('VALU', m_Values.data(), m_Values.size(), m_Raw ? genio::IStream::AC_RAW : genio::IStream::AC_XOR);
+			os->BeginBlock(genio::IStream::ENDBLOCKID);
+			os->EndBlock();
+			os->EndBlock();
+
+			phase.m_Blocks += 4;
+			phase.m_Bytes += m_Times.size() * sizeof(int64_t) + m_Values.size() * sizeof(double);
+		}
+	}
+
+	void Read(genio::IInputStream *is, SBenchPhase &phase)
+	{
+		while (is->NextBlockId() == 'TLM0')
+		{
+			if (!is->BeginBlock('TLM0'))
+				break;
+
+			phase.m_Blocks++;
+
+			genio::FOURCHARCODE blockid;
+			while ((blockid = is->NextBlockId()) != genio::IStream::ENDBLOCKID)
+			{
+				size_t n = 0;
+				switch (blockid)
+				{
+					case 'TIME':
+						n = is->ReadArrayINT64('TIME', m_Times.data(), m_Times.size()) * sizeof(int64_t);
+						break;
+
+					case 'VALU':
+						n = is->ReadArrayDouble('VALU', m_Values.data(), m_Values.size()) * sizeof(double);
+						break;
+
+					default:
+						if (is->BeginBlock(blockid))
+							is->EndBlock();
+						break;
+				}
+
+				phase.m_Blocks++;
+				phase.m_Bytes += n;
+			}
+
+			is->EndBlock();
+		}
+	}
+
+protected:
+	SBenchShape m_Shape;
+	bool m_Raw;
+	std::vector<int64_t> m_Times;
+	std::vector<double> m_Values;
+};
+
+
+// ************************************************************************
+// Table scenario
+//
+// Each top-level block is a table of 'samples' sensor records, written with ITableWriter. The read
+// side is an analytics pass that only wants the readings, so it loads the 'VALU' column and nothing else;
+// compare the I/O it does with the bytes the write side produced.
+
+struct SBenchRecord
+{
+	int64_t m_Time;
+	double m_Value;
+	int32_t m_Sensor;
+	float m_Quality;
+	uint64_t m_Flags;
+};
+
+class CTableScenario
+{
+public:
+	CTableScenario(const SBenchShape &shape) : m_Shape(shape)
+	{
+		m_Records.resize(shape.m_Samples);
+		m_Sum = 0;
+	}
+
+	void Write(genio::IOutputStream *os, SBenchPhase &phase)
+	{
+		static const genio::STableColumn columns[] =
+		{
+			{ 'TIME', genio::STableColumn::CT_INT64, genio::IStream::AC_DELTADELTA, offsetof(SBenchRecord, m_Time) },
+			{ 'VALU', genio::STableColumn::CT_DOUBLE, genio::IStream::AC_XOR, offsetof(SBenchRecord, m_Value) },
+			{ 'SENS', genio::STableColumn::CT_INT32, genio::IStream::AC_RAW, offsetof(SBenchRecord, m_Sensor) },
+			{ 'QUAL', genio::STableColumn::CT_FLOAT, genio::IStream::AC_RAW, offsetof(SBenchRecord, m_Quality) },
+			{ 'FLAG', genio::STableColumn::CT_UINT64, genio::IStream::AC_DELTADELTA, offsetof(SBenchRecord, m_Flags) },
+		};
+
+		genio::ITableWriter *tw = genio::ITableWriter::Create(columns, sizeof(columns) / sizeof(columns[0]));
+		if (!tw)
+			return;
+
+		CBenchRandom r(m_Shape.m_Seed);
+
+		int64_t t = 1600000000000000000LL;
+		for (uint32_t i = 0; i < m_Shape.m_Objects; i++)
+		{
+			double v = (double)(r.Next() % 1000);
+			for (SBenchRecord &rec : m_Records)
+			{
+				t += 1000000 + (int64_t)(r.Next() % 64) - 32;
+				v += ((double)(r.Next() % 201) - 100.0) / 1000.0;
+
+				rec.m_Time = t;
+				rec.m_Value = floor((v * 100.0) + 0.5) / 100.0;
+				rec.m_Sensor = (int32_t)(r.Next() % 16);
+				rec.m_Quality = (float)r.NextUnit();
+				rec.m_Flags = ((r.Next() % 100) == 0) ? 1 : 0;
+			}
+
+			tw->AppendRows(m_Records.data(), m_Records.size(), sizeof(SBenchRecord));
+			tw->Write(os, 'TBL0');
+
+			phase.m_Blocks += 8;
+			phase.m_Bytes += m_Records.size() * (sizeof(int64_t) + sizeof(double) + sizeof(int32_t) + sizeof(float) + sizeof(uint64_t));
+		}
+
+		tw->Release();
+	}
+
+	void Read(genio::IInputStream *is, SBenchPhase &phase)
+	{
+		genio::ITableReader *tr = genio::ITableReader::Create();
+		if (!tr)
+			return;
+
+		const genio::FOURCHARCODE wanted = 'VALU';
+
+		double sum = 0;
+		while (is->NextBlockId() == 'TBL0')
+		{
+			if (!tr->Read(is, 'TBL0', &wanted, 1))
+				break;
+
+			const double *values = (const double *)tr->GetColumn('VALU');
+			for (size_t i = 0, n = tr->GetRowCount(); i < n; i++)
+				sum += values[i];
+
+			phase.m_Blocks += 3;
+			phase.m_Bytes += tr->GetRowCount() * sizeof(double);
+		}
+
+		m_Sum = sum;
+
+		tr->Release();
+	}
+
+protected:
+	SBenchShape m_Shape;
+	std::vector<SBenchRecord> m_Records;
+	double m_Sum;		// keeps the analytics pass from being optimized away
+};
+
+
+// ************************************************************************
+// Driver
+
+template <class TScenario> bool RunScenario(TScenario &scenario, const SBenchBackend &backend, const TCHAR *filename, SBenchResult &result)
+{
+	backend.m_Remove(filename);
+
+	genio::IOutputStream *os = backend.m_CreateOutput(filename);
+	if (!os)
+		return false;
+
+	uint64_t allocs = s_HeapAllocs;
+	double t0 = BenchSeconds();
+	scenario.Write(os, result.m_Write);
+	os->Close();
+	result.m_Write.m_Seconds = BenchSeconds() - t0;
+	result.m_Write.m_Allocs = s_HeapAllocs - allocs;
+	os->GetStats(result.m_Write.m_Stats);
+	os->Release();
+
+	genio::IInputStream *is = backend.m_CreateInput(filename);
+	if (!is)
+		return false;
+
+	allocs = s_HeapAllocs;
+	t0 = BenchSeconds();
+	scenario.Read(is, result.m_Read);
+	is->Close();
+	result.m_Read.m_Seconds = BenchSeconds() - t0;
+	result.m_Read.m_Allocs = s_HeapAllocs - allocs;
+	is->GetStats(result.m_Read.m_Stats);
+	is->Release();
+
+	return true;
+}
+
+
+// The small files scenario does its own opening and closing, so it has its own driver
+static bool RunSmallFiles(const SBenchShape &shape, const TCHAR *filename, SBenchResult &result)
+{
+	genio::IStreamPool *pool = genio::IStreamPool::Create(1);
+	if (!pool)
+		return false;
+
+	CSmallFilesScenario scenario(shape);
+
+	// the first save and load size the pooled streams' buffers
+	SBenchPhase warmup = { };
+	bool ret = scenario.Save(pool, filename, 0, warmup) && scenario.Load(pool, filename, warmup);
+
+	for (size_t i = 0; ret && (i < scenario.Count()); i++)
+	{
+		uint64_t allocs = s_HeapAllocs;
+		double t0 = BenchSeconds();
+		ret = scenario.Save(pool, filename, i, result.m_Write);
+		result.m_Write.m_Seconds += BenchSeconds() - t0;
+		result.m_Write.m_Allocs += s_HeapAllocs - allocs;
+
+		allocs = s_HeapAllocs;
+		t0 = BenchSeconds();
+		ret = ret && scenario.Load(pool, filename, result.m_Read);
+		result.m_Read.m_Seconds += BenchSeconds() - t0;
+		result.m_Read.m_Allocs += s_HeapAllocs - allocs;
+	}
+
+	pool->Release();
+
+	DeleteFile(filename);
+
+	return ret;
+}
+
+
+static void PrintPhase(const TCHAR *name, const SBenchPhase &phase)
+{
+	double mbps = phase.m_Seconds > 0 ? ((double)phase.m_Bytes / (1024.0 * 1024.0)) / phase.m_Seconds : 0;
+	double bps = phase.m_Seconds > 0 ? (double)phase.m_Blocks / phase.m_Seconds : 0;
+
+	// the bytes that actually went to or from the OS, which is less than m_Bytes when data is encoded
+	double osmb = (double)(phase.m_Stats.m_BytesRead + phase.m_Stats.m_BytesWritten) / (1024.0 * 1024.0);
+
+	_tprintf(_T("  %-6s %10.4fs %10.2f MB/s %12.0f blocks/s %8.2f syscalls/block %10.2f MB I/O %10llu allocs\n"), name, phase.m_Seconds, mbps, bps, SyscallsPerBlock(phase), osmb, phase.m_Allocs);
+}
+
+
+static void WritePhaseJson(genio::ITextOutput *out, const TCHAR *name, const SBenchPhase &phase, bool last)
+{
+	double mbps = phase.m_Seconds > 0 ? ((double)phase.m_Bytes / (1024.0 * 1024.0)) / phase.m_Seconds : 0;
+	double bps = phase.m_Seconds > 0 ? (double)phase.m_Blocks / phase.m_Seconds : 0;
+
+	out->PrintF(_T("\"%s\": { \"seconds\": %.6f, \"bytes\": %llu, \"blocks\": %llu, \"mb_per_sec\": %.3f, \"blocks_per_sec\": %.1f, "),
+		name, phase.m_Seconds, phase.m_Bytes, phase.m_Blocks, mbps, bps);
+	out->PrintF(_T("\"os_reads\": %llu, \"os_writes\": %llu, \"os_seeks\": %llu, \"os_bytes_read\": %llu, \"os_bytes_written\": %llu, \"os_microseconds\": %llu, \"syscalls_per_block\": %.3f, \"heap_allocs\": %llu }%s"),
+		phase.m_Stats.m_OSReads, phase.m_Stats.m_OSWrites, phase.m_Stats.m_OSSeeks, phase.m_Stats.m_BytesRead, phase.m_Stats.m_BytesWritten,
+		phase.m_Stats.m_OSMicroseconds, SyscallsPerBlock(phase), phase.m_Allocs, last ? _T("") : _T(","));
+	out->NextLine();
+}
+
+
+static bool WriteResults(const TCHAR *filename, const SBenchShape &shape, const std::vector<SBenchResult> &results)
+{
+	genio::ITextOutput *out = genio::ITextOutput::Create(filename);
+	if (!out)
+		return false;
+
+	out->SetIndentChar(_T(' '));
+
+	out->PrintF(_T("{"));
+	out->IncIndent(2);
+	out->NextLine();
+
+	out->PrintF(_T("\"shape\": { \"depth\": %u, \"fanout\": %u, \"objects\": %u, \"min_payload\": %u, \"max_payload\": %u, \"dist\": \"%s\", \"strings\": %.3f, \"arrays\": %.3f, \"samples\": %u, \"seed\": %llu },"),
+		shape.m_Depth, shape.m_Fanout, shape.m_Objects, shape.m_MinPayload, shape.m_MaxPayload,
+		(shape.m_Dist == PD_EXPONENTIAL) ? _T("exponential") : _T("uniform"), shape.m_StringRatio, shape.m_ArrayRatio, shape.m_Samples, shape.m_Seed);
+	out->NextLine();
+
+	out->PrintF(_T("\"results\": ["));
+	out->IncIndent(2);
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const SBenchResult &r = results[i];
+
+		out->NextLine();
+		out->PrintF(_T("{"));
+		out->IncIndent(2);
+		out->NextLine();
+
+		out->PrintF(_T("\"scenario\": \"%s\", \"backend\": \"%s\", \"iteration\": %u,"), r.m_Scenario, r.m_Backend, r.m_Iteration);
+		out->NextLine();
+
+		WritePhaseJson(out, _T("write"), r.m_Write, false);
+		WritePhaseJson(out, _T("read"), r.m_Read, true);
+
+		out->DecIndent(2);
+		out->PrintF(_T("}%s"), (i < (results.size() - 1)) ? _T(",") : _T(""));
+	}
+
+	out->DecIndent(2);
+	out->NextLine();
+	out->PrintF(_T("]"));
+
+	out->DecIndent(2);
+	out->NextLine();
+	out->PrintF(_T("}"));
+	out->NextLine(0, false);
+
+	out->Release();
+
+	return true;
+}
+
+
+int _tmain(int argc, TCHAR **argv)
+{
+	SBenchShape shape;
+	shape.m_Depth = 3;
+	shape.m_Fanout = 4;
+	shape.m_Objects = 1000;
+	shape.m_MinPayload = 16;
+	shape.m_MaxPayload = 1024;
+	shape.m_Dist = PD_UNIFORM;
+	shape.m_StringRatio = 0.25;
+	shape.m_ArrayRatio = 0.25;
+	shape.m_Samples = 4096;
+	shape.m_Seed = 1;
+
+	uint32_t iterations = 3;
+	tstring scenarioname = _T("all");
+	tstring backendname = _T("all");
+	tstring filename = _T("genio_bench.dat");
+	tstring resultsname = _T("genio_bench.json");
+
+	for (int i = 1; i < argc; i++)
+	{
+		const TCHAR *arg = argv[i];
+		const TCHAR *val = (i < (argc - 1)) ? argv[i + 1] : nullptr;
+
+		if (!val)
+		{
+			_ftprintf(stderr, _T("missing value for %s\n"), arg);
+			return -1;
+		}
+
+		if (!_tcsicmp(arg, _T("-depth")))				shape.m_Depth = std::max(1, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-fanout")))			shape.m_Fanout = std::max(1, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-objects")))		shape.m_Objects = std::max(1, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-minpayload")))		shape.m_MinPayload = std::max(0, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-maxpayload")))		shape.m_MaxPayload = std::max(0, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-dist")))			shape.m_Dist = ((val[0] == _T('e')) || (val[0] == _T('E'))) ? PD_EXPONENTIAL : PD_UNIFORM;
+		else if (!_tcsicmp(arg, _T("-strings")))		shape.m_StringRatio = _tstof(val);
+		else if (!_tcsicmp(arg, _T("-arrays")))			shape.m_ArrayRatio = _tstof(val);
+		else if (!_tcsicmp(arg, _T("-samples")))		shape.m_Samples = std::max(1, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-seed")))			shape.m_Seed = _tcstoui64(val, nullptr, 10);
+		else if (!_tcsicmp(arg, _T("-iterations")))		iterations = std::max(1, _ttoi(val));
+		else if (!_tcsicmp(arg, _T("-scenario")))		scenarioname = val;
+		else if (!_tcsicmp(arg, _T("-backend")))		backendname = val;
+		else if (!_tcsicmp(arg, _T("-file")))			filename = val;
+		else if (!_tcsicmp(arg, _T("-results")))		resultsname = val;
+		else
+		{
+			_ftprintf(stderr, _T("unrecognized option %s\n"), arg);
+			return -1;
+		}
+
+		i++;
+	}
+
+	if (shape.m_MaxPayload < shape.m_MinPayload)
+		std::swap(shape.m_MaxPayload, shape.m_MinPayload);
+
+	bool run_synthetic = !_tcsicmp(scenarioname.c_str(), _T("all")) || !_tcsicmp(scenarioname.c_str(), _T("synthetic"));
+	bool run_readme = !_tcsicmp(scenarioname.c_str(), _T("all")) || !_tcsicmp(scenarioname.c_str(), _T("readme"));
+	bool run_telemetry = !_tcsicmp(scenarioname.c_str(), _T("all")) || !_tcsicmp(scenarioname.c_str(), _T("telemetry"));
+	bool run_telemetry_raw = !_tcsicmp(scenarioname.c_str(), _T("all")) || !_tcsicmp(scenarioname.c_str(), _T("telemetry-raw"));
+	bool run_table = !_tcsicmp(scenarioname.c_str(), _T("all")) || !_tcsicmp(scenarioname.c_str(), _T("table"));
+	bool run_smallfiles = !_tcsicmp(scenarioname.c_str(), _T("all")) || !_tcsicmp(scenarioname.c_str(), _T("smallfiles"));
+	run_smallfiles &= !_tcsicmp(backendname.c_str(), _T("all")) || !_tcsicmp(backendname.c_str(), _T("pool"));
+
+	std::vector<SBenchResult> results;
+
+	for (const SBenchBackend &backend : s_Backends)
+	{
+		if (_tcsicmp(backendname.c_str(), _T("all")) && _tcsicmp(backendname.c_str(), backend.m_Name))
+			continue;
+
+		for (uint32_t it = 0; it < iterations; it++)
+		{
+			if (run_synthetic)
+			{
+				SBenchResult r = { _T("synthetic"), backend.m_Name, it };
+				CSyntheticScenario scenario(shape);
+				if (RunScenario(scenario, backend, filename.c_str(), r))
+					results.push_back(r);
+			}
+
+			if (run_readme)
+			{
+				SBenchResult r = { _T("readme"), backend.m_Name, it };
+				CReadmeScenario scenario(shape);
+				if (RunScenario(scenario, backend, filename.c_str(), r))
+					results.push_back(r);
+			}
+
+			if (run_telemetry)
+			{
+				SBenchResult r = { _T("telemetry"), backend.m_Name, it };
+				CTelemetryScenario scenario(shape, false);
+				if (RunScenario(scenario, backend, filename.c_str(), r))
+					results.push_back(r);
+			}
+
+			if (run_telemetry_raw)
+			{
+				SBenchResult r = { _T("telemetry-raw"), backend.m_Name, it };
+				CTelemetryScenario scenario(shape, true);
+				if (RunScenario(scenario, backend, filename.c_str(), r))
+					results.push_back(r);
+			}
+
+			if (run_table)
+			{
+				SBenchResult r = { _T("table"), backend.m_Name, it };
+				CTableScenario scenario(shape);
+				if (RunScenario(scenario, backend, filename.c_str(), r))
+					results.push_back(r);
+			}
+		}
+	}
+
+	for (uint32_t it = 0; run_smallfiles && (it < iterations); it++)
+	{
+		SBenchResult r = { _T("smallfiles"), _T("pool"), it };
+		if (RunSmallFiles(shape, filename.c_str(), r))
+			results.push_back(r);
+	}
+
+	for (const SBenchBackend &backend : s_Backends)
+		backend.m_Remove(filename.c_str());
+
+	bool allocfail = false;
+
+	for (const SBenchResult &r : results)
+	{
+		_tprintf(_T("%s / %s (iteration %u)\n"), r.m_Scenario, r.m_Backend, r.m_Iteration);
+		PrintPhase(_T("write"), r.m_Write);
+		PrintPhase(_T("read"), r.m_Read);
+
+		// pooled streams are supposed to be allocation-free once they're warmed up
+		if (!_tcsicmp(r.m_Backend, _T("pool")) && (r.m_Write.m_Allocs || r.m_Read.m_Allocs))
+			allocfail = true;
+	}
+
+	if (!WriteResults(resultsname.c_str(), shape, results))
+	{
+		_ftprintf(stderr, _T("unable to write results to %s\n"), resultsname.c_str());
+		return -1;
+	}
+
+	if (allocfail)
+	{
+		_ftprintf(stderr, _T("pooled streams made heap allocations after warming up\n"));
+		return -1;
+	}
+
+	return results.empty() ? -1 : 0;
+}
@@ -55,12 +55,64 @@
 #include <stdint.h>
 #include <tchar.h>
 
+#if __has_include(<version>)
+#include <version>
+#endif
+
+#if defined(__cpp_lib_span)
+#include <span>
+#include <vector>
+#endif
+
 
 namespace genio
 {
 
 	typedef uint32_t FOURCHARCODE;
 
+#define GENIO_DEFAULTALIGN		16				// the alignment IAllocator::Alloc gives when none is asked for
+
+	/// Where GenIO gets its memory. Every Create function takes one, and everything the object it creates
+	/// allocates (the object included) then comes from it; nullptr (the default everywhere) means global new / delete.
+	/// The allocator has to outlive the objects made from it
+	class IAllocator
+	{
+
+	public:
+
+		/// Returns size bytes aligned to align (a power of 2), or nullptr if there isn't enough memory
+		virtual void *Alloc(size_t size, size_t align = GENIO_DEFAULTALIGN) = NULL;
+
+		/// Gives back memory from Alloc; size is the size it was allocated with
+		virtual void Free(void *p, size_t size) = NULL;
+
+		virtual void Release() = NULL;
+
+		/// Returns an allocator that uses the CRT heap; Releasing it does nothing
+		GENIO_API static IAllocator *Default();
+
+	};
+
+	/// A bump allocator: memory is handed out from large chunks in order and Free doesn't give it back
+	/// (except for the most recent allocation); Reset does, all at once, and the chunks are kept for reuse.
+	/// Arenas aren't thread safe, so give each thread (or each request) its own. Release the objects
+	/// made from an arena before you Reset it, so that they can close their files
+	class IArenaAllocator : public IAllocator
+	{
+
+	public:
+
+		/// Frees everything allocated from the arena
+		virtual void Reset() = NULL;
+
+		/// Returns the number of bytes allocated since the arena was created or last Reset, including alignment padding
+		virtual size_t GetBytesUsed() const = NULL;
+
+		/// Creates an arena that gets its chunks, at least chunksize bytes apiece, from backing (nullptr for the CRT heap)
+		GENIO_API static IArenaAllocator *Create(size_t chunksize = (64 << 10), IAllocator *backing = nullptr);
+
+	};
+
 #if defined(UNICODE) || defined(_UNICODE)
 #define IParserT IParserW
 #define CM_TCHAR CM_UNICODE
@@ -124,7 +176,7 @@ namespace genio
 		virtual uint64_t GetModeFlags() = NULL;
 
 		/// Creates an IParser in the mode you desire, ASCII or Unicode. Specify CM_TCHAR to choose based on your program configuration
-		GENIO_API static IParser *Create(CHAR_MODE mode);
+		GENIO_API static IParser *Create(CHAR_MODE mode, IAllocator *alloc = nullptr);
 
 	};
 
@@ -216,14 +268,115 @@ namespace genio
 
 		virtual void Release() = NULL;
 
-		GENIO_API static ITextOutput *Create(HANDLE h);
-		GENIO_API static ITextOutput *Create(const TCHAR *filename);
+		GENIO_API static ITextOutput *Create(HANDLE h, IAllocator *alloc = nullptr);
+		GENIO_API static ITextOutput *Create(const TCHAR *filename, IAllocator *alloc = nullptr);
 	};
 
 
 #define STRMFLG_BIGENDIAN		0x00000001		// the data in the stream is big endian if this is set, otherwise it is little endian
 #define STRMFLG_COMPRESSED		0x00000002		// the data has been lz-style compressed
 
+// Stream mode flags; see IStream::SetModeFlags
+#define STRMMODE_CHILDDIRECTORY		0x0001			// output: EndBlock appends a directory of the block's children (see IInputStream::FindChild)
+#define STRMMODE_WRITEBUFFER		0x0002			// output: writes are collected in a large buffer and go to the OS sequentially; headers of blocks still in it are patched in memory
+#define STRMMODE_READAHEAD			0x0004			// input: entering a large block reads it ahead in the background while you decode it; skipping the rest of a block stops reading it
+#define STRMMODE_SEQUENTIALSCAN		0x0008			// input: set before Open for one pass over a file; the OS reads ahead aggressively and doesn't keep the file cached at the expense of other data
+#define STRMMODE_MAPPED				0x0010			// input: set before Open; the file is mapped into memory and read from there, so typed arrays can be used in place (see IInputStream::MapTypedArray)
+#define STRMMODE_COMPRESS			0x0020			// output: blocks without children are compressed, against the stream's dictionary if it has one (see IOutputStream::SetCompressionDictionary)
+#define STRMMODE_SWMR				0x0040			// both: set before Open; one writer appends while any number of readers follow along, seeing only complete top-level blocks (see IInputStream::Refresh)
+
+// The id of the directory block at the end of a merged stream (see IStreamMerger). Its data is a UINT32 count of entries,
+// each of which is the UINT64 offset of the object in the stream, the object's id, a UINT16 key length and the key
+#define MERGEDIRECTORYID			'MDIR'
+
+// The blocks written by IObjectRefWriter ahead of an object; each holds the UINT32 id of the object. OID0 marks the first
+// occurrence, which is followed by the object itself, and ORF0 a later one (or a null reference, if the id is 0)
+#define OBJECTIDBLOCKID				'OID0'
+#define OBJECTREFBLOCKID			'ORF0'
+
+// The block at the start of a stream that holds the dictionary its blocks were compressed against; its data is the dictionary
+#define COMPRESSIONDICTIONARYID		'CDIC'
+
+// In STRMMODE_COMPRESS, blocks with more data than this are written as they are
+#define COMPRESSION_MAXBLOCK		(64 << 10)
+#define COMPRESSION_MAXDICTIONARY	(64 << 10)
+
+// The blocks of a patch made by IStreamDiff. PHDR comes first, holding a UINT32 version (PATCH_VERSION), the UINT64 size
+// and hash of the stream the patch applies to and the UINT64 size of the stream it makes. PCPY blocks (a UINT64 offset
+// and length of bytes to copy from the old stream) and PDAT blocks (a UINT32 length and that many new bytes) follow,
+// in the order their bytes appear in the new stream
+#define PATCHHEADERID				'PHDR'
+#define PATCHCOPYID					'PCPY'
+#define PATCHDATAID					'PDAT'
+#define PATCH_VERSION				1
+
+// The block at the start of a stream written in STRMMODE_SWMR; it holds the UINT64 length of the stream that readers may see
+#define SWMRHEADERID				'SWMR'
+
+// The block at the end of a stream that indexes its top-level blocks by the keys given to IOutputStream::AddKey
+#define KEYINDEXID					'KIDX'
+
+	/// I/O counters that are kept for every stream; see IStream::GetStats
+	struct SStreamStats
+	{
+		uint64_t m_BytesRead;			/// bytes moved from the OS into the stream
+		uint64_t m_BytesWritten;		/// bytes moved from the stream to the OS
+		uint64_t m_OSReads;				/// number of OS read calls
+		uint64_t m_OSWrites;			/// number of OS write calls
+		uint64_t m_OSSeeks;				/// number of OS file pointer calls (including those made to query the position); input streams keep their own position, so they only make these to find the end of the file
+		uint64_t m_BlocksBegun;			/// number of successful BeginBlock calls
+		uint64_t m_BlocksEnded;			/// number of EndBlock calls
+		uint32_t m_MaxDepth;			/// the deepest block nesting seen
+		uint64_t m_OSMicroseconds;		/// time spent inside OS I/O calls
+	};
+
+	/// One piece of a scattered buffer; see IOutputStream::WriteV and IInputStream::ReadV
+	struct SIOSegment
+	{
+		void *m_Data;
+		size_t m_Length;
+	};
+
+#define STREAMCURSOR_MAXDEPTH		16				// the deepest block nesting an SStreamCursor can hold
+
+	/// A saved input position, including the blocks that were open there; see IInputStream::SaveCursor
+	struct SStreamCursor
+	{
+		struct SOpenBlock
+		{
+			uint64_t m_Start;			/// the offset of the block's data
+			uint64_t m_Length;			/// the length of the block's data
+			FOURCHARCODE m_ID;
+			uint32_t m_Flags;
+		};
+
+		uint64_t m_Pos;
+		uint32_t m_Depth;				/// the number of entries used in m_Blocks, outermost first
+		SOpenBlock m_Blocks[STREAMCURSOR_MAXDEPTH];
+	};
+
+	class IStream;
+
+	/// Describes a block being entered or left; see IStream::SetBlockCallback
+	struct SBlockEvent
+	{
+		typedef enum
+		{
+			BE_BEGIN = 0,
+			BE_END
+		} EVENT_TYPE;
+
+		EVENT_TYPE m_Type;
+		IStream *m_Stream;				/// the stream that the block belongs to
+		FOURCHARCODE m_ID;				/// the block's identifier
+		uint32_t m_Depth;				/// 1 for top-level blocks, 2 for their children, etc.
+		uint64_t m_Offset;				/// stream position of the start of the block's data (just after its header)
+		uint64_t m_Length;				/// length of the block's data; output streams only know this when the block ends
+		uint64_t m_Timestamp;			/// time the event happened, in nanoseconds
+	};
+
+	typedef void (*BLOCK_CALLBACK)(const SBlockEvent &ev, void *userdata);
+
 	class IStream
 	{
 
@@ -243,6 +396,33 @@ namespace genio
 			ENDBLOCKID = 0
 		};
 
+		/// Encodings for array blocks; see IOutputStream::WriteArrayINT64 / WriteArrayDouble
+		enum ARRAY_CODEC
+		{
+			AC_RAW = 0,			/// elements are stored as they are
+			AC_DELTADELTA,		/// integers only; delta-of-delta, bit-packed. Best for timestamps, counters and sequence numbers
+			AC_XOR,				/// doubles only; each value is XOR'd with the one before it and the bits that changed are packed. Best for slowly varying measurements
+
+			AC_NUMCODECS
+		};
+
+		/// Element types for typed arrays; see IOutputStream::WriteTypedArray
+		enum ELEMENT_TYPE
+		{
+			ET_INT8 = 0,
+			ET_UINT8,
+			ET_INT16,
+			ET_UINT16,
+			ET_INT32,
+			ET_UINT32,
+			ET_INT64,
+			ET_UINT64,
+			ET_FLOAT,
+			ET_DOUBLE,
+
+			ET_NUMTYPES
+		};
+
 		virtual bool Assign(const TCHAR *filename) = NULL;
 		virtual bool Open() = NULL;
 		virtual void Close() = NULL;
@@ -255,6 +435,23 @@ namespace genio
 		virtual bool BeginBlock(FOURCHARCODE id) = NULL;
 		virtual void EndBlock() = NULL;
 
+		/// Fills stats with the counters accumulated since the stream was created or ResetStats was
+		/// last called. Returns false (and zeroes stats) if GenIO was built with GENIO_NOSTATS
+		virtual bool GetStats(SStreamStats &stats) const = NULL;
+
+		/// Zeroes all of the stream's I/O counters
+		virtual void ResetStats() = NULL;
+
+		/// Sets the STRMMODE_* flags that control stream operations
+		virtual void SetModeFlags(uint64_t flags) = NULL;
+
+		/// Gets the STRMMODE_* flags that control stream operations
+		virtual uint64_t GetModeFlags() const = NULL;
+
+		/// Sets a function that will be called whenever a block is begun or ended on this stream;
+		/// pass nullptr to remove it. Only one callback may be set per stream
+		virtual void SetBlockCallback(BLOCK_CALLBACK func, void *userdata = nullptr) = NULL;
+
 		virtual void Release() = NULL;
 
 	};
@@ -267,8 +464,83 @@ namespace genio
 		virtual FOURCHARCODE NextBlockId() = NULL;
 		virtual size_t NextBlockSize() = NULL;
 
+		/// Locates a block by its path from the top level of the stream, i.e. "SCN0/OBJ0[17]/INF1", where
+		/// [n] picks the n-th (zero-based) block with that id amongst its siblings; [0] is implied if omitted.
+		/// Only block headers are read to resolve the path, and every header that is seen along the way is
+		/// remembered, so repeated lookups into the same file don't re-scan it.
+		/// On success, the stream is positioned at the block's header with the block's ancestors open,
+		/// so BeginBlock(id) enters it and an EndBlock for each ancestor leaves them; any blocks that were
+		/// open beforehand are abandoned. On failure, the stream is left as it was
+		virtual bool Find(const TCHAR *path) = NULL;
+
+		/// Locates the index-th (zero-based) child block with the given id inside the current block.
+		/// If the block was written with STRMMODE_CHILDDIRECTORY, its directory answers this without visiting
+		/// any siblings (and a miss usually costs no more than reading the directory's bloom filter),
+		/// otherwise the children's headers are scanned. On success, the stream is positioned at the
+		/// child's header so that BeginBlock(id) enters it; on failure, the position is unchanged
+		virtual bool FindChild(FOURCHARCODE id, uint32_t index = 0) = NULL;
+
+		/// Saves the current position and the blocks that are open, so that you can try to read what follows
+		/// one way and go back to try another if it doesn't work out. Returns false if more than
+		/// STREAMCURSOR_MAXDEPTH blocks are open
+		virtual bool SaveCursor(SStreamCursor &cursor) const = NULL;
+
+		/// Returns to a position saved with SaveCursor, re-opening the blocks that were open then without
+		/// reading their headers again (and without firing the block callback); anything the stream has
+		/// cached about the file, like the blocks found with Find, is kept
+		virtual bool RestoreCursor(const SStreamCursor &cursor) = NULL;
+
+		/// Returns the number of elements in the array block at the current position (where you would call BeginBlock)
+		virtual size_t NextArrayCount() = NULL;
+
+		/// Reads an array block written with WriteArrayINT64 / WriteArrayDouble, decoding up to maxcount elements into data;
+		/// any more than that are skipped. Returns the number of elements read, or 0 if the next block isn't an array of that type with the given id
+		virtual size_t ReadArrayINT64(FOURCHARCODE id, int64_t *data, size_t maxcount) = NULL;
+		virtual size_t ReadArrayDouble(FOURCHARCODE id, double *data, size_t maxcount) = NULL;
+
+		/// Returns a pointer to the elements of the typed array block with the given id, right where they are in the
+		/// stream's memory, and moves past the block; the pointer stays valid until the stream is closed. That's only
+		/// possible if the stream was opened with STRMMODE_MAPPED and the elements are in this machine's byte order;
+		/// otherwise (or if the next block isn't a typed array of that type with the given id) this returns NULL
+		/// and leaves the stream where it was, so you can ReadTypedArray instead. NextArrayCount gives the count
+		virtual const void *MapTypedArray(FOURCHARCODE id, ELEMENT_TYPE type, size_t &count) = NULL;
+
+		/// Copies up to maxcount elements of a typed array block into data, converting them to this machine's byte order
+		/// if need be; any more than that are skipped. Returns the number of elements read, or 0 if the next block isn't
+		/// a typed array of that type with the given id
+		virtual size_t ReadTypedArray(FOURCHARCODE id, ELEMENT_TYPE type, void *data, size_t maxcount) = NULL;
+
 		virtual size_t Read(void *data, size_t size, size_t number = 1) = NULL;
 
+		/// Reads consecutive data from the stream into a number of separate buffers, with as few OS calls as possible.
+		/// Returns the total number of bytes read
+		virtual size_t ReadV(const SIOSegment *segments, size_t count) = NULL;
+
+		/// Reads len bytes from offset bytes into the data of the current block, in a single read (or a copy, if the
+		/// stream is mapped), without moving the stream's position. The range is clipped to the end of the block;
+		/// returns the number of bytes read, which is 0 if no block is open or offset is past its end
+		virtual size_t ReadAt(uint64_t offset, void *data, size_t len) = NULL;
+
+		/// Moves the position forward by count bytes without reading anything, stopping at the end of the current
+		/// block; returns how far it moved, which is 0 if no block is open
+		virtual uint64_t SkipInBlock(uint64_t count) = NULL;
+
+		/// In STRMMODE_SWMR, the stream ends after the last top-level block the writer had finished when it was opened
+		/// (it starts after the SWMR block, too). This reads the writer's commit marker again and extends the stream
+		/// to cover any blocks finished since, returning true if there are some. Pointers from MapTypedArray don't
+		/// survive a refresh that finds more of the file. Returns false in any other mode
+		virtual bool Refresh() = NULL;
+
+		/// In STRMMODE_SWMR, waits up to timeout milliseconds (or INFINITE) for the writer to finish another top-level
+		/// block, then refreshes; returns true if there's more to read. Nothing the writer does waits on readers
+		virtual bool WaitForCommit(uint32_t timeout) = NULL;
+
+		/// Locates the top-level block that was given key (see IOutputStream::AddKey) with the stream's key index.
+		/// The index is read, in one read, the first time; after that, finding a key takes no I/O at all. On success,
+		/// the stream is positioned at the block's header with no blocks open, so BeginBlock enters it; if more than one
+		/// block has the key, it's the first of them. On failure (or if there's no index), the stream is left as it was
+		virtual bool FindByKey(uint64_t key) = NULL;
+
 		virtual void ReadINT64		(int64_t	&d) = NULL;
 		virtual void ReadUINT64		(uint64_t	&d) = NULL;
 		virtual void ReadINT32		(int32_t	&d) = NULL;
@@ -285,7 +557,31 @@ namespace genio
 		virtual void ReadStringA	(char		*d) = NULL;
 		virtual void ReadStringW	(wchar_t	*d) = NULL;
 
-		GENIO_API static IInputStream *Create(HANDLE h = NULL);
+		/// Creates an input stream; if a handle is given, the stream reads from it starting at its current position.
+		/// Input streams read at their own position rather than through the handle's file pointer, so any number
+		/// of them may share one handle
+		GENIO_API static IInputStream *Create(HANDLE h = NULL, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// A file that is opened once, read-only, and read by any number of threads at the same time through cursors.
+	/// Each cursor is an input stream with its own position and block stack that doesn't lock anything to read;
+	/// a cursor must only be used by one thread at a time, but cursors are cheap, so make one per request
+	class ISharedInputFile
+	{
+
+	public:
+
+		/// Creates a new cursor, positioned at the start of the file; Release it when you're done.
+		/// The cursor's memory comes from alloc rather than the file's allocator, so each thread can use its own
+		virtual IInputStream *CreateCursor(IAllocator *alloc = nullptr) = NULL;
+
+		/// The file stays open until this and every cursor have been released
+		virtual void Release() = NULL;
+
+		/// Opens the file; returns nullptr if it can't be opened
+		GENIO_API static ISharedInputFile *Create(const TCHAR *filename, IAllocator *alloc = nullptr);
 
 	};
 
@@ -296,6 +592,37 @@ namespace genio
 
 		virtual size_t Write(const void *data, size_t size, size_t number = 1) = NULL;
 
+		/// Writes a number of separate buffers to the stream, one after another, with as few OS calls as possible;
+		/// i.e. a header struct, a vertex buffer and an index buffer. Returns the total number of bytes written
+		virtual size_t WriteV(const SIOSegment *segments, size_t count) = NULL;
+
+		/// Writes an entire array as a block with the given id, encoded with the given codec; if the codec doesn't apply to
+		/// the element type, the array is stored raw. Read them back with IInputStream::ReadArrayINT64 / ReadArrayDouble
+		virtual bool WriteArrayINT64(FOURCHARCODE id, const int64_t *data, size_t count, ARRAY_CODEC codec = AC_DELTADELTA) = NULL;
+		virtual bool WriteArrayDouble(FOURCHARCODE id, const double *data, size_t count, ARRAY_CODEC codec = AC_XOR) = NULL;
+
+		/// Writes an array of elements of the given type as a block with the given id, as they are, padded so that the
+		/// first element is at a multiple of alignment (a power of two, up to 4096) in the file. A stream that maps the
+		/// file can then hand the elements out in place; see IInputStream::MapTypedArray
+		virtual bool WriteTypedArray(FOURCHARCODE id, ELEMENT_TYPE type, const void *data, size_t count, size_t alignment = GENIO_DEFAULTALIGN) = NULL;
+
+		/// Copies the next block in the input stream to this one as it is, header, data and children, without decoding
+		/// any of it, and leaves the input after it. Use it to pass blocks you don't need to look at through when
+		/// filtering or rewriting a file. Returns false if there was no block to copy
+		virtual bool CopyBlockFrom(IInputStream *is) = NULL;
+
+		/// Writes a dictionary (see IDictionaryTrainer) for STRMMODE_COMPRESS to compress blocks against, as a
+		/// COMPRESSIONDICTIONARYID block; call it right after Open, before anything else is written. Input streams
+		/// pick it up by themselves when they first enter a compressed block. Since CopyBlockFrom copies compressed
+		/// blocks as they are, only copy them between streams with the same dictionary
+		virtual bool SetCompressionDictionary(const void *dict, size_t len) = NULL;
+
+		/// Gives the top-level block that's open (or, if none is, the last one written) a key, i.e. the id of the
+		/// object in it, so that IInputStream::FindByKey can go straight to it. Keys are kept until Close, which writes
+		/// them, sorted, in a KEYINDEXID block at the end of the stream. The stream's own blocks, such as the
+		/// compression dictionary, can't be keyed. Returns false if there's no block to key
+		virtual bool AddKey(uint64_t key) = NULL;
+
 		virtual void WriteINT64		(int64_t	d) = NULL;
 		virtual void WriteUINT64	(uint64_t	d) = NULL;
 		virtual void WriteINT32		(int32_t	d) = NULL;
@@ -311,7 +638,401 @@ namespace genio
 		virtual void WriteStringA	(const char		*d) = NULL;
 		virtual void WriteStringW	(const wchar_t	*d) = NULL;
 
-		GENIO_API static IOutputStream *Create(HANDLE h = NULL);
+		GENIO_API static IOutputStream *Create(HANDLE h = NULL, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Keeps stream objects around for reuse, for when many small files are opened and closed. Releasing a stream
+	/// that came from a pool closes it and gives it back rather than deleting it; its stats, mode flags and block
+	/// callback are reset, but its internal buffers are kept, so once a pool is warmed up, opening, loading or
+	/// saving and closing files through it doesn't touch the heap. A pool may be used from multiple threads,
+	/// but each stream is still only used by one thread at a time
+	class IStreamPool
+	{
+
+	public:
+
+		/// Gets a file input stream from the pool, creating one if none are free; Release it when you're done
+		virtual IInputStream *AcquireInputStream() = NULL;
+
+		/// Gets a file output stream from the pool, creating one if none are free; Release it when you're done
+		virtual IOutputStream *AcquireOutputStream() = NULL;
+
+		/// Deletes the free streams; streams that are still out are deleted when they're released
+		virtual void Release() = NULL;
+
+		/// Creates a pool, with reserve input streams and reserve output streams created up front
+		GENIO_API static IStreamPool *Create(size_t reserve = 0, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Merges any number of GenIO streams into one, copying their top-level blocks across without decoding them
+	/// (see IOutputStream::CopyBlockFrom). Objects can be given a key: the data of one of their child blocks. When
+	/// several objects have the same key, only the last one is kept, and an object that has a tombstone child
+	/// block removes every object before it with the same key, itself included. The merged stream ends with a
+	/// MERGEDIRECTORYID block listing every object that was written, its offset, and its key. Objects whose key is
+	/// 8 bytes long, i.e. a UINT64 id, are also given that key with IOutputStream::AddKey, so they can be found with
+	/// IInputStream::FindByKey once the output is closed
+	class IStreamMerger
+	{
+
+	public:
+
+		/// Adds an input; inputs added later supersede those added earlier. The merger reads from the input's
+		/// current position to the end of it, but doesn't take ownership of it
+		virtual void AddInput(IInputStream *is) = NULL;
+
+		/// Sets the id of the child block whose data is an object's key; top-level blocks without one are always kept
+		virtual void SetKeyBlock(FOURCHARCODE id) = NULL;
+
+		/// Sets the id of the child block that marks an object as deleted
+		virtual void SetTombstoneBlock(FOURCHARCODE id) = NULL;
+
+		/// Scans the inputs, in parallel, then writes the surviving blocks to the output in input order, followed by
+		/// the directory. Turn on STRMMODE_WRITEBUFFER for the output to write it in large sequential pieces.
+		/// Compressed blocks are copied as they are, so the inputs must all have the same compression dictionary, or
+		/// none; it's written to the output once, so the output must have nothing in it yet. Returns the number of
+		/// blocks written, or 0 if the inputs' dictionaries differ
+		virtual size_t Merge(IOutputStream *os) = NULL;
+
+		virtual void Release() = NULL;
+
+		GENIO_API static IStreamMerger *Create(IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// What the last IStreamDiff::Diff or Apply did
+	struct SPatchStats
+	{
+		uint64_t m_BytesCopied;			/// bytes of the new stream that come from the old one
+		uint64_t m_BytesAdded;			/// bytes of the new stream that are in the patch
+		uint64_t m_Copies;				/// number of PCPY blocks
+		uint64_t m_Additions;			/// number of PDAT blocks
+	};
+
+
+	/// Compares two versions of a stream block by block and makes a patch that turns one into the other, so that
+	/// after a small edit to a large file, only about as much as was edited has to be sent to wherever the old
+	/// version already is. Blocks are matched by a hash of their contents, wherever they are; a block that has
+	/// changed is compared child by child with the block with the same id (and occurrence) in the old stream,
+	/// so only the blocks that really changed end up in the patch
+	class IStreamDiff
+	{
+
+	public:
+
+		/// Writes a patch that turns oldis into newis to patch. Both inputs are read from their starts, without
+		/// opening any blocks; opening them with STRMMODE_MAPPED makes walking the headers cheaper. Turn on
+		/// STRMMODE_COMPRESS for the patch to compress the new data in it
+		virtual bool Diff(IInputStream *oldis, IInputStream *newis, IOutputStream *patch) = NULL;
+
+		/// Writes the new stream to os from the old one and a patch made by Diff. Returns false if oldis isn't the
+		/// stream the patch was made from (its size and hash are checked first) or the patch is damaged; os
+		/// should be thrown away then
+		virtual bool Apply(IInputStream *oldis, IInputStream *patch, IOutputStream *os) = NULL;
+
+		/// Gets the counts for the last Diff or Apply
+		virtual void GetStats(SPatchStats &stats) const = NULL;
+
+		virtual void Release() = NULL;
+
+		GENIO_API static IStreamDiff *Create(IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// An output stream that is split across numbered segment files ("<manifest>.000", "<manifest>.001", ...),
+	/// each of which is a complete GenIO stream holding whole top-level blocks, plus a manifest listing them
+	/// (itself a GenIO stream) that is written on Close. Assign names the manifest. Positions are logical,
+	/// counting from the start of the first segment; segments that have been finished can't be seeked into
+	class ISegmentedOutputStream : public IOutputStream
+	{
+
+	public:
+
+		/// Sets the size at which the next top-level block goes into a new segment; since segments only roll
+		/// over between top-level blocks, a segment will exceed this by up to the size of its last top-level block
+		virtual void SetSegmentSize(uint64_t size) = NULL;
+
+		/// Adds a folder (i.e., on another volume) that segments may be written to; segments are spread
+		/// across the folders round-robin. If none are added, segments are written next to the manifest
+		virtual void AddSegmentFolder(const TCHAR *folder) = NULL;
+
+		/// Returns the number of segments that have been started
+		virtual size_t GetSegmentCount() const = NULL;
+
+		GENIO_API static ISegmentedOutputStream *Create(uint64_t segment_size, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Reads the segments written by an ISegmentedOutputStream as one logical stream; Assign names the manifest.
+	/// Like all streams, this one must only be used by one thread at a time, but since every segment is
+	/// a complete stream, OpenSegment lets you hand segments to different threads and read them at once
+	class ISegmentedInputStream : public IInputStream
+	{
+
+	public:
+
+		/// Returns the number of segments listed in the manifest
+		virtual size_t GetSegmentCount() const = NULL;
+
+		/// Returns the logical position that the given segment starts at
+		virtual uint64_t GetSegmentStart(size_t segment) const = NULL;
+
+		/// Opens a new, independent input stream on the given segment; Release it when you're done.
+		/// Its memory comes from alloc rather than this stream's allocator, so each thread can use its own
+		virtual IInputStream *OpenSegment(size_t segment, IAllocator *alloc = nullptr) const = NULL;
+
+		GENIO_API static ISegmentedInputStream *Create(IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Describes one column of a table; see ITableWriter
+	struct STableColumn
+	{
+		typedef enum
+		{
+			CT_INT8 = 0,
+			CT_UINT8,
+			CT_INT16,
+			CT_UINT16,
+			CT_INT32,
+			CT_UINT32,
+			CT_INT64,
+			CT_UINT64,
+			CT_FLOAT,
+			CT_DOUBLE,
+
+			CT_NUMTYPES
+		} COLUMN_TYPE;
+
+		FOURCHARCODE m_ID;				/// the id of the column's block; must be unique within the table
+		COLUMN_TYPE m_Type;
+		IStream::ARRAY_CODEC m_Codec;	/// AC_DELTADELTA applies to 64-bit integer columns and AC_XOR to double columns; all others are stored raw
+		size_t m_Offset;				/// where the field is in your record structure, i.e. offsetof(SMyRecord, m_Field)
+	};
+
+
+	/// Collects rows of records and writes them as a table block, in which every column is stored contiguously
+	/// in a block of its own; that keeps like data together (which encodes far better) and lets readers load only
+	/// the columns they need. The table block holds a schema block, then the column blocks, then a terminator
+	class ITableWriter
+	{
+
+	public:
+
+		/// Appends a row, copying each column's field out of the given record
+		virtual void AppendRow(const void *record) = NULL;
+
+		/// Appends count rows from an array of records that are stride bytes apart
+		virtual void AppendRows(const void *records, size_t count, size_t stride) = NULL;
+
+		/// Returns the number of rows appended since the table was created or last written
+		virtual size_t GetRowCount() const = NULL;
+
+		/// Writes the rows as a table block with the given id, then discards them so that the next table can be built
+		virtual bool Write(IOutputStream *os, FOURCHARCODE id) = NULL;
+
+		virtual void Release() = NULL;
+
+		/// Creates a table writer for the given columns; returns NULL if any of them are invalid
+		GENIO_API static ITableWriter *Create(const STableColumn *columns, size_t numcolumns, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Loads the columns of a table block written by ITableWriter
+	class ITableReader
+	{
+
+	public:
+
+		/// Reads the table block with the given id at the stream's current position, loading only the given
+		/// columns (or all of them if columns is NULL); the blocks of the other columns are skipped without being read
+		virtual bool Read(IInputStream *is, FOURCHARCODE id, const FOURCHARCODE *columns = nullptr, size_t numcolumns = 0) = NULL;
+
+		/// Returns the number of rows in the table that was last read
+		virtual size_t GetRowCount() const = NULL;
+
+		/// Returns the number of columns in the table's schema, whether they were loaded or not
+		virtual size_t GetColumnCount() const = NULL;
+
+		/// Describes the index-th column in the table's schema (m_Offset is meaningless here)
+		virtual bool GetColumnInfo(size_t index, STableColumn &column) const = NULL;
+
+		/// Returns a loaded column as a contiguous array of GetRowCount() elements of its type, or NULL if it wasn't loaded
+		virtual const void *GetColumn(FOURCHARCODE id) const = NULL;
+
+		virtual void Release() = NULL;
+
+		GENIO_API static ITableReader *Create(IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Handles a block for an IBlockDispatcher; the block has been begun, and is ended after this returns.
+	/// Return false to report that the block couldn't be loaded
+	typedef bool (*BLOCK_HANDLER)(IInputStream *is, FOURCHARCODE id, void *userdata);
+
+#define BLOCKHANDLER_PARALLEL		0x0001			// the handler doesn't depend on any other handler having run, and may run on the thread pool at the same time as others (see IBlockDispatcher::Dispatch)
+
+	/// Runs the block loop for you: handlers are registered by block id, and Dispatch goes through the children
+	/// of the current block, passing each one to its handler. Blocks without one go to the default handler if
+	/// there is one, and are otherwise skipped without reading any of their data
+	class IBlockDispatcher
+	{
+
+	public:
+
+		/// Sets the function that handles blocks with the given id, replacing any that was set before; pass a NULL func
+		/// to remove it. flags are BLOCKHANDLER_*. Returns false for ENDBLOCKID, since that ends the loop
+		virtual bool SetHandler(FOURCHARCODE id, BLOCK_HANDLER func, void *userdata = nullptr, uint32_t flags = 0) = NULL;
+
+		/// Sets the function that handles blocks that have no handler of their own; pass NULL to skip them
+		virtual void SetDefaultHandler(BLOCK_HANDLER func, void *userdata = nullptr) = NULL;
+
+		/// Goes through the children of the block that is open in the stream, up to and including its terminator,
+		/// so that all that's left is to EndBlock the parent. If shared is given (and is the file the stream is
+		/// reading), blocks whose handlers were set with BLOCKHANDLER_PARALLEL are each handed to the thread pool
+		/// with a cursor of their own, and the loop carries on without waiting for them; they will all have
+		/// finished by the time this returns. Returns false if any handler did. A handler may call Dispatch to go
+		/// through its own block's children, except one that runs on the thread pool, which must use a dispatcher
+		/// of its own
+		virtual bool Dispatch(IInputStream *is, ISharedInputFile *shared = nullptr) = NULL;
+
+		virtual void Release() = NULL;
+
+		GENIO_API static IBlockDispatcher *Create(IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Writes an object graph in which an object may be referred to more than once (or refer back to one
+	/// of its ancestors) so that every object is stored only once. Wherever you would save a pointed-to object,
+	/// call WriteReference first: the first time an object is seen, it's given an id, an OID0 block is written,
+	/// and you save the object right after it; every other time, only an ORF0 block with its id is written.
+	/// Ids are scoped to the writer, so use one per stream
+	class IObjectRefWriter
+	{
+
+	public:
+
+		/// Writes the reference block for obj (which may be NULL) and returns true if the object itself
+		/// should be saved next, or false if it has already been written and the reference is all that's needed
+		virtual bool WriteReference(IOutputStream *os, const void *obj) = NULL;
+
+		/// Returns the id given to obj, or 0 if it hasn't been written
+		virtual uint32_t GetObjectId(const void *obj) const = NULL;
+
+		/// Returns the number of objects that have been given ids
+		virtual size_t GetObjectCount() const = NULL;
+
+		/// Forgets every object, so that the writer can be used for another stream
+		virtual void Reset() = NULL;
+
+		virtual void Release() = NULL;
+
+		/// Creates a writer; reserve pre-sizes its table for that many objects
+		GENIO_API static IObjectRefWriter *Create(size_t reserve = 0, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Reads the references written by IObjectRefWriter and rebuilds the graph's sharing. Call ReadReference where
+	/// WriteReference was called; if the object follows, create it, give it to SetObject before loading it (so
+	/// that anything inside it that refers back to it can be resolved), then load it. Otherwise, the reference
+	/// resolves to an object that was loaded earlier in the stream
+	class IObjectRefReader
+	{
+
+	public:
+
+		/// Reads the reference block at the stream's current position. Returns true if it's the first occurrence
+		/// of an object, which follows it in the stream, and sets objid to the id to give to SetObject. Returns false
+		/// for a reference to an object that has been read already, setting obj to it, or for a NULL reference,
+		/// an id that's out of sequence (i.e. a corrupt one) or when the next block isn't a reference at all,
+		/// setting obj to NULL; objid is 0 in those cases
+		virtual bool ReadReference(IInputStream *is, uint32_t &objid, void *&obj) = NULL;
+
+		/// Associates an object you created with the id that ReadReference returned
+		virtual void SetObject(uint32_t objid, void *obj) = NULL;
+
+		/// Returns the object with the given id, or NULL if there isn't one
+		virtual void *GetObject(uint32_t objid) const = NULL;
+
+		/// Forgets every object, so that the reader can be used for another stream
+		virtual void Reset() = NULL;
+
+		virtual void Release() = NULL;
+
+		/// Creates a reader; reserve pre-sizes its table for that many objects
+		GENIO_API static IObjectRefReader *Create(size_t reserve = 0, IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Builds a compression dictionary (see IOutputStream::SetCompressionDictionary) from samples of block data.
+	/// Blocks of a few hundred bytes have too little in them to compress on their own; compressed against a
+	/// dictionary of what such blocks usually contain, they do much better. Train it on a few thousand blocks
+	/// that are typical of what will be written
+	class IDictionaryTrainer
+	{
+
+	public:
+
+		/// Adds the data of one block to the samples
+		virtual void AddSample(const void *data, size_t len) = NULL;
+
+		/// Returns the number of samples that have been added
+		virtual size_t GetSampleCount() const = NULL;
+
+		/// Builds a dictionary of up to maxlen (at most COMPRESSION_MAXDICTIONARY) bytes in dict, returning its length
+		virtual size_t Train(void *dict, size_t maxlen) = NULL;
+
+		/// Discards the samples
+		virtual void Reset() = NULL;
+
+		virtual void Release() = NULL;
+
+		GENIO_API static IDictionaryTrainer *Create(IAllocator *alloc = nullptr);
+
+	};
+
+
+	/// Aggregates the block events of one or more streams by FOURCC path (i.e., "OBJ0/INF1"),
+	/// tracking how many times each path was seen and the inclusive and exclusive time spent in it
+	class IBlockProfiler
+	{
+
+	public:
+
+		/// Sets this profiler as the stream's block callback
+		virtual void Attach(IStream *stream) = NULL;
+
+		/// Removes this profiler from the stream
+		virtual void Detach(IStream *stream) = NULL;
+
+		/// Discards everything that has been gathered so far
+		virtual void Reset() = NULL;
+
+		/// Writes a table of paths, sorted by inclusive time
+		virtual void WriteReport(ITextOutput *out) = NULL;
+
+		/// Writes every recorded event in Chrome's trace event JSON format (load it in chrome://tracing
+		/// or Perfetto); only available if the profiler was created with record_events set
+		virtual bool WriteChromeTrace(const TCHAR *filename) = NULL;
+
+		/// Detaches from any streams that are still attached, so either Detach streams before
+		/// releasing them or release the profiler first
+		virtual void Release() = NULL;
+
+		/// Creates a profiler; if record_events is true, every event is also kept so that a trace can be written
+		GENIO_API static IBlockProfiler *Create(bool record_events = false, IAllocator *alloc = nullptr);
 
 	};
 
@@ -326,6 +1047,40 @@ namespace genio
 #define ReadString ReadStringA
 #define WriteString WriteStringA
 
+#endif
+
+
+	/// Gives the typed array element type of a C++ type, i.e. TElementType<float>::TYPE is IStream::ET_FLOAT
+	template <typename T> struct TElementType;
+	template <> struct TElementType<int8_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_INT8; };
+	template <> struct TElementType<uint8_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_UINT8; };
+	template <> struct TElementType<int16_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_INT16; };
+	template <> struct TElementType<uint16_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_UINT16; };
+	template <> struct TElementType<int32_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_INT32; };
+	template <> struct TElementType<uint32_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_UINT32; };
+	template <> struct TElementType<int64_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_INT64; };
+	template <> struct TElementType<uint64_t> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_UINT64; };
+	template <> struct TElementType<float> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_FLOAT; };
+	template <> struct TElementType<double> { static const IStream::ELEMENT_TYPE TYPE = IStream::ET_DOUBLE; };
+
+#if defined(__cpp_lib_span)
+
+	/// Gets the elements of the typed array block with the given id as a span; they're used in place if the stream
+	/// allows it (see IInputStream::MapTypedArray), and are otherwise copied into copy. The span is empty if the next
+	/// block isn't a typed array of T with that id
+	template <typename T> std::span<const T> ReadTypedArraySpan(IInputStream *is, FOURCHARCODE id, std::vector<T> &copy)
+	{
+		size_t count = 0;
+		const T *p = (const T *)is->MapTypedArray(id, TElementType<T>::TYPE, count);
+		if (p)
+			return std::span<const T>(p, count);
+
+		copy.resize(is->NextArrayCount());
+		copy.resize(is->ReadTypedArray(id, TElementType<T>::TYPE, copy.data(), copy.size()));
+
+		return std::span<const T>(copy.data(), copy.size());
+	}
+
 #endif
 
 };
@@ -0,0 +1,207 @@
+/*
+
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that makes forward- and backward-compatible de/serialization easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+
+*/
+
+#pragma once
+
+// Awaitable versions of the stream operations, for coroutines (C++20). Each operation runs the ordinary
+// synchronous call on the thread pool and resumes the awaiting coroutine when it's done, so a thread that
+// services lots of connections can load and save without blocking on the disk. The streams underneath are the
+// usual IInputStream / IOutputStream, so files read and written this way are no different from any others,
+// and you can mix synchronous and awaited calls on the same stream (just not at the same time).
+//
+// A stream is still only used by one thing at a time: await each operation before starting the next one.
+
+#include <GenIO.h>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+
+#if defined(__cpp_impl_coroutine) && defined(__cpp_lib_coroutine)
+
+#include <coroutine>
+#include <type_traits>
+#include <utility>
+
+
+namespace genio
+{
+
+	/// Called from the thread pool when an operation finishes, instead of resuming the coroutine there;
+	/// an event loop would queue the handle and resume it on its own thread
+	typedef void (*ASYNC_RESUME_FUNC)(std::coroutine_handle<> handle, void *userdata);
+
+	/// Where asynchronous operations run and how they resume the coroutine that awaits them
+	struct SAsyncContext
+	{
+		PTP_CALLBACK_ENVIRON m_Environment;	/// the thread pool to run operations on, or NULL for the process' default pool
+		ASYNC_RESUME_FUNC m_Resume;			/// NULL to resume the coroutine on the thread pool thread that ran the operation
+		void *m_UserData;					/// passed to m_Resume
+	};
+
+
+	/// Holds the result of an operation; operations that don't return anything have nothing to hold
+	template <typename R> struct TAsyncResult
+	{
+		R m_Value;
+
+		template <typename F> void Run(F &func) { m_Value = func(); }
+		R Get() { return m_Value; }
+	};
+
+	template <> struct TAsyncResult<void>
+	{
+		template <typename F> void Run(F &func) { func(); }
+		void Get() { }
+	};
+
+
+	/// An awaitable that runs func on the thread pool; co_await gives you what func returns. If the
+	/// work can't be queued, func runs right away on the awaiting thread and the coroutine doesn't suspend
+	template <typename F> class TAsyncOperation
+	{
+
+	public:
+
+		typedef typename std::invoke_result<F &>::type RESULT_TYPE;
+
+		TAsyncOperation(F func, const SAsyncContext &ctx) : m_Func(std::move(func)), m_Context(ctx) { }
+
+		bool await_ready() const noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			m_Handle = handle;
+
+			// once it's queued, the operation may finish (and the coroutine resume, destroying this) at any time
+			if (TrySubmitThreadpoolCallback(Callback, this, m_Context.m_Environment))
+				return true;
+
+			m_Result.Run(m_Func);
+
+			return false;
+		}
+
+		RESULT_TYPE await_resume() { return m_Result.Get(); }
+
+	protected:
+		static void CALLBACK Callback(PTP_CALLBACK_INSTANCE instance, PVOID userdata)
+		{
+			TAsyncOperation *op = (TAsyncOperation *)userdata;
+
+			op->m_Result.Run(op->m_Func);
+
+			if (op->m_Context.m_Resume)
+				op->m_Context.m_Resume(op->m_Handle, op->m_Context.m_UserData);
+			else
+				op->m_Handle.resume();
+		}
+
+		F m_Func;
+		SAsyncContext m_Context;
+		std::coroutine_handle<> m_Handle;
+		TAsyncResult<RESULT_TYPE> m_Result;
+
+	};
+
+
+	/// Runs any function on the thread pool; use it to await a whole batch of synchronous calls at once,
+	/// i.e. co_await RunAsync([&]() { obj.Load(is); }, ctx), which is cheaper than awaiting each of them
+	template <typename F> TAsyncOperation<typename std::decay<F>::type> RunAsync(F &&func, const SAsyncContext &ctx = SAsyncContext())
+	{
+		return TAsyncOperation<typename std::decay<F>::type>(std::forward<F>(func), ctx);
+	}
+
+
+	/// Awaitable operations on an input stream. It doesn't own the stream; the buffers you pass
+	/// must stay valid until the operation that uses them has been awaited
+	class CAsyncInputStream
+	{
+
+	public:
+
+		CAsyncInputStream(IInputStream *is, const SAsyncContext &ctx = SAsyncContext()) : m_Stream(is), m_Context(ctx) { }
+
+		IInputStream *Stream() const { return m_Stream; }
+
+		auto OpenAsync() { return RunAsync([s = m_Stream]() { return s->Open(); }, m_Context); }
+		auto BeginBlockAsync(FOURCHARCODE id) { return RunAsync([s = m_Stream, id]() { return s->BeginBlock(id); }, m_Context); }
+		auto EndBlockAsync() { return RunAsync([s = m_Stream]() { s->EndBlock(); }, m_Context); }
+		auto NextBlockIdAsync() { return RunAsync([s = m_Stream]() { return s->NextBlockId(); }, m_Context); }
+		auto NextBlockSizeAsync() { return RunAsync([s = m_Stream]() { return s->NextBlockSize(); }, m_Context); }
+		auto FindAsync(const TCHAR *path) { return RunAsync([s = m_Stream, path]() { return s->Find(path); }, m_Context); }
+		auto FindChildAsync(FOURCHARCODE id, uint32_t index = 0) { return RunAsync([s = m_Stream, id, index]() { return s->FindChild(id, index); }, m_Context); }
+		auto ReadAsync(void *data, size_t size, size_t number = 1) { return RunAsync([s = m_Stream, data, size, number]() { return s->Read(data, size, number); }, m_Context); }
+		auto ReadVAsync(const SIOSegment *segments, size_t count) { return RunAsync([s = m_Stream, segments, count]() { return s->ReadV(segments, count); }, m_Context); }
+		auto ReadArrayINT64Async(FOURCHARCODE id, int64_t *data, size_t maxcount) { return RunAsync([s = m_Stream, id, data, maxcount]() { return s->ReadArrayINT64(id, data, maxcount); }, m_Context); }
+		auto ReadArrayDoubleAsync(FOURCHARCODE id, double *data, size_t maxcount) { return RunAsync([s = m_Stream, id, data, maxcount]() { return s->ReadArrayDouble(id, data, maxcount); }, m_Context); }
+
+	protected:
+		IInputStream *m_Stream;
+		SAsyncContext m_Context;
+
+	};
+
+
+	/// Awaitable operations on an output stream. It doesn't own the stream; the data you pass
+	/// must stay valid until the operation that uses it has been awaited
+	class CAsyncOutputStream
+	{
+
+	public:
+
+		CAsyncOutputStream(IOutputStream *os, const SAsyncContext &ctx = SAsyncContext()) : m_Stream(os), m_Context(ctx) { }
+
+		IOutputStream *Stream() const { return m_Stream; }
+
+		auto OpenAsync() { return RunAsync([s = m_Stream]() { return s->Open(); }, m_Context); }
+		auto CloseAsync() { return RunAsync([s = m_Stream]() { s->Close(); }, m_Context); }
+		auto FlushAsync() { return RunAsync([s = m_Stream]() { s->Flush(); }, m_Context); }
+		auto BeginBlockAsync(FOURCHARCODE id) { return RunAsync([s = m_Stream, id]() { return s->BeginBlock(id); }, m_Context); }
+		auto EndBlockAsync() { return RunAsync([s = m_Stream]() { s->EndBlock(); }, m_Context); }
+		auto WriteAsync(const void *data, size_t size, size_t number = 1) { return RunAsync([s = m_Stream, data, size, number]() { return s->Write(data, size, number); }, m_Context); }
+		auto WriteVAsync(const SIOSegment *segments, size_t count) { return RunAsync([s = m_Stream, segments, count]() { return s->WriteV(segments, count); }, m_Context); }
+		auto WriteArrayINT64Async(FOURCHARCODE id, const int64_t *data, size_t count, IStream::ARRAY_CODEC codec = IStream::AC_DELTADELTA) { return RunAsync([s = m_Stream, id, data, count, codec]() { return s->WriteArrayINT64(id, data, count, codec); }, m_Context); }
+		auto WriteArrayDoubleAsync(FOURCHARCODE id, const double *data, size_t count, IStream::ARRAY_CODEC codec = IStream::AC_XOR) { return RunAsync([s = m_Stream, id, data, count, codec]() { return s->WriteArrayDouble(id, data, count, codec); }, m_Context); }
+		auto CopyBlockFromAsync(IInputStream *is) { return RunAsync([s = m_Stream, is]() { return s->CopyBlockFrom(is); }, m_Context); }
+
+	protected:
+		IOutputStream *m_Stream;
+		SAsyncContext m_Context;
+
+	};
+
+};
+
+#endif
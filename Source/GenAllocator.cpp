@@ -0,0 +1,190 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenAllocator.h>
+
+
+static CDefaultAllocator s_DefaultAllocator;
+
+
+genio::IAllocator *genio::IAllocator::Default()
+{
+	return &s_DefaultAllocator;
+}
+
+
+genio::IArenaAllocator *genio::IArenaAllocator::Create(size_t chunksize, genio::IAllocator *backing)
+{
+	return AllocNew<CArenaAllocator>(backing, chunksize, backing);
+}
+
+
+// ************************************************************************
+// Default Allocator Methods
+
+void *CDefaultAllocator::Alloc(size_t size, size_t align)
+{
+	return _aligned_malloc(size ? size : 1, align);
+}
+
+
+void CDefaultAllocator::Free(void *p, size_t size)
+{
+	_aligned_free(p);
+}
+
+
+// ************************************************************************
+// Arena Allocator Methods
+
+CArenaAllocator::CArenaAllocator(size_t chunksize, genio::IAllocator *backing)
+{
+	m_Alloc = backing;
+	m_ChunkSize = std::max<size_t>(chunksize, sizeof(SChunk) * 2);
+
+	m_First = m_Current = nullptr;
+	m_Top = m_End = nullptr;
+	m_Used = 0;
+}
+
+
+CArenaAllocator::~CArenaAllocator()
+{
+	while (m_First)
+	{
+		SChunk *next = m_First->m_Next;
+		Backing()->Free(m_First, sizeof(SChunk) + m_First->m_Size);
+		m_First = next;
+	}
+}
+
+
+void CArenaAllocator::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+genio::IAllocator *CArenaAllocator::Backing() const
+{
+	return m_Alloc ? m_Alloc : &s_DefaultAllocator;
+}
+
+
+bool CArenaAllocator::NextChunk(size_t size, size_t align)
+{
+	size_t need = size + align;
+
+	// reuse the chunks left over from before the last Reset while they're big enough
+	if (m_Current && m_Current->m_Next && (m_Current->m_Next->m_Size >= need))
+	{
+		m_Used += m_Top - (uint8_t *)(m_Current + 1);
+
+		m_Current = m_Current->m_Next;
+	}
+	else
+	{
+		size_t chunksize = std::max<size_t>(m_ChunkSize - sizeof(SChunk), need);
+
+		SChunk *c = (SChunk *)Backing()->Alloc(sizeof(SChunk) + chunksize, GENIO_DEFAULTALIGN);
+		if (!c)
+			return false;
+
+		c->m_Size = chunksize;
+
+		// a new chunk goes after the current one, ahead of any that are waiting to be reused
+		if (m_Current)
+		{
+			m_Used += m_Top - (uint8_t *)(m_Current + 1);
+
+			c->m_Next = m_Current->m_Next;
+			m_Current->m_Next = c;
+		}
+		else
+		{
+			c->m_Next = m_First;
+			m_First = c;
+		}
+
+		m_Current = c;
+	}
+
+	m_Top = (uint8_t *)(m_Current + 1);
+	m_End = m_Top + m_Current->m_Size;
+
+	return true;
+}
+
+
+void *CArenaAllocator::Alloc(size_t size, size_t align)
+{
+	if (!align)
+		align = 1;
+
+	uint8_t *p = (uint8_t *)((((uintptr_t)m_Top) + (align - 1)) & ~((uintptr_t)align - 1));
+	if (!m_Top || ((p + size) > m_End))
+	{
+		if (!NextChunk(size, align))
+			return nullptr;
+
+		p = (uint8_t *)((((uintptr_t)m_Top) + (align - 1)) & ~((uintptr_t)align - 1));
+	}
+
+	m_Top = p + size;
+
+	return p;
+}
+
+
+void CArenaAllocator::Free(void *p, size_t size)
+{
+	// Memory comes back all at once with Reset, except for the most recent allocation, which can be
+	// taken back right away; that's enough to let a growing buffer reuse its old space
+	if (p && (((uint8_t *)p + size) == m_Top))
+		m_Top = (uint8_t *)p;
+}
+
+
+void CArenaAllocator::Reset()
+{
+	m_Current = m_First;
+	m_Top = m_First ? (uint8_t *)(m_First + 1) : nullptr;
+	m_End = m_First ? (m_Top + m_First->m_Size) : nullptr;
+	m_Used = 0;
+}
+
+
+size_t CArenaAllocator::GetBytesUsed() const
+{
+	return m_Used + (m_Current ? (size_t)(m_Top - (uint8_t *)(m_Current + 1)) : 0);
+}
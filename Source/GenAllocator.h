@@ -0,0 +1,168 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+
+
+// Implements the allocators, and the pieces that let the rest of GenIO get its memory from an IAllocator.
+// A null IAllocator * everywhere means "the default", which is global new / delete
+
+
+class CDefaultAllocator : public genio::IAllocator
+{
+
+public:
+
+	virtual void *Alloc(size_t size, size_t align = GENIO_DEFAULTALIGN);
+	virtual void Free(void *p, size_t size);
+	virtual void Release() { }
+
+};
+
+
+class CArenaAllocator : public genio::IArenaAllocator
+{
+
+public:
+
+	CArenaAllocator(size_t chunksize, genio::IAllocator *backing);
+	virtual ~CArenaAllocator();
+
+	virtual void *Alloc(size_t size, size_t align = GENIO_DEFAULTALIGN);
+	virtual void Free(void *p, size_t size);
+	virtual void Release();
+
+	virtual void Reset();
+	virtual size_t GetBytesUsed() const;
+
+protected:
+	// Chunks are kept in a list; Reset goes back to the first one, and the rest are reused as the arena fills again
+	struct SChunk
+	{
+		SChunk *m_Next;
+		size_t m_Size;				// usable bytes, which follow the header
+	};
+
+	// Moves on to a chunk with room for the given allocation, allocating one if need be
+	bool NextChunk(size_t size, size_t align);
+
+	// Where the chunks come from
+	genio::IAllocator *Backing() const;
+
+	genio::IAllocator *m_Alloc;		// the allocator the arena was made from; nullptr for the default
+	size_t m_ChunkSize;
+
+	SChunk *m_First;
+	SChunk *m_Current;
+	uint8_t *m_Top;					// the next free byte in the current chunk
+	uint8_t *m_End;					// the end of the current chunk
+	size_t m_Used;					// bytes handed out by the chunks before the current one
+
+};
+
+
+// Allocates and constructs a T from the given allocator, or with new if there isn't one
+template <typename T, typename... A> T *AllocNew(genio::IAllocator *alloc, A &&... args)
+{
+	if (!alloc)
+		return new T(std::forward<A>(args)...);
+
+	void *p = alloc->Alloc(sizeof(T), alignof(T));
+	return p ? new (p) T(std::forward<A>(args)...) : nullptr;
+}
+
+
+// Destroys and frees an object made with AllocNew
+template <typename T> void AllocDelete(genio::IAllocator *alloc, T *p)
+{
+	if (!alloc)
+	{
+		delete p;
+		return;
+	}
+
+	p->~T();
+	alloc->Free(p, sizeof(T));
+}
+
+
+// An STL allocator that draws from an IAllocator, so containers can live in the same memory as their owners.
+// It moves with its container, so a container assigned from another takes the other's allocator along
+template <typename T> class TGenAllocator
+{
+
+public:
+
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	TGenAllocator(genio::IAllocator *alloc = nullptr) : m_Alloc(alloc) { }
+	template <typename U> TGenAllocator(const TGenAllocator<U> &a) : m_Alloc(a.m_Alloc) { }
+
+	T *allocate(size_t n)
+	{
+		if (!m_Alloc)
+			return (T *)::operator new(n * sizeof(T));
+
+		void *p = m_Alloc->Alloc(n * sizeof(T), alignof(T));
+		if (!p)
+			throw std::bad_alloc();
+
+		return (T *)p;
+	}
+
+	void deallocate(T *p, size_t n)
+	{
+		if (!m_Alloc)
+			::operator delete(p);
+		else
+			m_Alloc->Free(p, n * sizeof(T));
+	}
+
+	template <typename U> bool operator ==(const TGenAllocator<U> &a) const { return (m_Alloc == a.m_Alloc); }
+	template <typename U> bool operator !=(const TGenAllocator<U> &a) const { return (m_Alloc != a.m_Alloc); }
+
+	genio::IAllocator *m_Alloc;
+
+};
+
+
+template <typename T> using TGenVector = std::vector<T, TGenAllocator<T>>;
+template <typename K, typename V> using TGenMap = std::map<K, V, std::less<K>, TGenAllocator<std::pair<const K, V>>>;
+template <typename K, typename V> using TGenHashMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, TGenAllocator<std::pair<const K, V>>>;
+template <typename C> using TGenString = std::basic_string<C, std::char_traits<C>, TGenAllocator<C>>;
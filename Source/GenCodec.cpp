@@ -0,0 +1,398 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#include "stdafx.h"
+#include <GenCodec.h>
+
+
+// ************************************************************************
+// Bit Packing
+
+static inline uint32_t BitWidth(uint64_t v)
+{
+	uint32_t w = 0;
+	while (v)
+	{
+		w++;
+		v >>= 1;
+	}
+
+	return w;
+}
+
+
+// v must not be 0
+static inline uint32_t TrailingZeros(uint64_t v)
+{
+	uint32_t z = 0;
+	while (!(v & 1))
+	{
+		z++;
+		v >>= 1;
+	}
+
+	return z;
+}
+
+
+static inline uint64_t ZigZag(uint64_t v)
+{
+	return (v << 1) ^ (uint64_t)((int64_t)v >> 63);
+}
+
+
+static inline uint64_t UnZigZag(uint64_t v)
+{
+	return (v >> 1) ^ (0 - (v & 1));
+}
+
+
+static inline size_t FrameBytes(size_t n, uint32_t width)
+{
+	return ((n * width) + 7) / 8;
+}
+
+
+template <typename T> static void AppendRaw(TGenVector<uint8_t> &out, T v)
+{
+	size_t pos = out.size();
+	out.resize(pos + sizeof(T));
+	memcpy(&out[pos], &v, sizeof(T));
+}
+
+
+// out must be zeroed and have ARRAYCODEC_INPUTPADDING bytes to spare past the packed frame
+static void PackFrame(const uint64_t *v, size_t n, uint32_t width, uint8_t *out)
+{
+	if (!width)
+		return;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t bit = (uint64_t)i * width;
+		uint8_t *p = out + (bit >> 3);
+		uint32_t shift = (uint32_t)(bit & 7);
+
+		uint64_t w;
+		memcpy(&w, p, sizeof(uint64_t));
+		w |= v[i] << shift;
+		memcpy(p, &w, sizeof(uint64_t));
+
+		// only values wider than 56 bits can spill into a ninth byte
+		if ((shift + width) > 64)
+			p[8] |= (uint8_t)(v[i] >> (64 - shift));
+	}
+}
+
+
+// Every value is extracted independently of the others, so there's no loop-carried dependency here
+static void UnpackFrame(const uint8_t *in, size_t n, uint32_t width, uint64_t *v)
+{
+	if (!width)
+	{
+		memset(v, 0, n * sizeof(uint64_t));
+		return;
+	}
+
+	uint64_t mask = (width < 64) ? ((1ULL << width) - 1) : ~0ULL;
+
+	if (width <= 56)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			uint64_t bit = (uint64_t)i * width;
+
+			uint64_t w;
+			memcpy(&w, in + (bit >> 3), sizeof(uint64_t));
+
+			v[i] = (w >> (bit & 7)) & mask;
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			uint64_t bit = (uint64_t)i * width;
+			const uint8_t *p = in + (bit >> 3);
+			uint32_t shift = (uint32_t)(bit & 7);
+
+			uint64_t w;
+			memcpy(&w, p, sizeof(uint64_t));
+
+			w >>= shift;
+			if (shift)
+				w |= (uint64_t)p[8] << (64 - shift);
+
+			v[i] = w & mask;
+		}
+	}
+}
+
+
+// Appends a frame, preceded by the given prefix bytes
+static void AppendFrame(TGenVector<uint8_t> &out, const uint8_t *prefix, size_t prefixlen, const uint64_t *v, size_t n, uint32_t width)
+{
+	size_t pos = out.size();
+	size_t nbytes = FrameBytes(n, width);
+
+	out.resize(pos + prefixlen + nbytes + ARRAYCODEC_INPUTPADDING);
+	memcpy(&out[pos], prefix, prefixlen);
+	PackFrame(v, n, width, &out[pos + prefixlen]);
+	out.resize(pos + prefixlen + nbytes);
+}
+
+
+// ************************************************************************
+// Delta-of-delta Codec
+
+size_t DeltaDeltaEncode(const int64_t *data, size_t count, TGenVector<uint8_t> &out)
+{
+	size_t start = out.size();
+
+	if (!count)
+		return 0;
+
+	// do the arithmetic unsigned, so that overflow wraps around instead of being undefined
+	uint64_t prev = (uint64_t)data[0];
+	AppendRaw(out, prev);
+
+	if (count < 2)
+		return out.size() - start;
+
+	uint64_t delta = (uint64_t)data[1] - prev;
+	AppendRaw(out, delta);
+	prev = (uint64_t)data[1];
+
+	uint64_t frame[ARRAYCODEC_FRAMESIZE];
+
+	for (size_t i = 2; i < count; i += ARRAYCODEC_FRAMESIZE)
+	{
+		size_t n = std::min<size_t>(ARRAYCODEC_FRAMESIZE, count - i);
+
+		uint64_t any = 0;
+		for (size_t j = 0; j < n; j++)
+		{
+			uint64_t d = (uint64_t)data[i + j] - prev;
+
+			frame[j] = ZigZag(d - delta);
+			any |= frame[j];
+
+			delta = d;
+			prev = (uint64_t)data[i + j];
+		}
+
+		uint8_t width = (uint8_t)BitWidth(any);
+		AppendFrame(out, &width, 1, frame, n, width);
+	}
+
+	return out.size() - start;
+}
+
+
+bool DeltaDeltaDecode(const uint8_t *in, size_t len, int64_t *data, size_t count)
+{
+	const uint8_t *end = in + len;
+
+	if (!count)
+		return true;
+
+	if ((size_t)(end - in) < sizeof(uint64_t))
+		return false;
+
+	uint64_t prev;
+	memcpy(&prev, in, sizeof(uint64_t));
+	in += sizeof(uint64_t);
+	data[0] = (int64_t)prev;
+
+	if (count < 2)
+		return true;
+
+	if ((size_t)(end - in) < sizeof(uint64_t))
+		return false;
+
+	uint64_t delta;
+	memcpy(&delta, in, sizeof(uint64_t));
+	in += sizeof(uint64_t);
+	prev += delta;
+	data[1] = (int64_t)prev;
+
+	uint64_t frame[ARRAYCODEC_FRAMESIZE];
+
+	for (size_t i = 2; i < count; i += ARRAYCODEC_FRAMESIZE)
+	{
+		size_t n = std::min<size_t>(ARRAYCODEC_FRAMESIZE, count - i);
+
+		if (in >= end)
+			return false;
+
+		uint32_t width = *(in++);
+		size_t nbytes = FrameBytes(n, width);
+		if ((width > 64) || ((size_t)(end - in) < nbytes))
+			return false;
+
+		UnpackFrame(in, n, width, frame);
+		in += nbytes;
+
+		for (size_t j = 0; j < n; j++)
+		{
+			delta += UnZigZag(frame[j]);
+			prev += delta;
+			data[i + j] = (int64_t)prev;
+		}
+	}
+
+	return true;
+}
+
+
+// ************************************************************************
+// XOR Codec
+
+size_t XorEncode(const double *data, size_t count, TGenVector<uint8_t> &out)
+{
+	size_t start = out.size();
+
+	if (!count)
+		return 0;
+
+	uint64_t prev;
+	memcpy(&prev, &data[0], sizeof(uint64_t));
+	AppendRaw(out, prev);
+
+	uint64_t frame[ARRAYCODEC_FRAMESIZE];
+
+	for (size_t i = 1; i < count; i += ARRAYCODEC_FRAMESIZE)
+	{
+		size_t n = std::min<size_t>(ARRAYCODEC_FRAMESIZE, count - i);
+
+		uint64_t any = 0;
+		for (size_t j = 0; j < n; j++)
+		{
+			uint64_t b;
+			memcpy(&b, &data[i + j], sizeof(uint64_t));
+
+			frame[j] = b ^ prev;
+			any |= frame[j];
+
+			prev = b;
+		}
+
+		// the trailing zeroes that every value in the frame shares don't need to be stored
+		uint8_t hdr[2];
+		hdr[0] = (uint8_t)(any ? TrailingZeros(any) : 0);
+		hdr[1] = (uint8_t)BitWidth(any >> hdr[0]);
+
+		if (hdr[0])
+		{
+			for (size_t j = 0; j < n; j++)
+				frame[j] >>= hdr[0];
+		}
+
+		AppendFrame(out, hdr, 2, frame, n, hdr[1]);
+	}
+
+	return out.size() - start;
+}
+
+
+bool XorDecode(const uint8_t *in, size_t len, double *data, size_t count)
+{
+	const uint8_t *end = in + len;
+
+	if (!count)
+		return true;
+
+	if ((size_t)(end - in) < sizeof(uint64_t))
+		return false;
+
+	uint64_t prev;
+	memcpy(&prev, in, sizeof(uint64_t));
+	in += sizeof(uint64_t);
+	memcpy(&data[0], &prev, sizeof(double));
+
+	uint64_t frame[ARRAYCODEC_FRAMESIZE];
+
+	for (size_t i = 1; i < count; i += ARRAYCODEC_FRAMESIZE)
+	{
+		size_t n = std::min<size_t>(ARRAYCODEC_FRAMESIZE, count - i);
+
+		if ((size_t)(end - in) < 2)
+			return false;
+
+		uint32_t tz = *(in++);
+		uint32_t width = *(in++);
+		size_t nbytes = FrameBytes(n, width);
+		if ((tz > 63) || ((tz + width) > 64) || ((size_t)(end - in) < nbytes))
+			return false;
+
+		UnpackFrame(in, n, width, frame);
+		in += nbytes;
+
+		for (size_t j = 0; j < n; j++)
+		{
+			prev ^= frame[j] << tz;
+			memcpy(&data[i + j], &prev, sizeof(double));
+		}
+	}
+
+	return true;
+}
+
+
+void SwapElements(void *data, size_t count, size_t elemsize)
+{
+	uint8_t *p = (uint8_t *)data;
+
+	switch (elemsize)
+	{
+		case sizeof(uint16_t):
+			for (size_t i = 0; i < count; i++, p += elemsize)
+				*(uint16_t *)p = _byteswap_ushort(*(uint16_t *)p);
+			break;
+
+		case sizeof(uint32_t):
+			for (size_t i = 0; i < count; i++, p += elemsize)
+				*(uint32_t *)p = _byteswap_ulong(*(uint32_t *)p);
+			break;
+
+		case sizeof(uint64_t):
+			for (size_t i = 0; i < count; i++, p += elemsize)
+				*(uint64_t *)p = _byteswap_uint64(*(uint64_t *)p);
+			break;
+
+		default:
+			for (size_t i = 0; i < count; i++, p += elemsize)
+				std::reverse(p, p + elemsize);
+			break;
+	}
+}
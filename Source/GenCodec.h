@@ -0,0 +1,126 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenAllocator.h>
+
+
+// Array block codecs. An array block's data is an SArrayHeader followed by the encoded elements.
+//
+// Both codecs work on frames of ARRAYCODEC_FRAMESIZE values; every value in a frame is packed with
+// the same number of bits, so decoding a frame is a branch-free unpack of independent values (which
+// the compiler can vectorize) followed by a running sum or XOR to rebuild the originals.
+
+#define ARRAYCODEC_FRAMESIZE		128
+
+// Decoders may read this many bytes past the end of their input, so buffers must be padded
+#define ARRAYCODEC_INPUTPADDING		16
+
+
+#pragma pack(push, arrayheader_pack)
+
+#pragma pack(1)
+
+struct SArrayHeader
+{
+	typedef enum
+	{
+		AET_INT64 = 0,
+		AET_DOUBLE,
+		AET_TYPED						// a typed array; an STypedArrayHeader follows
+	} ELEMENT_TYPE;
+
+	uint8_t m_Codec;				// genio::IStream::ARRAY_CODEC
+	uint8_t m_ElementType;			// ELEMENT_TYPE
+	uint16_t m_Reserved;
+	uint64_t m_Count;				// number of elements
+};
+
+// Typed arrays (see IOutputStream::WriteTypedArray) are always raw. The array header is followed by this, then
+// m_Padding zeroes that put the first element at a multiple of m_Alignment in the file, then the elements
+struct STypedArrayHeader
+{
+	enum
+	{
+		TAF_BIGENDIAN = 0x0001			// the elements are big endian
+	};
+
+	uint8_t m_ElementType;			// genio::IStream::ELEMENT_TYPE
+	uint8_t m_ElementSize;
+	uint16_t m_Flags;				// TAF_*
+	uint16_t m_Alignment;
+	uint16_t m_Padding;
+};
+
+#pragma pack(pop, arrayheader_pack)
+
+#define TYPEDARRAY_MAXALIGNMENT		4096
+
+
+// Returns the size of one element of the given type, or 0 if the type is invalid
+inline size_t ElementTypeSize(genio::IStream::ELEMENT_TYPE type)
+{
+	static const size_t sizes[genio::IStream::ET_NUMTYPES] =
+	{
+		sizeof(int8_t), sizeof(uint8_t), sizeof(int16_t), sizeof(uint16_t), sizeof(int32_t),
+		sizeof(uint32_t), sizeof(int64_t), sizeof(uint64_t), sizeof(float), sizeof(double)
+	};
+
+	return ((unsigned)type < genio::IStream::ET_NUMTYPES) ? sizes[type] : 0;
+}
+
+
+inline bool HostIsBigEndian()
+{
+	const uint16_t one = 1;
+	return (*(const uint8_t *)&one == 0);
+}
+
+
+// Reverses the bytes of each of count elements of the given size, in place
+void SwapElements(void *data, size_t count, size_t elemsize);
+
+
+// Delta-of-delta: the first value and first delta are stored whole, then every change in the delta
+// is zigzag encoded and bit-packed; regularly spaced timestamps pack down to a bit or two per value
+size_t DeltaDeltaEncode(const int64_t *data, size_t count, TGenVector<uint8_t> &out);
+bool DeltaDeltaDecode(const uint8_t *in, size_t len, int64_t *data, size_t count);
+
+// XOR: the first value is stored whole, then every value is XOR'd with the one before it and the
+// bits that can differ within a frame (between its largest leading and trailing runs of zeroes) are packed
+size_t XorEncode(const double *data, size_t count, TGenVector<uint8_t> &out);
+bool XorDecode(const uint8_t *in, size_t len, double *data, size_t count);
@@ -0,0 +1,467 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenCompress.h>
+
+
+genio::IDictionaryTrainer *genio::IDictionaryTrainer::Create(genio::IAllocator *alloc)
+{
+	return (genio::IDictionaryTrainer *)(AllocNew<CDictionaryTrainer>(alloc, alloc));
+}
+
+
+static inline uint32_t LZHash(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(uint32_t));
+
+	return (v * 2654435761U) >> (32 - LZ_HASHBITS);
+}
+
+
+static inline void LZPutLength(TGenVector<uint8_t> &out, size_t n)
+{
+	while (n >= 255)
+	{
+		out.push_back(255);
+		n -= 255;
+	}
+
+	out.push_back((uint8_t)n);
+}
+
+
+static inline bool LZGetLength(const uint8_t *&in, const uint8_t *end, size_t &n)
+{
+	uint8_t b;
+	do
+	{
+		if (in >= end)
+			return false;
+
+		b = *(in++);
+		n += b;
+	}
+	while (b == 255);
+
+	return true;
+}
+
+
+// Writes a sequence; a matchlen of 0 makes it the last one
+static void LZPutSequence(TGenVector<uint8_t> &out, const uint8_t *lit, size_t litlen, size_t offset, size_t matchlen)
+{
+	size_t ml = matchlen ? (matchlen - LZ_MINMATCH) : 0;
+
+	out.push_back((uint8_t)((std::min<size_t>(litlen, 15) << 4) | std::min<size_t>(ml, 15)));
+
+	if (litlen >= 15)
+		LZPutLength(out, litlen - 15);
+
+	out.insert(out.end(), lit, lit + litlen);
+
+	if (matchlen)
+	{
+		out.push_back((uint8_t)(offset & 0xFF));
+		out.push_back((uint8_t)(offset >> 8));
+
+		if (ml >= 15)
+			LZPutLength(out, ml - 15);
+	}
+}
+
+
+// ************************************************************************
+// LZ Compressor Methods
+
+CLZCompressor::CLZCompressor(genio::IAllocator *alloc) :
+	m_Dictionary(alloc),
+	m_DictionaryTable(alloc),
+	m_Table(alloc)
+{
+	m_Generation = 0;
+}
+
+
+void CLZCompressor::SetDictionary(const void *dict, size_t len)
+{
+	if (!dict || !len)
+	{
+		m_Dictionary.clear();
+		m_DictionaryTable.clear();
+		return;
+	}
+
+	m_Dictionary.assign((const uint8_t *)dict, (const uint8_t *)dict + len);
+
+	// later positions overwrite earlier ones; they're closer to the block, and trained dictionaries put what's most useful last
+	m_DictionaryTable.assign((size_t)1 << LZ_HASHBITS, 0);
+	for (size_t i = 0; (i + LZ_MINMATCH) <= len; i++)
+		m_DictionaryTable[LZHash(m_Dictionary.data() + i)] = (uint32_t)(i + 1);
+}
+
+
+size_t CLZCompressor::Compress(const void *data, size_t len, TGenVector<uint8_t> &out)
+{
+	const uint8_t *in = (const uint8_t *)data;
+	const uint8_t *dict = m_Dictionary.data();
+	size_t dictlen = m_Dictionary.size();
+
+	out.clear();
+
+	uint64_t v = len;
+	do
+	{
+		uint8_t b = (uint8_t)(v & 0x7F);
+		v >>= 7;
+		out.push_back(b | (v ? 0x80 : 0));
+	}
+	while (v);
+
+	if (m_Table.empty())
+		m_Table.resize((size_t)1 << LZ_HASHBITS);
+
+	m_Generation = (m_Generation + 1) & 0xFFFF;
+	if (!m_Generation)
+	{
+		std::fill(m_Table.begin(), m_Table.end(), 0);
+		m_Generation = 1;
+	}
+
+	size_t anchor = 0, i = 0;
+	size_t limit = (len >= LZ_MINMATCH) ? (len - LZ_MINMATCH + 1) : 0;
+
+	while (i < limit)
+	{
+		uint32_t h = LZHash(in + i);
+
+		size_t bestlen = 0, bestoff = 0;
+
+		uint32_t e = m_Table[h];
+		if ((e >> 16) == m_Generation)
+		{
+			size_t c = e & 0xFFFF;
+
+			size_t n = 0;
+			while (((i + n) < len) && (in[c + n] == in[i + n]))
+				n++;
+
+			bestlen = n;
+			bestoff = i - c;
+		}
+
+		m_Table[h] = (m_Generation << 16) | (uint32_t)i;
+
+		// a match in the dictionary can run on past its end into the start of the block
+		if (dictlen && m_DictionaryTable[h])
+		{
+			size_t c = m_DictionaryTable[h] - 1;
+			size_t off = (dictlen - c) + i;
+
+			if (off <= LZ_MAXOFFSET)
+			{
+				size_t n = 0;
+				while ((i + n) < len)
+				{
+					size_t p = c + n;
+					if (((p < dictlen) ? dict[p] : in[p - dictlen]) != in[i + n])
+						break;
+
+					n++;
+				}
+
+				if (n > bestlen)
+				{
+					bestlen = n;
+					bestoff = off;
+				}
+			}
+		}
+
+		if (bestlen >= LZ_MINMATCH)
+		{
+			LZPutSequence(out, in + anchor, i - anchor, bestoff, bestlen);
+
+			i += bestlen;
+			anchor = i;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	if (anchor < len)
+		LZPutSequence(out, in + anchor, len - anchor, 0, 0);
+
+	return out.size();
+}
+
+
+bool LZDecompress(const uint8_t *in, size_t len, const uint8_t *dict, size_t dictlen, TGenVector<uint8_t> &out)
+{
+	const uint8_t *end = in + len;
+
+	uint64_t total = 0;
+	for (uint32_t shift = 0; ; shift += 7)
+	{
+		if ((in >= end) || (shift > 56))
+			return false;
+
+		uint8_t b = *(in++);
+		total |= (uint64_t)(b & 0x7F) << shift;
+
+		if (!(b & 0x80))
+			break;
+	}
+
+	if (total > COMPRESSION_MAXBLOCK)
+		return false;
+
+	out.resize((size_t)total);
+
+	uint8_t *o = out.data();
+	size_t pos = 0;
+
+	while (in < end)
+	{
+		uint8_t token = *(in++);
+
+		size_t lit = token >> 4;
+		if ((lit == 15) && !LZGetLength(in, end, lit))
+			return false;
+
+		if ((lit > (size_t)(end - in)) || (lit > (out.size() - pos)))
+			return false;
+
+		memcpy(o + pos, in, lit);
+		in += lit;
+		pos += lit;
+
+		if (in == end)
+			break;
+
+		if ((end - in) < 2)
+			return false;
+
+		size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+		in += 2;
+
+		size_t ml = token & 0xF;
+		if ((ml == 15) && !LZGetLength(in, end, ml))
+			return false;
+
+		ml += LZ_MINMATCH;
+
+		if (!offset || (offset > (pos + dictlen)) || (ml > (out.size() - pos)))
+			return false;
+
+		// byte by byte, since a match may overlap what it produces
+		for (size_t k = 0; k < ml; k++, pos++)
+			o[pos] = (offset > pos) ? dict[dictlen - (offset - pos)] : o[pos - offset];
+	}
+
+	return (pos == out.size());
+}
+
+
+// ************************************************************************
+// Dictionary Trainer Methods
+
+CDictionaryTrainer::CDictionaryTrainer(genio::IAllocator *alloc) :
+	m_Samples(alloc),
+	m_SampleEnds(alloc),
+	m_Counts(alloc),
+	m_LastSample(alloc),
+	m_Segments(alloc)
+{
+	m_Alloc = alloc;
+}
+
+
+CDictionaryTrainer::~CDictionaryTrainer()
+{
+}
+
+
+void CDictionaryTrainer::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+void CDictionaryTrainer::AddSample(const void *data, size_t len)
+{
+	if (!data || !len)
+		return;
+
+	m_Samples.insert(m_Samples.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+	m_SampleEnds.push_back(m_Samples.size());
+}
+
+
+size_t CDictionaryTrainer::GetSampleCount() const
+{
+	return m_SampleEnds.size();
+}
+
+
+void CDictionaryTrainer::Reset()
+{
+	m_Samples.clear();
+	m_SampleEnds.clear();
+}
+
+
+static inline uint32_t DmerHash(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(uint64_t));
+
+	return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - DICTTRAINER_HASHBITS));
+}
+
+
+size_t CDictionaryTrainer::Train(void *dict, size_t maxlen)
+{
+	maxlen = std::min<size_t>(maxlen, COMPRESSION_MAXDICTIONARY);
+
+	if (!dict || !maxlen || m_Samples.empty())
+		return 0;
+
+	size_t total = m_Samples.size();
+
+	// if everything fits, the samples are the dictionary
+	if (total <= maxlen)
+	{
+		memcpy(dict, m_Samples.data(), total);
+		return total;
+	}
+
+	// anything shorter than a segment isn't worth having
+	if (maxlen < DICTTRAINER_SEGMENT)
+		return 0;
+
+	const uint8_t *s = m_Samples.data();
+
+	m_Counts.assign((size_t)1 << DICTTRAINER_HASHBITS, 0);
+	m_LastSample.assign((size_t)1 << DICTTRAINER_HASHBITS, UINT32_MAX);
+
+	size_t begin = 0;
+	for (size_t i = 0; i < m_SampleEnds.size(); i++)
+	{
+		size_t end = m_SampleEnds[i];
+
+		for (size_t p = begin; (p + DICTTRAINER_DMER) <= end; p++)
+		{
+			uint32_t h = DmerHash(s + p);
+			if (m_LastSample[h] != (uint32_t)i)
+			{
+				m_LastSample[h] = (uint32_t)i;
+				m_Counts[h]++;
+			}
+		}
+
+		begin = end;
+	}
+
+	// a d-mer that's only in one sample is worth nothing to the others
+	for (auto &c : m_Counts)
+	{
+		if (c < 2)
+			c = 0;
+	}
+
+	size_t epochs = maxlen / DICTTRAINER_SEGMENT;
+	size_t epochlen = total / epochs;
+
+	const size_t seglen = DICTTRAINER_SEGMENT;
+	const size_t window = DICTTRAINER_SEGMENT - DICTTRAINER_DMER + 1;		// the number of d-mers in a segment
+
+	m_Segments.clear();
+
+	for (size_t e = 0; e < epochs; e++)
+	{
+		size_t first = e * epochlen;
+		size_t last = std::min(first + epochlen, total);
+		if ((last - first) < seglen)
+			continue;
+
+		// slide a window of d-mers over the epoch, scoring each segment by the d-mers it starts
+		size_t positions = last - first - DICTTRAINER_DMER + 1;
+
+		uint64_t score = 0, best = 0;
+		size_t beststart = 0;
+
+		for (size_t p = 0; p < positions; p++)
+		{
+			score += m_Counts[DmerHash(s + first + p)];
+
+			if (p >= window)
+				score -= m_Counts[DmerHash(s + first + p - window)];
+
+			if ((p + 1 >= window) && (score > best))
+			{
+				best = score;
+				beststart = first + p + 1 - window;
+			}
+		}
+
+		if (!best)
+			continue;
+
+		SSegment seg;
+		seg.m_Start = beststart;
+		seg.m_Score = best;
+		m_Segments.push_back(seg);
+
+		for (size_t p = beststart; (p + DICTTRAINER_DMER) <= (beststart + seglen); p++)
+			m_Counts[DmerHash(s + p)] = 0;
+	}
+
+	// the best segments go last, where the most blocks can reach them
+	std::sort(m_Segments.begin(), m_Segments.end(), [](const SSegment &a, const SSegment &b)
+	{
+		return a.m_Score < b.m_Score;
+	});
+
+	uint8_t *d = (uint8_t *)dict;
+	size_t ret = 0;
+	for (const auto &seg : m_Segments)
+	{
+		memcpy(d + ret, s + seg.m_Start, seglen);
+		ret += seglen;
+	}
+
+	return ret;
+}
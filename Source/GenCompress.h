@@ -0,0 +1,131 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenAllocator.h>
+
+
+// Block compression, for STRMMODE_COMPRESS, and the dictionary trainer.
+//
+// The format is LZ77 in the style of LZ4: a varint of the decompressed length, then sequences of a token byte
+// (the literal count in the high nibble, the match length less LZ_MINMATCH in the low one; 15 in either means
+// more of it follows in bytes, each 255 meaning more still), the literals, and a little-endian UINT16 offset
+// back to the match. The last sequence is literals only. The stream's dictionary is treated as though it came
+// right before every block, so matches may reach back into it; that's what makes blocks of a few hundred
+// bytes compressible, since they rarely repeat much within themselves.
+
+#define LZ_MINMATCH				4
+#define LZ_MAXOFFSET			0xFFFF
+#define LZ_HASHBITS				14
+
+
+// Compresses blocks against a dictionary; the dictionary's hash table is built once, when it's set
+class CLZCompressor
+{
+
+public:
+
+	CLZCompressor(genio::IAllocator *alloc = nullptr);
+
+	// Copies the dictionary, or clears it if len is 0
+	void SetDictionary(const void *dict, size_t len);
+
+	const uint8_t *GetDictionary() const { return m_Dictionary.data(); }
+	size_t GetDictionarySize() const { return m_Dictionary.size(); }
+
+	// Compresses len bytes (up to COMPRESSION_MAXBLOCK) into out, returning the compressed size
+	size_t Compress(const void *data, size_t len, TGenVector<uint8_t> &out);
+
+protected:
+	TGenVector<uint8_t> m_Dictionary;
+	TGenVector<uint32_t> m_DictionaryTable;		// the last position + 1 in the dictionary of each hash; 0 if none
+
+	// The last position in the block of each hash, tagged with the generation (in the high 16 bits) of the
+	// block it was set in, so that the table doesn't have to be cleared for every block
+	TGenVector<uint32_t> m_Table;
+	uint32_t m_Generation;
+
+};
+
+
+// Decompresses what CLZCompressor::Compress made with the same dictionary into out
+bool LZDecompress(const uint8_t *in, size_t len, const uint8_t *dict, size_t dictlen, TGenVector<uint8_t> &out);
+
+
+// Implements the dictionary trainer
+//
+// Training is a simplified form of the COVER algorithm: every DICTTRAINER_DMER byte substring (d-mer) is counted
+// once per sample it appears in, the samples are split into as many epochs as there are segments in the
+// dictionary, and the DICTTRAINER_SEGMENT bytes of each epoch whose d-mers are shared by the most samples are
+// taken. D-mers are zeroed once they're taken so that later epochs add something new.
+
+#define DICTTRAINER_DMER		8
+#define DICTTRAINER_SEGMENT		64
+#define DICTTRAINER_HASHBITS	20
+
+
+class CDictionaryTrainer : public genio::IDictionaryTrainer
+{
+
+public:
+
+	CDictionaryTrainer(genio::IAllocator *alloc);
+	virtual ~CDictionaryTrainer();
+
+	virtual void AddSample(const void *data, size_t len);
+	virtual size_t GetSampleCount() const;
+	virtual size_t Train(void *dict, size_t maxlen);
+	virtual void Reset();
+	virtual void Release();
+
+protected:
+	TGenVector<uint8_t> m_Samples;				// every sample, one after another
+	TGenVector<size_t> m_SampleEnds;
+
+	TGenVector<uint32_t> m_Counts;				// the number of samples each d-mer hash was seen in
+	TGenVector<uint32_t> m_LastSample;			// the last sample each d-mer hash was counted for
+
+	struct SSegment
+	{
+		size_t m_Start;
+		uint64_t m_Score;
+	};
+
+	TGenVector<SSegment> m_Segments;
+
+	genio::IAllocator *m_Alloc;
+
+};
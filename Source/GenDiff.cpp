@@ -0,0 +1,568 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenDiff.h>
+
+
+genio::IStreamDiff *genio::IStreamDiff::Create(genio::IAllocator *alloc)
+{
+	return (genio::IStreamDiff *)(AllocNew<CStreamDiff>(alloc, alloc));
+}
+
+
+// ************************************************************************
+// Diff Hash Methods
+
+void CDiffHash::Reset()
+{
+	m_Hash = 0x243F6A8885A308D3ULL;
+	m_Total = 0;
+	m_PendingLen = 0;
+}
+
+
+inline void CDiffHash::Mix(uint64_t w)
+{
+	m_Hash ^= w * 0x9E3779B97F4A7C15ULL;
+	m_Hash = ((m_Hash << 31) | (m_Hash >> 33)) * 0xBF58476D1CE4E5B9ULL;
+}
+
+
+void CDiffHash::Add(const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	m_Total += len;
+
+	if (m_PendingLen)
+	{
+		size_t n = std::min(len, sizeof(uint64_t) - m_PendingLen);
+		memcpy(m_Pending + m_PendingLen, p, n);
+		m_PendingLen += n;
+		p += n;
+		len -= n;
+
+		if (m_PendingLen < sizeof(uint64_t))
+			return;
+
+		uint64_t w;
+		memcpy(&w, m_Pending, sizeof(uint64_t));
+		Mix(w);
+		m_PendingLen = 0;
+	}
+
+	while (len >= sizeof(uint64_t))
+	{
+		uint64_t w;
+		memcpy(&w, p, sizeof(uint64_t));
+		Mix(w);
+
+		p += sizeof(uint64_t);
+		len -= sizeof(uint64_t);
+	}
+
+	memcpy(m_Pending, p, len);
+	m_PendingLen = len;
+}
+
+
+uint64_t CDiffHash::Get() const
+{
+	// the length goes in too, so that trailing zeroes make a difference
+	uint64_t w = 0;
+	memcpy(&w, m_Pending, m_PendingLen);
+
+	uint64_t h = m_Hash;
+	h ^= w * 0x9E3779B97F4A7C15ULL;
+	h = ((h << 31) | (h >> 33)) * 0xBF58476D1CE4E5B9ULL;
+	h ^= m_Total;
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+
+// ************************************************************************
+// Stream Diff Methods
+
+CStreamDiff::CStreamDiff(genio::IAllocator *alloc) :
+	m_Old(alloc),
+	m_New(alloc),
+	m_Data(alloc),
+	m_Buffer(alloc)
+{
+	m_Alloc = alloc;
+	m_Patch = nullptr;
+	m_Op = PO_NONE;
+	m_CopyOffset = m_CopyLength = 0;
+
+	memset(&m_Stats, 0, sizeof(genio::SPatchStats));
+}
+
+
+CStreamDiff::~CStreamDiff()
+{
+}
+
+
+void CStreamDiff::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+void CStreamDiff::GetStats(genio::SPatchStats &stats) const
+{
+	stats = m_Stats;
+}
+
+
+void CStreamDiff::InitSource(SSource &src, genio::IInputStream *is)
+{
+	src.m_Stream = is;
+
+	is->Seek(genio::IStream::SEEK_MODE::SM_END, 0);
+	src.m_Size = is->Pos();
+	is->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, 0);
+
+	src.m_WindowStart = 0;
+	src.m_WindowValid = 0;
+}
+
+
+bool CStreamDiff::ReadSource(SSource &src, uint64_t offset, void *data, size_t len)
+{
+	if ((offset > src.m_Size) || (len > (src.m_Size - offset)))
+		return false;
+
+	if ((offset >= src.m_WindowStart) && ((offset + len) <= (src.m_WindowStart + src.m_WindowValid)))
+	{
+		memcpy(data, src.m_Window.data() + (offset - src.m_WindowStart), len);
+		return true;
+	}
+
+	// big reads don't go through the window
+	if (len > (DIFF_WINDOWSIZE / 2))
+	{
+		src.m_Stream->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)offset);
+		return (src.m_Stream->Read(data, len) == len);
+	}
+
+	src.m_Window.resize(DIFF_WINDOWSIZE);
+	src.m_WindowStart = offset;
+
+	src.m_Stream->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)offset);
+	src.m_WindowValid = src.m_Stream->Read(src.m_Window.data(), (size_t)std::min<uint64_t>(DIFF_WINDOWSIZE, src.m_Size - offset));
+	if (src.m_WindowValid < len)
+		return false;
+
+	memcpy(data, src.m_Window.data(), len);
+
+	return true;
+}
+
+
+bool CStreamDiff::HashRange(SSource &src, uint64_t first, uint64_t end, CDiffHash &hash)
+{
+	m_Buffer.resize(BLOCKCOPY_CHUNKSIZE);
+
+	while (first < end)
+	{
+		size_t n = (size_t)std::min<uint64_t>(end - first, m_Buffer.size());
+		if (!ReadSource(src, first, m_Buffer.data(), n))
+			return false;
+
+		hash.Add(m_Buffer.data(), n);
+		first += n;
+	}
+
+	return true;
+}
+
+
+uint64_t CStreamDiff::ListBlocks(SSource &src, uint64_t first, uint64_t end, TBlockArray &blocks, CDiffHash *file)
+{
+	blocks.clear();
+
+	uint64_t pos = first;
+	while ((end - pos) >= sizeof(SStreamBlockInfo))
+	{
+		SStreamBlockInfo info;
+		if (!ReadSource(src, pos, &info, sizeof(SStreamBlockInfo)))
+			break;
+
+		if (info.m_Length > (end - pos - sizeof(SStreamBlockInfo)))
+			break;
+
+		// ids are printable, or zero for a terminator; anything else means this isn't a header at all
+		bool valid = true;
+		for (size_t i = 0; valid && (i < sizeof(genio::FOURCHARCODE)); i++)
+		{
+			uint8_t c = ((const uint8_t *)&info.m_ID)[i];
+			valid = !c || ((c >= 0x20) && (c < 0x7F));
+		}
+
+		if (!valid)
+			break;
+
+		if (file)
+			file->Add(&info, sizeof(SStreamBlockInfo));
+
+		SBlock b;
+		b.m_Offset = pos;
+		b.m_Size = sizeof(SStreamBlockInfo) + info.m_Length;
+		b.m_ID = ntohl(info.m_ID);
+		b.m_Flags = info.m_Flags.Get();
+
+		info.m_Crc = 0;
+
+		CDiffHash hash;
+		hash.Add(&info, sizeof(SStreamBlockInfo));
+
+		uint64_t data = pos + sizeof(SStreamBlockInfo);
+		m_Buffer.resize(BLOCKCOPY_CHUNKSIZE);
+
+		bool ok = true;
+		for (uint64_t at = data; ok && (at < (pos + b.m_Size)); )
+		{
+			size_t n = (size_t)std::min<uint64_t>(pos + b.m_Size - at, m_Buffer.size());
+			ok = ReadSource(src, at, m_Buffer.data(), n);
+			if (ok)
+			{
+				hash.Add(m_Buffer.data(), n);
+				if (file)
+					file->Add(m_Buffer.data(), n);
+			}
+
+			at += n;
+		}
+
+		if (!ok)
+			break;
+
+		b.m_Hash = hash.Get();
+		blocks.push_back(b);
+
+		pos += b.m_Size;
+	}
+
+	return pos;
+}
+
+
+bool CStreamDiff::ListChildren(SSource &src, const SBlock &block, TBlockArray &children)
+{
+	// compressed data can look like anything
+	if (block.m_Flags & STRMFLG_COMPRESSED)
+		return false;
+
+	uint64_t first = block.m_Offset + sizeof(SStreamBlockInfo);
+	uint64_t end = block.m_Offset + block.m_Size;
+
+	return (first < end) && (ListBlocks(src, first, end, children, nullptr) == end);
+}
+
+
+void CStreamDiff::DiffLevel(const TBlockArray &oldblocks, const TBlockArray &newblocks, uint32_t depth)
+{
+	TGenHashMap<uint64_t, size_t> byhash(oldblocks.size(), std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+		TGenAllocator<std::pair<const uint64_t, size_t>>(m_Alloc));
+
+	// blocks are also found by id and occurrence, i.e. the third INF0, for comparing their children
+	TGenMap<uint64_t, size_t> byplace(m_Alloc);
+	TGenMap<genio::FOURCHARCODE, uint32_t> counts(m_Alloc);
+
+	for (size_t i = 0; i < oldblocks.size(); i++)
+	{
+		const SBlock &b = oldblocks[i];
+
+		byhash.emplace(b.m_Hash, i);
+		byplace.emplace(((uint64_t)b.m_ID << 32) | counts[b.m_ID]++, i);
+	}
+
+	counts.clear();
+
+	for (const SBlock &b : newblocks)
+	{
+		uint64_t place = ((uint64_t)b.m_ID << 32) | counts[b.m_ID]++;
+
+		auto h = byhash.find(b.m_Hash);
+		if ((h != byhash.end()) && (oldblocks[h->second].m_Size == b.m_Size))
+		{
+			EmitCopy(oldblocks[h->second].m_Offset, b.m_Size);
+			continue;
+		}
+
+		auto p = byplace.find(place);
+		if ((p != byplace.end()) && (depth < DIFF_MAXDEPTH))
+		{
+			TBlockArray oldchildren(m_Alloc), newchildren(m_Alloc);
+
+			if (ListChildren(m_Old, oldblocks[p->second], oldchildren) && ListChildren(m_New, b, newchildren))
+			{
+				// the header's length has probably changed, even if nothing else has
+				EmitData(b.m_Offset, sizeof(SStreamBlockInfo));
+				DiffLevel(oldchildren, newchildren, depth + 1);
+				continue;
+			}
+		}
+
+		EmitData(b.m_Offset, b.m_Size);
+	}
+}
+
+
+void CStreamDiff::EmitCopy(uint64_t offset, uint64_t len)
+{
+	if ((m_Op == PO_COPY) && ((m_CopyOffset + m_CopyLength) == offset))
+	{
+		m_CopyLength += len;
+		return;
+	}
+
+	FlushOp();
+
+	m_Op = PO_COPY;
+	m_CopyOffset = offset;
+	m_CopyLength = len;
+}
+
+
+void CStreamDiff::EmitData(uint64_t offset, uint64_t len)
+{
+	if (m_Op != PO_DATA)
+	{
+		FlushOp();
+		m_Op = PO_DATA;
+	}
+
+	while (len)
+	{
+		size_t n = (size_t)std::min<uint64_t>(len, DIFF_MAXDATA - m_Data.size());
+
+		size_t at = m_Data.size();
+		m_Data.resize(at + n);
+		if (!ReadSource(m_New, offset, m_Data.data() + at, n))
+			m_Data.resize(at);
+
+		offset += n;
+		len -= n;
+
+		if (m_Data.size() >= DIFF_MAXDATA)
+		{
+			FlushOp();
+			m_Op = PO_DATA;
+		}
+	}
+}
+
+
+void CStreamDiff::FlushOp()
+{
+	if ((m_Op == PO_COPY) && m_CopyLength)
+	{
+		m_Patch->BeginBlock(PATCHCOPYID);
+		m_Patch->WriteUINT64(m_CopyOffset);
+		m_Patch->WriteUINT64(m_CopyLength);
+		m_Patch->EndBlock();
+
+		m_Stats.m_BytesCopied += m_CopyLength;
+		m_Stats.m_Copies++;
+	}
+	else if ((m_Op == PO_DATA) && !m_Data.empty())
+	{
+		m_Patch->BeginBlock(PATCHDATAID);
+		m_Patch->WriteUINT32((uint32_t)m_Data.size());
+		m_Patch->Write(m_Data.data(), m_Data.size());
+		m_Patch->EndBlock();
+
+		m_Stats.m_BytesAdded += m_Data.size();
+		m_Stats.m_Additions++;
+	}
+
+	m_Op = PO_NONE;
+	m_CopyLength = 0;
+	m_Data.clear();
+}
+
+
+bool CStreamDiff::Diff(genio::IInputStream *oldis, genio::IInputStream *newis, genio::IOutputStream *patch)
+{
+	memset(&m_Stats, 0, sizeof(genio::SPatchStats));
+
+	if (!oldis || !newis || !patch || !oldis->CanAccess() || !newis->CanAccess() || !patch->CanAccess())
+		return false;
+
+	InitSource(m_Old, oldis);
+	InitSource(m_New, newis);
+
+	// the whole of the old stream is hashed along the way, so that Apply can tell it's been given the right one
+	CDiffHash oldhash;
+	TBlockArray oldblocks(m_Alloc), newblocks(m_Alloc);
+
+	uint64_t oldstop = ListBlocks(m_Old, 0, m_Old.m_Size, oldblocks, &oldhash);
+	if (!HashRange(m_Old, oldstop, m_Old.m_Size, oldhash))
+		return false;
+
+	uint64_t newstop = ListBlocks(m_New, 0, m_New.m_Size, newblocks, nullptr);
+
+	patch->BeginBlock(PATCHHEADERID);
+	patch->WriteUINT32(PATCH_VERSION);
+	patch->WriteUINT64(m_Old.m_Size);
+	patch->WriteUINT64(oldhash.Get());
+	patch->WriteUINT64(m_New.m_Size);
+	patch->EndBlock();
+
+	m_Patch = patch;
+	m_Op = PO_NONE;
+
+	DiffLevel(oldblocks, newblocks, 0);
+
+	// anything after the last whole block goes across as it is
+	if (newstop < m_New.m_Size)
+		EmitData(newstop, m_New.m_Size - newstop);
+
+	FlushOp();
+
+	m_Patch = nullptr;
+
+	return true;
+}
+
+
+bool CStreamDiff::Apply(genio::IInputStream *oldis, genio::IInputStream *patch, genio::IOutputStream *os)
+{
+	memset(&m_Stats, 0, sizeof(genio::SPatchStats));
+
+	if (!oldis || !patch || !os || !oldis->CanAccess() || !patch->CanAccess() || !os->CanAccess())
+		return false;
+
+	uint32_t version = 0;
+	uint64_t oldsize = 0, oldhash = 0, newsize = 0;
+
+	if (!patch->BeginBlock(PATCHHEADERID))
+		return false;
+
+	patch->ReadUINT32(version);
+	patch->ReadUINT64(oldsize);
+	patch->ReadUINT64(oldhash);
+	patch->ReadUINT64(newsize);
+	patch->EndBlock();
+
+	if (version != PATCH_VERSION)
+		return false;
+
+	InitSource(m_Old, oldis);
+
+	CDiffHash hash;
+	if ((m_Old.m_Size != oldsize) || !HashRange(m_Old, 0, m_Old.m_Size, hash) || (hash.Get() != oldhash))
+		return false;
+
+	uint64_t written = 0;
+
+	for (;;)
+	{
+		genio::FOURCHARCODE id = patch->NextBlockId();
+
+		if (id == PATCHCOPYID)
+		{
+			uint64_t offset = 0, len = 0;
+
+			if (!patch->BeginBlock(PATCHCOPYID))
+				return false;
+
+			patch->ReadUINT64(offset);
+			patch->ReadUINT64(len);
+			patch->EndBlock();
+
+			if ((offset > oldsize) || (len > (oldsize - offset)))
+				return false;
+
+			m_Buffer.resize(BLOCKCOPY_CHUNKSIZE);
+
+			for (uint64_t done = 0; done < len; )
+			{
+				size_t n = (size_t)std::min<uint64_t>(len - done, m_Buffer.size());
+				if (!ReadSource(m_Old, offset + done, m_Buffer.data(), n) || (os->Write(m_Buffer.data(), n) != n))
+					return false;
+
+				done += n;
+			}
+
+			written += len;
+
+			m_Stats.m_BytesCopied += len;
+			m_Stats.m_Copies++;
+		}
+		else if (id == PATCHDATAID)
+		{
+			uint32_t len = 0;
+
+			if (!patch->BeginBlock(PATCHDATAID))
+				return false;
+
+			patch->ReadUINT32(len);
+
+			// Diff never writes more than this in one block, so a longer length is corrupt and mustn't be allocated for
+			if (len > DIFF_MAXDATA)
+			{
+				patch->EndBlock();
+				return false;
+			}
+
+			m_Data.resize(len);
+			bool ok = (patch->Read(m_Data.data(), len) == len);
+
+			patch->EndBlock();
+
+			if (!ok || (os->Write(m_Data.data(), len) != len))
+				return false;
+
+			written += len;
+
+			m_Stats.m_BytesAdded += len;
+			m_Stats.m_Additions++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return (written == newsize);
+}
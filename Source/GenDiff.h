@@ -0,0 +1,156 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+
+
+// Implements the stream differ
+//
+// Each level of a stream (the top level, or the data of a block) is listed as the blocks that exactly fill it, each
+// with a hash of its header and data. The crc field isn't hashed, since nothing computes it, so older files that have
+// garbage there still match. Blocks of the new level that are in the old one anywhere are copied; a block that isn't,
+// but has children and was at the same place among the blocks with its id in the old level, has its header written
+// and its children compared the same way; anything else is written whole. Adjacent copies and writes are combined.
+
+#define DIFF_MAXDEPTH			32
+#define DIFF_WINDOWSIZE			(1 << 20)
+
+// PDAT blocks are kept small enough that STRMMODE_COMPRESS will compress them
+#define DIFF_MAXDATA			(COMPRESSION_MAXBLOCK - sizeof(uint32_t))
+
+
+// A streaming 64-bit hash; data can be added in pieces of any size
+class CDiffHash
+{
+
+public:
+
+	CDiffHash() { Reset(); }
+
+	void Reset();
+	void Add(const void *data, size_t len);
+	uint64_t Get() const;
+
+protected:
+	inline void Mix(uint64_t w);
+
+	uint64_t m_Hash;
+	uint64_t m_Total;
+	uint8_t m_Pending[sizeof(uint64_t)];
+	size_t m_PendingLen;
+
+};
+
+
+class CStreamDiff : public genio::IStreamDiff
+{
+
+public:
+
+	CStreamDiff(genio::IAllocator *alloc);
+	virtual ~CStreamDiff();
+
+	virtual bool Diff(genio::IInputStream *oldis, genio::IInputStream *newis, genio::IOutputStream *patch);
+	virtual bool Apply(genio::IInputStream *oldis, genio::IInputStream *patch, genio::IOutputStream *os);
+	virtual void GetStats(genio::SPatchStats &stats) const;
+	virtual void Release();
+
+protected:
+	// Reads an input by absolute offset, through a window, so that walking headers doesn't take a read for each
+	struct SSource
+	{
+		SSource(genio::IAllocator *alloc = nullptr) : m_Window(alloc) { }
+
+		genio::IInputStream *m_Stream;
+		uint64_t m_Size;
+		TGenVector<uint8_t> m_Window;
+		uint64_t m_WindowStart;
+		size_t m_WindowValid;
+	};
+
+	void InitSource(SSource &src, genio::IInputStream *is);
+	bool ReadSource(SSource &src, uint64_t offset, void *data, size_t len);
+
+	// Adds [first, end) of src to the hash
+	bool HashRange(SSource &src, uint64_t first, uint64_t end, CDiffHash &hash);
+
+	struct SBlock
+	{
+		uint64_t m_Offset;				// of the header
+		uint64_t m_Size;				// header and data
+		uint64_t m_Hash;
+		genio::FOURCHARCODE m_ID;
+		uint32_t m_Flags;
+	};
+
+	typedef TGenVector<SBlock> TBlockArray;
+
+	// Lists the blocks that fill [first, end) of src, returning where they stop; that's end if they fill all of it.
+	// If file is given, every byte that's listed is added to it, in order
+	uint64_t ListBlocks(SSource &src, uint64_t first, uint64_t end, TBlockArray &blocks, CDiffHash *file);
+
+	// Lists the children of a block; false unless they fill all of its data
+	bool ListChildren(SSource &src, const SBlock &block, TBlockArray &children);
+
+	void DiffLevel(const TBlockArray &oldblocks, const TBlockArray &newblocks, uint32_t depth);
+
+	// Patch operations, combined with the one before them where possible
+	void EmitCopy(uint64_t offset, uint64_t len);
+	void EmitData(uint64_t offset, uint64_t len);
+	void FlushOp();
+
+	enum PATCH_OP
+	{
+		PO_NONE = 0,
+		PO_COPY,
+		PO_DATA
+	};
+
+	SSource m_Old, m_New;
+
+	genio::IOutputStream *m_Patch;
+	PATCH_OP m_Op;
+	uint64_t m_CopyOffset, m_CopyLength;
+	TGenVector<uint8_t> m_Data;
+
+	TGenVector<uint8_t> m_Buffer;
+
+	genio::SPatchStats m_Stats;
+
+	genio::IAllocator *m_Alloc;
+
+};
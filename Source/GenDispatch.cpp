@@ -0,0 +1,260 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenDispatch.h>
+
+
+genio::IBlockDispatcher *genio::IBlockDispatcher::Create(genio::IAllocator *alloc)
+{
+	return (genio::IBlockDispatcher *)(AllocNew<CBlockDispatcher>(alloc, alloc));
+}
+
+
+// ************************************************************************
+// Block Dispatcher Methods
+
+CBlockDispatcher::CBlockDispatcher(genio::IAllocator *alloc) :
+	m_Table(alloc)
+{
+	m_Alloc = alloc;
+
+	m_Shift = 4;
+	m_Used = 0;
+
+	SHandler empty;
+	memset(&empty, 0, sizeof(SHandler));
+	m_Table.assign((size_t)1 << m_Shift, empty);
+
+	m_Default = empty;
+}
+
+
+CBlockDispatcher::~CBlockDispatcher()
+{
+}
+
+
+void CBlockDispatcher::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+const CBlockDispatcher::SHandler *CBlockDispatcher::Find(genio::FOURCHARCODE id) const
+{
+	size_t mask = m_Table.size() - 1;
+
+	for (size_t i = Slot(id); m_Table[i].m_ID != genio::IStream::ENDBLOCKID; i = (i + 1) & mask)
+	{
+		if (m_Table[i].m_ID == id)
+			return m_Table[i].m_Func ? &m_Table[i] : nullptr;
+	}
+
+	return nullptr;
+}
+
+
+void CBlockDispatcher::Grow()
+{
+	TGenVector<SHandler> old(m_Alloc);
+	old.swap(m_Table);
+
+	SHandler empty;
+	memset(&empty, 0, sizeof(SHandler));
+
+	m_Shift++;
+	m_Table.assign((size_t)1 << m_Shift, empty);
+	m_Used = 0;
+
+	size_t mask = m_Table.size() - 1;
+
+	for (const SHandler &h : old)
+	{
+		if ((h.m_ID == genio::IStream::ENDBLOCKID) || !h.m_Func)
+			continue;
+
+		size_t i = Slot(h.m_ID);
+		while (m_Table[i].m_ID != genio::IStream::ENDBLOCKID)
+			i = (i + 1) & mask;
+
+		m_Table[i] = h;
+		m_Used++;
+	}
+}
+
+
+bool CBlockDispatcher::SetHandler(genio::FOURCHARCODE id, genio::BLOCK_HANDLER func, void *userdata, uint32_t flags)
+{
+	if (id == genio::IStream::ENDBLOCKID)
+		return false;
+
+	if (((m_Used + 1) * 2) > m_Table.size())
+		Grow();
+
+	size_t mask = m_Table.size() - 1;
+
+	size_t i = Slot(id);
+	while ((m_Table[i].m_ID != genio::IStream::ENDBLOCKID) && (m_Table[i].m_ID != id))
+		i = (i + 1) & mask;
+
+	SHandler &h = m_Table[i];
+
+	if (h.m_ID == genio::IStream::ENDBLOCKID)
+	{
+		// removing a handler that was never set doesn't need a slot
+		if (!func)
+			return true;
+
+		h.m_ID = id;
+		m_Used++;
+	}
+
+	h.m_Func = func;
+	h.m_UserData = userdata;
+	h.m_Flags = flags;
+
+	return true;
+}
+
+
+void CBlockDispatcher::SetDefaultHandler(genio::BLOCK_HANDLER func, void *userdata)
+{
+	m_Default.m_Func = func;
+	m_Default.m_UserData = userdata;
+}
+
+
+bool CBlockDispatcher::QueueJob(TJobList &jobs, genio::IInputStream *is, genio::ISharedInputFile *shared, genio::FOURCHARCODE id, const SHandler &h)
+{
+	jobs.emplace_back();
+
+	SJob &job = jobs.back();
+	job.m_Shared = shared;
+	job.m_ID = id;
+	job.m_Func = h.m_Func;
+	job.m_UserData = h.m_UserData;
+	job.m_Result = false;
+	job.m_Work = NULL;
+
+	if (is->SaveCursor(job.m_Cursor))
+		job.m_Work = CreateThreadpoolWork(JobCallback, &job, NULL);
+
+	if (!job.m_Work)
+	{
+		jobs.pop_back();
+		return false;
+	}
+
+	SubmitThreadpoolWork(job.m_Work);
+
+	return true;
+}
+
+
+void CALLBACK CBlockDispatcher::JobCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	SJob *job = (SJob *)context;
+
+	// The cursor is made on the heap; the dispatcher's allocator may not be safe to use from more than one thread
+	genio::IInputStream *is = job->m_Shared->CreateCursor();
+	if (!is)
+		return;
+
+	if (is->RestoreCursor(job->m_Cursor) && is->BeginBlock(job->m_ID))
+	{
+		job->m_Result = job->m_Func(is, job->m_ID, job->m_UserData);
+
+		is->EndBlock();
+	}
+
+	is->Release();
+}
+
+
+bool CBlockDispatcher::Dispatch(genio::IInputStream *is, genio::ISharedInputFile *shared)
+{
+	if (!is)
+		return false;
+
+	bool ret = true;
+
+	TJobList jobs(m_Alloc);
+
+	genio::FOURCHARCODE id;
+	while ((id = is->NextBlockId()) != genio::IStream::ENDBLOCKID)
+	{
+		const SHandler *found = Find(id);
+
+		if (found && shared && (found->m_Flags & BLOCKHANDLER_PARALLEL) && QueueJob(jobs, is, shared, id, *found))
+		{
+			// the header is still cached from NextBlockId, so skipping the block doesn't read anything
+			if (is->BeginBlock(id))
+				is->EndBlock();
+
+			continue;
+		}
+
+		// A copy, since a handler that calls SetHandler can make the table grow, which moves it
+		SHandler h = found ? *found : m_Default;
+
+		if (!is->BeginBlock(id))
+		{
+			ret = false;
+			break;
+		}
+
+		if (h.m_Func && !h.m_Func(is, id, h.m_UserData))
+			ret = false;
+
+		is->EndBlock();
+	}
+
+	// consume the terminator, if the loop didn't stop at the end of the file
+	if (is->BeginBlock(genio::IStream::ENDBLOCKID))
+		is->EndBlock();
+
+	while (!jobs.empty())
+	{
+		SJob &job = jobs.back();
+
+		WaitForThreadpoolWorkCallbacks(job.m_Work, FALSE);
+		CloseThreadpoolWork(job.m_Work);
+
+		if (!job.m_Result)
+			ret = false;
+
+		jobs.pop_back();
+	}
+
+	return ret;
+}
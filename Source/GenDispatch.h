@@ -0,0 +1,110 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+
+
+// Implements the block dispatcher
+//
+// Handlers are kept in an open-addressed table keyed by block id, with linear probing; it's a power of two
+// in size and never more than half full, so finding a handler is usually a multiply and one compare.
+
+
+class CBlockDispatcher : public genio::IBlockDispatcher
+{
+
+public:
+
+	CBlockDispatcher(genio::IAllocator *alloc);
+	virtual ~CBlockDispatcher();
+
+	virtual bool SetHandler(genio::FOURCHARCODE id, genio::BLOCK_HANDLER func, void *userdata = nullptr, uint32_t flags = 0);
+	virtual void SetDefaultHandler(genio::BLOCK_HANDLER func, void *userdata = nullptr);
+	virtual bool Dispatch(genio::IInputStream *is, genio::ISharedInputFile *shared = nullptr);
+	virtual void Release();
+
+protected:
+	struct SHandler
+	{
+		genio::FOURCHARCODE m_ID;		// ENDBLOCKID marks an empty slot
+		genio::BLOCK_HANDLER m_Func;	// NULL once the handler has been removed; the slot stays taken so lookups probe past it
+		void *m_UserData;
+		uint32_t m_Flags;
+	};
+
+	inline size_t Slot(genio::FOURCHARCODE id) const
+	{
+		return (size_t)((uint32_t)(id * 2654435761u) >> (32 - m_Shift));
+	}
+
+	// Returns the handler for the given id, or NULL if there isn't one
+	const SHandler *Find(genio::FOURCHARCODE id) const;
+
+	// Doubles the size of the table, leaving out the slots of removed handlers
+	void Grow();
+
+	TGenVector<SHandler> m_Table;
+	uint32_t m_Shift;				// the table has (1 << m_Shift) slots
+	size_t m_Used;					// slots that aren't empty, including those of removed handlers
+
+	SHandler m_Default;
+
+	// A block that is being handled on the thread pool; it has its own cursor, made from the shared file
+	// and restored to where the block's header is, so the dispatching stream can skip straight past it
+	struct SJob
+	{
+		genio::ISharedInputFile *m_Shared;
+		genio::SStreamCursor m_Cursor;
+		genio::FOURCHARCODE m_ID;
+		genio::BLOCK_HANDLER m_Func;
+		void *m_UserData;
+		PTP_WORK m_Work;
+		bool m_Result;
+	};
+
+	// A deque, so jobs that are running don't move when more are added. Every Dispatch has its own, so that a handler
+	// dispatching its block's children doesn't touch the list of the Dispatch that called it
+	typedef std::deque<SJob, TGenAllocator<SJob>> TJobList;
+
+	// Starts handling the block at the stream's position on the thread pool; false if that can't be done
+	bool QueueJob(TJobList &jobs, genio::IInputStream *is, genio::ISharedInputFile *shared, genio::FOURCHARCODE id, const SHandler &h);
+
+	static void CALLBACK JobCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work);
+
+	genio::IAllocator *m_Alloc;
+
+};
@@ -34,6 +34,8 @@
 #pragma once
 
 
+#include <GenAllocator.h>
+
 
 // ************************************************************************
 
@@ -52,7 +54,7 @@ template <typename T> struct SFlagset
 	inline void Clear(T f) { flags &= ~f; }
 
 	inline operator T() { return flags; }
-	inline T Get() { return flags; }
+	inline T Get() const { return flags; }
 
 	inline bool IsSet(T f) { return (((flags & f) == f) ? true : false); }
 
@@ -99,7 +101,360 @@ struct SStreamBlockEntry
 	SStreamBlockInfo m_Info;
 	size_t m_BlockStart;
 	uint32_t m_RunningCrc;
+	size_t m_FirstChild;				// output streams: where this block's children start in the child directory records
+};
+
+
+// ************************************************************************
+
+// Child directories are written by output streams in STRMMODE_CHILDDIRECTORY as the last child of
+// a block. The payload is a sorted array of entries, a bloom filter over the entries' ids, and a trailer;
+// the trailer is always the last thing in the parent, so readers can find the directory from the
+// parent's extent alone. Readers that don't know about directories just see an unrecognized block.
+
+#define CHILDDIRECTORYID	'GDIR'
+
+#pragma pack(push, childdirectory_pack)
+
+#pragma pack(1)
+
+struct SChildDirEntry
+{
+	genio::FOURCHARCODE m_ID;			// the child's id
+	uint64_t m_Offset;					// the offset of the child's header from the start of the parent's data
+};
+
+struct SChildDirTrailer
+{
+	uint32_t m_Count;					// number of SChildDirEntry's
+	uint32_t m_BloomBits;				// size of the bloom filter, always a multiple of 8
+	genio::FOURCHARCODE m_Magic;		// CHILDDIRECTORYID
+};
+
+#pragma pack(pop, childdirectory_pack)
+
+
+// ************************************************************************
+
+// In STRMMODE_SWMR, the writer starts the file with this block, and after each top-level block it finishes, it
+// writes the length of the file up to that point into it. Readers never go past that length at the top level.
+// The length is 8-byte aligned in the file, so that it's always written and read whole; SStreamBlockInfo is 4 bytes
+// shorter where size_t is, so the header is padded there to keep it at the same offset
+
+#pragma pack(push, swmrheader_pack)
+
+#pragma pack(1)
+
+struct SSWMRHeader
+{
+	SStreamBlockInfo m_Info;			// SWMRHEADERID; its data is the rest of this
+	uint32_t m_Version;					// SWMR_VERSION
+#if (SIZE_MAX == UINT32_MAX)
+	uint32_t m_Reserved;				// 0
+#endif
+	uint64_t m_Committed;				// the length of the file that readers may see
+};
+
+#pragma pack(pop, swmrheader_pack)
+
+static_assert((offsetof(SSWMRHeader, m_Committed) % 8) == 0, "the SWMR commit marker must be 8-byte aligned");
+
+#define SWMR_VERSION			1
+
+// Change notifications aren't sent for every write, so readers waiting on a commit check again at least this often (ms)
+#define SWMR_POLLINTERVAL		100
+
+
+// ************************************************************************
+
+// Key indexes are written by output streams at Close, as the last top-level block, if any keys were added. The payload
+// is the entries, sorted by key, and a trailer, which is the last thing in the file so that readers can find the index
+// from the end of the file alone. The trailer also describes a line from the smallest key to the largest, giving
+// each key's expected place in the entries, and how far from it any entry actually is; for keys that are spread
+// evenly, like GUIDs, that leaves only a few entries to search
+
+#pragma pack(push, keyindex_pack)
+
+#pragma pack(1)
+
+struct SKeyIndexEntry
+{
+	uint64_t m_Key;
+	uint64_t m_Offset;					// of the top-level block's header
+};
+
+struct SKeyIndexTrailer
+{
+	uint64_t m_Count;					// number of SKeyIndexEntry's
+	uint64_t m_MinKey, m_MaxKey;
+	uint64_t m_MaxError;				// the furthest any entry is from where the line puts it
+	genio::FOURCHARCODE m_Magic;		// KEYINDEXID
+};
+
+#pragma pack(pop, keyindex_pack)
+
+// Readers get this much of the end of the file in the first read for the key index, which is enough for ~4000 keys
+#define KEYINDEX_TAILREAD		(64 << 10)
+
+
+// Returns true for the blocks streams write for their own use, which can't be given a key
+inline bool IsInternalBlockID(genio::FOURCHARCODE id)
+{
+	return (id == COMPRESSIONDICTIONARYID) || (id == SWMRHEADERID) || (id == CHILDDIRECTORYID) || (id == KEYINDEXID);
+}
+
+
+// Returns where the line through the smallest and largest keys puts the given key amongst the entries
+inline uint64_t PredictKeyIndex(const SKeyIndexTrailer &kit, uint64_t key)
+{
+	if ((kit.m_Count < 2) || (key <= kit.m_MinKey) || (kit.m_MaxKey <= kit.m_MinKey))
+		return 0;
+
+	if (key >= kit.m_MaxKey)
+		return kit.m_Count - 1;
+
+	double t = (double)(key - kit.m_MinKey) / (double)(kit.m_MaxKey - kit.m_MinKey);
+
+	return std::min<uint64_t>((uint64_t)(t * (double)(kit.m_Count - 1)), kit.m_Count - 1);
+}
+
+
+/// Bloom filter helpers for child directories; ~10 bits per entry and 3 probes gives
+/// a false positive rate of around 2%
+struct SChildDirBloom
+{
+	enum
+	{
+		BITSPERENTRY = 10,
+		PROBES = 3,
+		MINBITS = 64
+	};
+
+	static inline uint32_t BitsFor(size_t count)
+	{
+		size_t bits = std::max<size_t>(count * BITSPERENTRY, MINBITS);
+		return (uint32_t)((bits + 7) & ~(size_t)7);
+	}
+
+	static inline void Probes(genio::FOURCHARCODE id, uint32_t bits, uint32_t *probe)
+	{
+		// double hashing, from two multiplicative hashes of the id
+		uint32_t h1 = id * 0x9E3779B1;
+		uint32_t h2 = ((id ^ (id >> 16)) * 0x85EBCA6B) | 1;
+
+		for (uint32_t i = 0; i < PROBES; i++)
+			probe[i] = (h1 + (i * h2)) % bits;
+	}
+
+	static inline void Add(uint8_t *bloom, uint32_t bits, genio::FOURCHARCODE id)
+	{
+		uint32_t probe[PROBES];
+		Probes(id, bits, probe);
+
+		for (uint32_t i = 0; i < PROBES; i++)
+			bloom[probe[i] >> 3] |= (uint8_t)(1 << (probe[i] & 7));
+	}
+
+	static inline bool MayContain(const uint8_t *bloom, uint32_t bits, genio::FOURCHARCODE id)
+	{
+		uint32_t probe[PROBES];
+		Probes(id, bits, probe);
+
+		for (uint32_t i = 0; i < PROBES; i++)
+		{
+			if (!(bloom[probe[i] >> 3] & (1 << (probe[i] & 7))))
+				return false;
+		}
+
+		return true;
+	}
 };
 
-typedef class std::deque<SStreamBlockEntry> TStreamBlockStack;
+/// A stack that keeps its first N elements inside itself and only goes to the heap for any past that,
+/// so that pushing and popping never allocates until nesting gets deep. T must be trivially copyable
+template <typename T, size_t N> class CInlineStack
+{
+
+public:
+
+	CInlineStack(genio::IAllocator *alloc = nullptr) : m_Spill(alloc) { m_Count = 0; }
+
+	inline bool empty() const { return (m_Count == 0); }
+	inline size_t size() const { return m_Count; }
+
+	inline void clear()
+	{
+		m_Count = 0;
+		m_Spill.clear();
+	}
+
+	inline void push_back(const T &t)
+	{
+		if (m_Count < N)
+			m_Inline[m_Count] = t;
+		else
+			m_Spill.push_back(t);
+
+		m_Count++;
+	}
+
+	inline void pop_back()
+	{
+		assert(m_Count);
+
+		m_Count--;
+		if (m_Count >= N)
+			m_Spill.pop_back();
+	}
+
+	inline T &operator [](size_t i) { return (i < N) ? m_Inline[i] : m_Spill[i - N]; }
+	inline const T &operator [](size_t i) const { return (i < N) ? m_Inline[i] : m_Spill[i - N]; }
+
+	inline T &back() { return (*this)[m_Count - 1]; }
+	inline const T &back() const { return (*this)[m_Count - 1]; }
+
+	// Iterates from the bottom of the stack to the top
+	template <typename S, typename E> class iterator_t
+	{
+	public:
+		iterator_t(S *s, size_t i) : m_Stack(s), m_Index(i) { }
+
+		inline E &operator *() const { return (*m_Stack)[m_Index]; }
+		inline E *operator ->() const { return &(*m_Stack)[m_Index]; }
+		inline iterator_t &operator ++() { m_Index++; return *this; }
+		inline bool operator ==(const iterator_t &it) const { return (m_Index == it.m_Index); }
+		inline bool operator !=(const iterator_t &it) const { return (m_Index != it.m_Index); }
+
+	protected:
+		S *m_Stack;
+		size_t m_Index;
+	};
+
+	typedef iterator_t<CInlineStack, T> iterator;
+	typedef iterator_t<const CInlineStack, const T> const_iterator;
+
+	inline iterator begin() { return iterator(this, 0); }
+	inline iterator end() { return iterator(this, m_Count); }
+	inline const_iterator begin() const { return const_iterator(this, 0); }
+	inline const_iterator end() const { return const_iterator(this, m_Count); }
+
+protected:
+	T m_Inline[N];
+	TGenVector<T> m_Spill;
+	size_t m_Count;
+
+};
+
+
+// Blocks are rarely nested deeper than this
+#define STREAMBLOCKSTACK_INLINEDEPTH	16
+
+typedef CInlineStack<SStreamBlockEntry, STREAMBLOCKSTACK_INLINEDEPTH> TStreamBlockStack;
+
+
+// ************************************************************************
+
+/// SBlockHook holds a stream's block callback and fires events at it
+struct SBlockHook
+{
+	SBlockHook() { m_Func = nullptr; m_UserData = nullptr; }
+
+	inline void Set(genio::BLOCK_CALLBACK func, void *userdata) { m_Func = func; m_UserData = userdata; }
+
+	inline void Fire(genio::SBlockEvent::EVENT_TYPE type, genio::IStream *stream, genio::FOURCHARCODE id, size_t depth, uint64_t offset, uint64_t length)
+	{
+		if (!m_Func)
+			return;
+
+		genio::SBlockEvent ev;
+		ev.m_Type = type;
+		ev.m_Stream = stream;
+		ev.m_ID = id;
+		ev.m_Depth = (uint32_t)depth;
+		ev.m_Offset = offset;
+		ev.m_Length = length;
+		ev.m_Timestamp = Nanoseconds();
+
+		m_Func(ev, m_UserData);
+	}
+
+	static uint64_t Nanoseconds()
+	{
+		static LARGE_INTEGER freq = { 0 };
+		if (!freq.QuadPart)
+			QueryPerformanceFrequency(&freq);
+
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+
+		// split the conversion so that the multiplication can't overflow
+		uint64_t sec = (uint64_t)t.QuadPart / (uint64_t)freq.QuadPart;
+		uint64_t rem = (uint64_t)t.QuadPart % (uint64_t)freq.QuadPart;
+
+		return (sec * 1000000000ULL) + ((rem * 1000000000ULL) / (uint64_t)freq.QuadPart);
+	}
+
+	genio::BLOCK_CALLBACK m_Func;
+	void *m_UserData;
+};
+
+
+// ************************************************************************
+
+/// Converts a FOURCC to its printable form; s must hold at least 5 characters.
+/// Unprintable characters come out as '.'
+inline void FourCCToString(genio::FOURCHARCODE id, TCHAR *s)
+{
+	for (size_t i = 0; i < 4; i++)
+	{
+		TCHAR c = (TCHAR)((id >> ((3 - i) * 8)) & 0xFF);
+		s[i] = ((c >= _T(' ')) && (c <= _T('~'))) ? c : _T('.');
+	}
+
+	s[4] = _T('\0');
+}
+
+
+/// Reads a FOURCC from up to 4 characters of s, stopping early at any character in the delimiter set.
+/// Like multi-character literals, shorter ids are right-aligned ("ab" == 'ab'). Returns the number
+/// of characters consumed, or 0 if there were none (or too many)
+inline size_t StringToFourCC(const TCHAR *s, const TCHAR *delimiters, genio::FOURCHARCODE &id)
+{
+	id = 0;
+
+	size_t i = 0;
+	while (s[i] && !_tcschr(delimiters, s[i]))
+	{
+		if (i == 4)
+			return 0;
+
+		id = (id << 8) | (uint8_t)s[i];
+		i++;
+	}
+
+	return i;
+}
+
+
+// ************************************************************************
+
+// Vectored I/O. Windows' own scatter / gather calls need unbuffered handles and page-sized buffers,
+// so segments smaller than IOV_DIRECTTHRESHOLD are instead gathered into a buffer of up to IOV_GATHERSIZE
+// bytes and moved with one call; copying those is cheaper than a call apiece. Larger segments go straight
+// to (or from) the OS
+#define IOV_DIRECTTHRESHOLD		(16 << 10)
+#define IOV_GATHERSIZE			(64 << 10)
+
+// The most that is passed to a single ReadFile / WriteFile
+#define IOV_MAXCALLSIZE			(1 << 30)
+
+// Blocks copied between streams are moved this much at a time
+#define BLOCKCOPY_CHUNKSIZE		(1 << 20)
+
+// The size of an output stream's write buffer in STRMMODE_WRITEBUFFER; writes at least this big bypass it
+#define WRITEBUFFER_SIZE		(1 << 20)
 
+// In STRMMODE_READAHEAD, entering a block at least READAHEAD_MINBLOCK long starts reading it ahead in the
+// background, READAHEAD_WINDOWSIZE at a time into two alternating windows
+#define READAHEAD_MINBLOCK		(256 << 10)
+#define READAHEAD_WINDOWSIZE	(1 << 20)
@@ -0,0 +1,300 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenMerge.h>
+
+
+genio::IStreamMerger *genio::IStreamMerger::Create(genio::IAllocator *alloc)
+{
+	return (genio::IStreamMerger *)(AllocNew<CStreamMerger>(alloc, alloc));
+}
+
+
+// ************************************************************************
+// Stream Merger Methods
+
+CStreamMerger::CStreamMerger(genio::IAllocator *alloc) :
+	m_Inputs(alloc)
+{
+	m_Alloc = alloc;
+	m_KeyID = genio::IStream::ENDBLOCKID;
+	m_TombstoneID = genio::IStream::ENDBLOCKID;
+}
+
+
+CStreamMerger::~CStreamMerger()
+{
+}
+
+
+void CStreamMerger::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+void CStreamMerger::AddInput(genio::IInputStream *is)
+{
+	if (!is)
+		return;
+
+	SMergeInput in;
+	in.m_Merger = this;
+	in.m_Stream = is;
+	in.m_Start = 0;
+
+	m_Inputs.push_back(in);
+}
+
+
+void CStreamMerger::SetKeyBlock(genio::FOURCHARCODE id)
+{
+	m_KeyID = id;
+}
+
+
+void CStreamMerger::SetTombstoneBlock(genio::FOURCHARCODE id)
+{
+	m_TombstoneID = id;
+}
+
+
+void CStreamMerger::ScanInput(SMergeInput &in)
+{
+	genio::IInputStream *is = in.m_Stream;
+
+	in.m_Objects.clear();
+	in.m_Dictionary.clear();
+	in.m_Start = is->Pos();
+
+	genio::FOURCHARCODE id;
+	while ((id = is->NextBlockId()) != genio::IStream::ENDBLOCKID)
+	{
+		SMergeObject mo;
+		mo.m_Offset = is->Pos();
+		mo.m_ID = id;
+		mo.m_HasKey = false;
+		mo.m_Tombstone = false;
+		mo.m_Keep = true;
+
+		if (!is->BeginBlock(id))
+			break;
+
+		// The dictionary is written to the output once, up front, rather than being copied as an object
+		if (id == COMPRESSIONDICTIONARYID)
+		{
+			in.m_Dictionary.resize(COMPRESSION_MAXDICTIONARY);
+			in.m_Dictionary.resize(is->ReadAt(0, (void *)in.m_Dictionary.data(), in.m_Dictionary.size()));
+
+			is->EndBlock();
+			continue;
+		}
+
+		if ((m_KeyID != genio::IStream::ENDBLOCKID) && is->FindChild(m_KeyID))
+		{
+			// The size in the header is the stored size, which is smaller than the key if the block is compressed;
+			// ReadAt stops at the end of the decoded block
+			if (is->BeginBlock(m_KeyID))
+			{
+				mo.m_Key.resize(MERGE_MAXKEYLENGTH);
+				mo.m_Key.resize(is->ReadAt(0, (void *)mo.m_Key.data(), mo.m_Key.size()));
+				mo.m_HasKey = !mo.m_Key.empty();
+
+				is->EndBlock();
+			}
+		}
+
+		if (mo.m_HasKey && (m_TombstoneID != genio::IStream::ENDBLOCKID) && is->FindChild(m_TombstoneID))
+			mo.m_Tombstone = true;
+
+		is->EndBlock();
+
+		// The directory of an input that was itself merged is replaced by the new one, and its key index and
+		// SWMR block only describe that file
+		if ((id != MERGEDIRECTORYID) && (id != KEYINDEXID) && (id != SWMRHEADERID))
+			in.m_Objects.push_back(mo);
+	}
+}
+
+
+void CALLBACK CStreamMerger::ScanCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
+{
+	SMergeInput *in = (SMergeInput *)context;
+
+	in->m_Merger->ScanInput(*in);
+}
+
+
+void CStreamMerger::ResolveKeys()
+{
+	TGenMap<std::string, SMergeObject *> latest(m_Alloc);
+
+	for (auto &in : m_Inputs)
+	{
+		for (auto &mo : in.m_Objects)
+		{
+			if (!mo.m_HasKey)
+				continue;
+
+			auto it = latest.find(mo.m_Key);
+			if (it != latest.end())
+			{
+				it->second->m_Keep = false;
+				latest.erase(it);
+			}
+
+			if (mo.m_Tombstone)
+				mo.m_Keep = false;
+			else
+				latest.insert(std::make_pair(mo.m_Key, &mo));
+		}
+	}
+}
+
+
+bool CStreamMerger::CheckDictionaries() const
+{
+	for (const auto &in : m_Inputs)
+	{
+		if (in.m_Dictionary != m_Inputs.front().m_Dictionary)
+			return false;
+	}
+
+	return true;
+}
+
+
+size_t CStreamMerger::Merge(genio::IOutputStream *os)
+{
+	if (!os)
+		return 0;
+
+	// Every input is a separate stream, so each one can be scanned on a thread of its own
+	TGenVector<PTP_WORK> work(m_Inputs.size(), nullptr, m_Alloc);
+
+	for (size_t i = 0; i < m_Inputs.size(); i++)
+	{
+		work[i] = CreateThreadpoolWork(ScanCallback, &m_Inputs[i], NULL);
+		if (work[i])
+			SubmitThreadpoolWork(work[i]);
+		else
+			ScanInput(m_Inputs[i]);
+	}
+
+	for (auto w : work)
+	{
+		if (!w)
+			continue;
+
+		WaitForThreadpoolWorkCallbacks(w, FALSE);
+		CloseThreadpoolWork(w);
+	}
+
+	if (m_Inputs.empty() || !CheckDictionaries())
+		return 0;
+
+	const std::string &dict = m_Inputs.front().m_Dictionary;
+	if (!dict.empty() && !os->SetCompressionDictionary(dict.data(), dict.length()))
+		return 0;
+
+	ResolveKeys();
+
+	size_t ret = 0;
+
+	TGenVector<SMergeDirEntry> dir(m_Alloc);
+
+	for (auto &in : m_Inputs)
+	{
+		// After a block has been copied, the input is already at the next one; it only has to seek after a skip
+		bool positioned = false;
+
+		for (auto &mo : in.m_Objects)
+		{
+			if (!mo.m_Keep)
+			{
+				positioned = false;
+				continue;
+			}
+
+			if (!positioned)
+				in.m_Stream->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)mo.m_Offset);
+
+			SMergeDirEntry de;
+			de.m_Offset = os->Pos();
+			de.m_Object = &mo;
+
+			positioned = os->CopyBlockFrom(in.m_Stream);
+			if (positioned)
+			{
+				// Objects keyed by a 64-bit id can be found in the output with FindByKey
+				if (mo.m_HasKey && (mo.m_Key.length() == sizeof(uint64_t)))
+				{
+					uint64_t key;
+					memcpy(&key, mo.m_Key.data(), sizeof(uint64_t));
+					os->AddKey(key);
+				}
+
+				dir.push_back(de);
+				ret++;
+			}
+		}
+	}
+
+	WriteDirectory(os, dir);
+
+	return ret;
+}
+
+
+void CStreamMerger::WriteDirectory(genio::IOutputStream *os, const TGenVector<SMergeDirEntry> &dir)
+{
+	if (!os->BeginBlock(MERGEDIRECTORYID))
+		return;
+
+	os->WriteUINT32((uint32_t)dir.size());
+
+	for (const auto &de : dir)
+	{
+		const SMergeObject &mo = *de.m_Object;
+
+		uint16_t keylen = mo.m_HasKey ? (uint16_t)mo.m_Key.length() : 0;
+
+		os->WriteUINT64(de.m_Offset);
+		os->WriteUINT32(mo.m_ID);
+		os->WriteUINT16(keylen);
+		if (keylen)
+			os->Write(mo.m_Key.data(), 1, keylen);
+	}
+
+	os->EndBlock();
+}
@@ -0,0 +1,111 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+
+
+// Implements the stream merger
+
+
+// Keys are written to the merge directory with a UINT16 length, so longer key blocks are cut off here
+#define MERGE_MAXKEYLENGTH		0xFFFF
+
+
+class CStreamMerger : public genio::IStreamMerger
+{
+
+public:
+
+	CStreamMerger(genio::IAllocator *alloc);
+	virtual ~CStreamMerger();
+
+	virtual void AddInput(genio::IInputStream *is);
+	virtual void SetKeyBlock(genio::FOURCHARCODE id);
+	virtual void SetTombstoneBlock(genio::FOURCHARCODE id);
+	virtual size_t Merge(genio::IOutputStream *os);
+	virtual void Release();
+
+protected:
+	// One top-level block of an input
+	struct SMergeObject
+	{
+		uint64_t m_Offset;
+		genio::FOURCHARCODE m_ID;
+		bool m_HasKey;
+		bool m_Tombstone;
+		bool m_Keep;
+		std::string m_Key;				// the raw data of the key block
+	};
+
+	struct SMergeInput
+	{
+		CStreamMerger *m_Merger;
+		genio::IInputStream *m_Stream;
+		uint64_t m_Start;
+		std::vector<SMergeObject> m_Objects;
+		std::string m_Dictionary;		// the data of the input's COMPRESSIONDICTIONARYID block, if it has one
+	};
+
+	struct SMergeDirEntry
+	{
+		uint64_t m_Offset;				// in the output
+		const SMergeObject *m_Object;
+	};
+
+	// Records the offset, id and key of every top-level block from the input's current position on
+	void ScanInput(SMergeInput &in);
+
+	static void CALLBACK ScanCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work);
+
+	// Marks the objects that are superseded or deleted by a later one with the same key
+	void ResolveKeys();
+
+	// Compressed blocks are copied without being decoded, so every input has to have been compressed with the
+	// same dictionary (or none); returns false if they weren't
+	bool CheckDictionaries() const;
+
+	void WriteDirectory(genio::IOutputStream *os, const TGenVector<SMergeDirEntry> &dir);
+
+	genio::FOURCHARCODE m_KeyID;			// ENDBLOCKID if objects have no keys
+	genio::FOURCHARCODE m_TombstoneID;		// ENDBLOCKID if nothing is ever deleted
+
+	// The inputs are scanned on the thread pool, so what the scans record comes from the heap rather than m_Alloc
+	std::deque<SMergeInput, TGenAllocator<SMergeInput>> m_Inputs;
+
+	genio::IAllocator *m_Alloc;
+
+};
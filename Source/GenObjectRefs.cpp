@@ -0,0 +1,212 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenObjectRefs.h>
+
+
+genio::IObjectRefWriter *genio::IObjectRefWriter::Create(size_t reserve, genio::IAllocator *alloc)
+{
+	return (genio::IObjectRefWriter *)(AllocNew<CObjectRefWriter>(alloc, reserve, alloc));
+}
+
+
+genio::IObjectRefReader *genio::IObjectRefReader::Create(size_t reserve, genio::IAllocator *alloc)
+{
+	return (genio::IObjectRefReader *)(AllocNew<CObjectRefReader>(alloc, reserve, alloc));
+}
+
+
+// ************************************************************************
+// Object Reference Writer Methods
+
+CObjectRefWriter::CObjectRefWriter(size_t reserve, genio::IAllocator *alloc) :
+	m_Ids(TGenAllocator<std::pair<const void * const, uint32_t>>(alloc))
+{
+	m_Alloc = alloc;
+
+	if (reserve)
+		m_Ids.reserve(reserve);
+}
+
+
+CObjectRefWriter::~CObjectRefWriter()
+{
+}
+
+
+void CObjectRefWriter::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+bool CObjectRefWriter::WriteReference(genio::IOutputStream *os, const void *obj)
+{
+	if (!os)
+		return false;
+
+	uint32_t objid = 0;
+	bool first = false;
+
+	if (obj)
+	{
+		auto ins = m_Ids.insert(std::make_pair(obj, (uint32_t)(m_Ids.size() + 1)));
+		objid = ins.first->second;
+		first = ins.second;
+	}
+
+	if (!os->BeginBlock(first ? OBJECTIDBLOCKID : OBJECTREFBLOCKID))
+	{
+		// the object hasn't been written, so the next reference to it must be its first occurrence
+		if (first)
+			m_Ids.erase(obj);
+
+		return false;
+	}
+
+	os->WriteUINT32(objid);
+	os->EndBlock();
+
+	return first;
+}
+
+
+uint32_t CObjectRefWriter::GetObjectId(const void *obj) const
+{
+	auto it = m_Ids.find(obj);
+	return (it != m_Ids.end()) ? it->second : 0;
+}
+
+
+size_t CObjectRefWriter::GetObjectCount() const
+{
+	return m_Ids.size();
+}
+
+
+void CObjectRefWriter::Reset()
+{
+	m_Ids.clear();
+}
+
+
+// ************************************************************************
+// Object Reference Reader Methods
+
+CObjectRefReader::CObjectRefReader(size_t reserve, genio::IAllocator *alloc) :
+	m_Objects(alloc)
+{
+	m_Alloc = alloc;
+
+	m_Objects.reserve(reserve + 1);
+
+	Reset();
+}
+
+
+CObjectRefReader::~CObjectRefReader()
+{
+}
+
+
+void CObjectRefReader::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+bool CObjectRefReader::ReadReference(genio::IInputStream *is, uint32_t &objid, void *&obj)
+{
+	objid = 0;
+	obj = nullptr;
+
+	if (!is)
+		return false;
+
+	genio::FOURCHARCODE id = is->NextBlockId();
+	if ((id != OBJECTIDBLOCKID) && (id != OBJECTREFBLOCKID))
+		return false;
+
+	if (!is->BeginBlock(id))
+		return false;
+
+	uint32_t refid = 0;
+	is->ReadUINT32(refid);
+
+	is->EndBlock();
+
+	if (id == OBJECTREFBLOCKID)
+	{
+		obj = GetObject(refid);
+		return false;
+	}
+
+	if (!refid)
+		return false;
+
+	// Ids are handed out in the order objects are written, so a new one can only be the next; one past that is corrupt
+	if (refid > m_Objects.size())
+		return false;
+
+	if (refid == m_Objects.size())
+		m_Objects.push_back(nullptr);
+
+	objid = refid;
+
+	return true;
+}
+
+
+void CObjectRefReader::SetObject(uint32_t objid, void *obj)
+{
+	if (!objid || (objid > m_Objects.size()))
+		return;
+
+	if (objid == m_Objects.size())
+		m_Objects.push_back(nullptr);
+
+	m_Objects[objid] = obj;
+}
+
+
+void *CObjectRefReader::GetObject(uint32_t objid) const
+{
+	return (objid < m_Objects.size()) ? m_Objects[objid] : nullptr;
+}
+
+
+void CObjectRefReader::Reset()
+{
+	m_Objects.clear();
+	m_Objects.push_back(nullptr);
+}
@@ -0,0 +1,89 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+
+
+// Implements the object reference writer and reader
+//
+// The writer keeps a table of every object pointer it has been given, hashed by identity, and numbers them
+// from 1 in the order they're first seen. Since objects are read back in the order they were written, the
+// reader's table is just an array indexed by id.
+
+
+class CObjectRefWriter : public genio::IObjectRefWriter
+{
+
+public:
+
+	CObjectRefWriter(size_t reserve, genio::IAllocator *alloc);
+	virtual ~CObjectRefWriter();
+
+	virtual bool WriteReference(genio::IOutputStream *os, const void *obj);
+	virtual uint32_t GetObjectId(const void *obj) const;
+	virtual size_t GetObjectCount() const;
+	virtual void Reset();
+	virtual void Release();
+
+protected:
+	TGenHashMap<const void *, uint32_t> m_Ids;
+
+	genio::IAllocator *m_Alloc;
+
+};
+
+
+class CObjectRefReader : public genio::IObjectRefReader
+{
+
+public:
+
+	CObjectRefReader(size_t reserve, genio::IAllocator *alloc);
+	virtual ~CObjectRefReader();
+
+	virtual bool ReadReference(genio::IInputStream *is, uint32_t &objid, void *&obj);
+	virtual void SetObject(uint32_t objid, void *obj);
+	virtual void *GetObject(uint32_t objid) const;
+	virtual void Reset();
+	virtual void Release();
+
+protected:
+	TGenVector<void *> m_Objects;		// indexed by id; [0] is the null reference
+
+	genio::IAllocator *m_Alloc;
+
+};
@@ -36,8 +36,10 @@
 #include <string.h>
 
 
-CGenParserA::CGenParserA()
+CGenParserA::CGenParserA(genio::IAllocator *alloc) :
+	m_curStr(alloc)
 {
+	m_Alloc = alloc;
 	m_data = nullptr;
 	m_datalen = 0;
 	m_pos = 0;
@@ -411,8 +413,10 @@ bool CGenParserA::IsToken(const char *s, bool case_sensitive) const
 	return !_stricmp(m_curStr.c_str(), s);
 }
 
-CGenParserW::CGenParserW()
+CGenParserW::CGenParserW(genio::IAllocator *alloc) :
+	m_curStr(alloc)
 {
+	m_Alloc = alloc;
 	m_data = nullptr;
 	m_datalen = 0;
 	m_pos = 0;
@@ -814,16 +818,16 @@ bool CGenParserW::IsToken(const wchar_t *s, bool case_sensitive) const
 	return !_wcsicmp(m_curStr.c_str(), s);
 }
 
-genio::IParser *genio::IParser::Create(CHAR_MODE mode)
+genio::IParser *genio::IParser::Create(CHAR_MODE mode, genio::IAllocator *alloc)
 {
 	switch (mode)
 	{
 		case CM_ASCII:
-			return new CGenParserA();
+			return AllocNew<CGenParserA>(alloc, alloc);
 			break;
 
 		case CM_UNICODE:
-			return new CGenParserW();
+			return AllocNew<CGenParserW>(alloc, alloc);
 			break;
 	}
 
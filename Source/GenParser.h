@@ -34,11 +34,12 @@
 #pragma once
 
 #include <PowerProps.h>
+#include <GenAllocator.h>
 
 class CGenParserA : public genio::IParserA
 {
 public:
-	CGenParserA();
+	CGenParserA(genio::IAllocator *alloc);
 
 	virtual ~CGenParserA();
 
@@ -55,7 +56,7 @@ public:
 
 	virtual bool IsToken(const char *s, bool case_sensitive = false) const;
 
-	virtual void Release() { delete this; }
+	virtual void Release() { AllocDelete(m_Alloc, this); }
 
 	virtual void SetModeFlags(uint64_t flags) { m_flags = flags; }
 	virtual uint64_t GetModeFlags() { return m_flags; }
@@ -66,16 +67,18 @@ protected:
 	size_t m_pos;
 	size_t m_start, m_end;
 
-	std::basic_string<char> m_curStr;
+	TGenString<char> m_curStr;
 	genio::IParser::TOKEN_TYPE m_curType;
 
 	props::TFlags64 m_flags;
+
+	genio::IAllocator *m_Alloc;
 };
 
 class CGenParserW : public genio::IParserW
 {
 public:
-	CGenParserW();
+	CGenParserW(genio::IAllocator *alloc);
 
 	~CGenParserW();
 
@@ -92,7 +95,7 @@ public:
 
 	virtual bool IsToken(const wchar_t *s, bool case_sensitive = false) const;
 
-	virtual void Release() { delete this; }
+	virtual void Release() { AllocDelete(m_Alloc, this); }
 
 	virtual void SetModeFlags(uint64_t flags) { m_flags = flags; }
 	virtual uint64_t GetModeFlags() { return m_flags; }
@@ -103,9 +106,11 @@ protected:
 	size_t m_pos;
 	size_t m_start, m_end;
 
-	std::basic_string<wchar_t> m_curStr;
+	TGenString<wchar_t> m_curStr;
 	genio::IParser::TOKEN_TYPE m_curType;
 
 	props::TFlags64 m_flags;
+
+	genio::IAllocator *m_Alloc;
 };
 
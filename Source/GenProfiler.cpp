@@ -0,0 +1,329 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenProfiler.h>
+
+
+genio::IBlockProfiler *genio::IBlockProfiler::Create(bool record_events, genio::IAllocator *alloc)
+{
+	return (genio::IBlockProfiler *)(AllocNew<CBlockProfiler>(alloc, record_events, alloc));
+}
+
+
+// ************************************************************************
+// Block Profiler Methods
+
+CBlockProfiler::CBlockProfiler(bool record_events, genio::IAllocator *alloc) :
+	m_Nodes(alloc),
+	m_Streams(alloc),
+	m_Events(alloc)
+{
+	m_Alloc = alloc;
+	InitializeSRWLock(&m_Lock);
+
+	m_RecordEvents = record_events;
+	m_NextTrack = 1;
+
+	Reset();
+}
+
+
+CBlockProfiler::~CBlockProfiler()
+{
+	while (!m_Streams.empty())
+		Detach(m_Streams.back().m_Stream);
+}
+
+
+void CBlockProfiler::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+void CBlockProfiler::Attach(genio::IStream *stream)
+{
+	if (!stream)
+		return;
+
+	AcquireSRWLockExclusive(&m_Lock);
+
+	bool found = false;
+	for (auto &st : m_Streams)
+	{
+		if (st.m_Stream == stream)
+		{
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		SStreamState st;
+		st.m_Stream = stream;
+		st.m_Track = m_NextTrack++;
+		m_Streams.push_back(st);
+	}
+
+	ReleaseSRWLockExclusive(&m_Lock);
+
+	stream->SetBlockCallback(BlockCallback, this);
+}
+
+
+void CBlockProfiler::Detach(genio::IStream *stream)
+{
+	if (!stream)
+		return;
+
+	AcquireSRWLockExclusive(&m_Lock);
+
+	for (auto it = m_Streams.begin(); it != m_Streams.end(); it++)
+	{
+		if (it->m_Stream == stream)
+		{
+			m_Streams.erase(it);
+			break;
+		}
+	}
+
+	ReleaseSRWLockExclusive(&m_Lock);
+
+	stream->SetBlockCallback(nullptr, nullptr);
+}
+
+
+void CBlockProfiler::Reset()
+{
+	AcquireSRWLockExclusive(&m_Lock);
+
+	m_Nodes.clear();
+
+	SPathNode root;
+	root.m_ID = genio::IStream::ENDBLOCKID;
+	root.m_Parent = ROOTNODE;
+	root.m_Count = 0;
+	root.m_Inclusive = 0;
+	root.m_Exclusive = 0;
+	m_Nodes.push_back(root);
+
+	for (auto &st : m_Streams)
+		st.m_Open.clear();
+
+	m_Events.clear();
+
+	ReleaseSRWLockExclusive(&m_Lock);
+}
+
+
+void CBlockProfiler::BlockCallback(const genio::SBlockEvent &ev, void *userdata)
+{
+	((CBlockProfiler *)userdata)->OnEvent(ev);
+}
+
+
+void CBlockProfiler::OnEvent(const genio::SBlockEvent &ev)
+{
+	AcquireSRWLockExclusive(&m_Lock);
+
+	SStreamState *st = nullptr;
+	for (auto &s : m_Streams)
+	{
+		if (s.m_Stream == ev.m_Stream)
+		{
+			st = &s;
+			break;
+		}
+	}
+
+	if (st)
+	{
+		if (ev.m_Type == genio::SBlockEvent::BE_BEGIN)
+		{
+			size_t parent = st->m_Open.empty() ? (size_t)ROOTNODE : st->m_Open.back().m_Node;
+
+			size_t node;
+			auto it = m_Nodes[parent].m_Children.find(ev.m_ID);
+			if (it == m_Nodes[parent].m_Children.end())
+			{
+				SPathNode n;
+				n.m_ID = ev.m_ID;
+				n.m_Parent = parent;
+				n.m_Count = 0;
+				n.m_Inclusive = 0;
+				n.m_Exclusive = 0;
+
+				node = m_Nodes.size();
+				m_Nodes.push_back(n);
+				m_Nodes[parent].m_Children.insert(std::make_pair(ev.m_ID, node));
+			}
+			else
+			{
+				node = it->second;
+			}
+
+			SOpenBlock ob;
+			ob.m_Node = node;
+			ob.m_Start = ev.m_Timestamp;
+			ob.m_ChildTime = 0;
+			st->m_Open.push_back(ob);
+		}
+		else if (!st->m_Open.empty())
+		{
+			SOpenBlock ob = st->m_Open.back();
+			st->m_Open.pop_back();
+
+			uint64_t inclusive = (ev.m_Timestamp > ob.m_Start) ? (ev.m_Timestamp - ob.m_Start) : 0;
+
+			SPathNode &n = m_Nodes[ob.m_Node];
+			n.m_Count++;
+			n.m_Inclusive += inclusive;
+			n.m_Exclusive += (inclusive > ob.m_ChildTime) ? (inclusive - ob.m_ChildTime) : 0;
+
+			// the parent's exclusive time doesn't include the time spent in this block
+			if (!st->m_Open.empty())
+				st->m_Open.back().m_ChildTime += inclusive;
+		}
+
+		if (m_RecordEvents)
+		{
+			SRecordedEvent re;
+			re.m_Type = ev.m_Type;
+			re.m_ID = ev.m_ID;
+			re.m_Track = st->m_Track;
+			re.m_Timestamp = ev.m_Timestamp;
+			re.m_Offset = ev.m_Offset;
+			re.m_Length = ev.m_Length;
+			m_Events.push_back(re);
+		}
+	}
+
+	ReleaseSRWLockExclusive(&m_Lock);
+}
+
+
+tstring CBlockProfiler::PathOf(size_t node) const
+{
+	tstring ret;
+
+	while (node != ROOTNODE)
+	{
+		TCHAR id[5];
+		FourCCToString(m_Nodes[node].m_ID, id);
+
+		ret = ret.empty() ? tstring(id) : (tstring(id) + _T("/") + ret);
+
+		node = m_Nodes[node].m_Parent;
+	}
+
+	return ret;
+}
+
+
+void CBlockProfiler::WriteReport(genio::ITextOutput *out)
+{
+	if (!out)
+		return;
+
+	AcquireSRWLockShared(&m_Lock);
+
+	TGenVector<size_t> order(m_Alloc);
+	order.reserve(m_Nodes.size());
+	for (size_t i = ROOTNODE + 1; i < m_Nodes.size(); i++)
+		order.push_back(i);
+
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		return m_Nodes[a].m_Inclusive > m_Nodes[b].m_Inclusive;
+	});
+
+	out->PrintF(_T("%-48s %12s %14s %14s"), _T("path"), _T("count"), _T("inclusive ms"), _T("exclusive ms"));
+	out->NextLine();
+
+	for (size_t i : order)
+	{
+		const SPathNode &n = m_Nodes[i];
+
+		out->PrintF(_T("%-48s %12llu %14.3f %14.3f"), PathOf(i).c_str(), n.m_Count,
+			(double)n.m_Inclusive / 1000000.0, (double)n.m_Exclusive / 1000000.0);
+		out->NextLine();
+	}
+
+	ReleaseSRWLockShared(&m_Lock);
+
+	out->Flush();
+}
+
+
+bool CBlockProfiler::WriteChromeTrace(const TCHAR *filename)
+{
+	if (!m_RecordEvents)
+		return false;
+
+	genio::ITextOutput *out = genio::ITextOutput::Create(filename);
+	if (!out)
+		return false;
+
+	AcquireSRWLockShared(&m_Lock);
+
+	uint64_t base = m_Events.empty() ? 0 : m_Events.front().m_Timestamp;
+
+	out->PrintF(_T("{ \"displayTimeUnit\": \"ns\", \"traceEvents\": ["));
+	out->IncIndent();
+
+	for (size_t i = 0; i < m_Events.size(); i++)
+	{
+		const SRecordedEvent &re = m_Events[i];
+
+		TCHAR id[5];
+		FourCCToString(re.m_ID, id);
+
+		// chrome wants timestamps in microseconds
+		out->NextLine();
+		out->PrintF(_T("{ \"name\": \"%s\", \"cat\": \"genio\", \"ph\": \"%s\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": { \"offset\": %llu, \"length\": %llu } }%s"),
+			id, (re.m_Type == genio::SBlockEvent::BE_BEGIN) ? _T("B") : _T("E"), (double)(re.m_Timestamp - base) / 1000.0,
+			re.m_Track, re.m_Offset, re.m_Length, (i < (m_Events.size() - 1)) ? _T(",") : _T(""));
+	}
+
+	ReleaseSRWLockShared(&m_Lock);
+
+	out->DecIndent();
+	out->NextLine();
+	out->PrintF(_T("] }"));
+	out->NextLine(0, false);
+
+	out->Release();
+
+	return true;
+}
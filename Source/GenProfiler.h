@@ -0,0 +1,118 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+
+
+// Implements the block profiler, a block callback sink that builds a tree of FOURCC paths
+
+
+class CBlockProfiler : public genio::IBlockProfiler
+{
+
+public:
+
+	CBlockProfiler(bool record_events, genio::IAllocator *alloc);
+	virtual ~CBlockProfiler();
+
+	virtual void Attach(genio::IStream *stream);
+	virtual void Detach(genio::IStream *stream);
+	virtual void Reset();
+	virtual void WriteReport(genio::ITextOutput *out);
+	virtual bool WriteChromeTrace(const TCHAR *filename);
+	virtual void Release();
+
+protected:
+	static void BlockCallback(const genio::SBlockEvent &ev, void *userdata);
+	void OnEvent(const genio::SBlockEvent &ev);
+
+	// Builds the "OBJ0/INF1" style path of the given node
+	tstring PathOf(size_t node) const;
+
+	enum
+	{
+		ROOTNODE = 0
+	};
+
+	// One node per unique path; node ROOTNODE stands for the top level of the stream(s)
+	struct SPathNode
+	{
+		genio::FOURCHARCODE m_ID;
+		size_t m_Parent;
+		uint64_t m_Count;
+		uint64_t m_Inclusive;		// nanoseconds
+		uint64_t m_Exclusive;		// nanoseconds
+		std::map<genio::FOURCHARCODE, size_t> m_Children;
+	};
+
+	struct SOpenBlock
+	{
+		size_t m_Node;
+		uint64_t m_Start;
+		uint64_t m_ChildTime;
+	};
+
+	// Each attached stream keeps its own stack of open blocks, and gets its own track in traces
+	struct SStreamState
+	{
+		genio::IStream *m_Stream;
+		uint32_t m_Track;
+		std::vector<SOpenBlock> m_Open;
+	};
+
+	struct SRecordedEvent
+	{
+		genio::SBlockEvent::EVENT_TYPE m_Type;
+		genio::FOURCHARCODE m_ID;
+		uint32_t m_Track;
+		uint64_t m_Timestamp;
+		uint64_t m_Offset;
+		uint64_t m_Length;
+	};
+
+	SRWLOCK m_Lock;
+
+	TGenVector<SPathNode> m_Nodes;
+	TGenVector<SStreamState> m_Streams;
+	uint32_t m_NextTrack;
+
+	bool m_RecordEvents;
+	TGenVector<SRecordedEvent> m_Events;
+
+	genio::IAllocator *m_Alloc;
+
+};
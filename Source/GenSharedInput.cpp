@@ -0,0 +1,105 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenSharedInput.h>
+#include <GenStreamIn.h>
+
+
+genio::ISharedInputFile *genio::ISharedInputFile::Create(const TCHAR *filename, genio::IAllocator *alloc)
+{
+	if (!filename)
+		return nullptr;
+
+	// Reads on a synchronous handle are serialized by the system, even at explicit offsets, so the cursors on
+	// different threads would wait on each other; overlapped, they really do read at the same time
+	HANDLE h = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	CSharedInputFile *ret = AllocNew<CSharedInputFile>(alloc, h, alloc);
+	if (!ret)
+		CloseHandle(h);
+
+	return (genio::ISharedInputFile *)ret;
+}
+
+
+// ************************************************************************
+// Shared Input File Methods
+
+CSharedInputFile::CSharedInputFile(HANDLE h, genio::IAllocator *alloc)
+{
+	m_hFile = h;
+	m_RefCount = 1;
+	m_Alloc = alloc;
+}
+
+
+CSharedInputFile::~CSharedInputFile()
+{
+	if (m_hFile)
+		CloseHandle(m_hFile);
+}
+
+
+void CSharedInputFile::Release()
+{
+	DecRef();
+}
+
+
+void CSharedInputFile::AddRef()
+{
+	InterlockedIncrement(&m_RefCount);
+}
+
+
+void CSharedInputFile::DecRef()
+{
+	if (!InterlockedDecrement(&m_RefCount))
+		AllocDelete(m_Alloc, this);
+}
+
+
+genio::IInputStream *CSharedInputFile::CreateCursor(genio::IAllocator *alloc)
+{
+	// the cursor doesn't own the handle, so closing it leaves the file open for the others
+	CInputStream *ret = AllocNew<CInputStream>(alloc, m_hFile, alloc);
+	if (!ret)
+		return nullptr;
+
+	ret->SetShared(this);
+	ret->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, 0);
+
+	return (genio::IInputStream *)ret;
+}
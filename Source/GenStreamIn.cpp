@@ -32,29 +32,120 @@
 
 #include "stdafx.h"
 #include <GenStreamIn.h>
+#include <GenStreamPool.h>
+#include <GenSharedInput.h>
 //#include <Crc.h>
 
 
-genio::IInputStream *genio::IInputStream::Create(HANDLE h)
+genio::IInputStream *genio::IInputStream::Create(HANDLE h, genio::IAllocator *alloc)
 {
-	return (genio::IInputStream *)(new CInputStream(h));
+	return (genio::IInputStream *)(AllocNew<CInputStream>(alloc, h, alloc));
 }
 
 
 // ************************************************************************
 // Input Stream Methods
 
-CInputStream::CInputStream()
+CInputStream::CInputStream(genio::IAllocator *alloc) :
+	m_BlockIndex(alloc),
+	m_BlockScanState(alloc),
+	m_CodecBuffer(alloc),
+	m_GatherBuffer(alloc),
+	m_ArrayScratch(alloc),
+	m_Filename(alloc),
+	m_Dictionary(alloc),
+	m_Decoded(alloc),
+	m_KeyIndex(alloc),
+	m_StreamBlockStack(alloc)
 {
+	m_Alloc = alloc;
 	m_OwnsFile = true;
 	m_hFile = NULL;
+	m_Pos = 0;
+	m_PeekPos = NOPEEK;
+	m_hMapping = NULL;
+	m_View = nullptr;
+	m_ViewSize = 0;
+	m_DictionaryLoaded = false;
+	m_DecodedStart = m_DecodedEnd = 0;
+	m_DecodedDepth = 0;
+	m_Committed = UNBOUNDED;
+	m_hChangeNotify = NULL;
+	m_KeyIndexLoaded = false;
+	m_ModeFlags = 0;
+	m_ChildDir.m_First = NOPARENT;
+	m_Pool = nullptr;
+	m_Shared = nullptr;
+	m_hReadEvent = NULL;
+
+	m_ChildDir.m_Bloom = TGenVector<uint8_t>(alloc);
+	m_ChildDir.m_Entries = TGenVector<SChildDirEntry>(alloc);
+
+	for (auto &win : m_ReadAhead)
+	{
+		win.m_Requested = 0;
+		win.m_Pending = false;
+		win.m_Work = NULL;
+		win.m_hEvent = NULL;
+		win.m_Data = TGenVector<uint8_t>(alloc);
+	}
+	m_ReadAheadStart = m_ReadAheadEnd = 0;
 }
 
 
-CInputStream::CInputStream(HANDLE h)
+CInputStream::CInputStream(HANDLE h, genio::IAllocator *alloc) :
+	m_BlockIndex(alloc),
+	m_BlockScanState(alloc),
+	m_CodecBuffer(alloc),
+	m_GatherBuffer(alloc),
+	m_ArrayScratch(alloc),
+	m_Filename(alloc),
+	m_Dictionary(alloc),
+	m_Decoded(alloc),
+	m_KeyIndex(alloc),
+	m_StreamBlockStack(alloc)
 {
+	m_Alloc = alloc;
 	m_hFile = h;
 	m_OwnsFile = (m_hFile == NULL) ? true : false;
+	m_Pos = 0;
+	m_PeekPos = NOPEEK;
+	m_hMapping = NULL;
+	m_View = nullptr;
+	m_ViewSize = 0;
+	m_DictionaryLoaded = false;
+	m_DecodedStart = m_DecodedEnd = 0;
+	m_DecodedDepth = 0;
+	m_Committed = UNBOUNDED;
+	m_hChangeNotify = NULL;
+	m_KeyIndexLoaded = false;
+	m_ModeFlags = 0;
+	m_ChildDir.m_First = NOPARENT;
+	m_Pool = nullptr;
+	m_Shared = nullptr;
+	m_hReadEvent = NULL;
+
+	m_ChildDir.m_Bloom = TGenVector<uint8_t>(alloc);
+	m_ChildDir.m_Entries = TGenVector<SChildDirEntry>(alloc);
+
+	for (auto &win : m_ReadAhead)
+	{
+		win.m_Requested = 0;
+		win.m_Pending = false;
+		win.m_Work = NULL;
+		win.m_hEvent = NULL;
+		win.m_Data = TGenVector<uint8_t>(alloc);
+	}
+	m_ReadAheadStart = m_ReadAheadEnd = 0;
+
+	// Start wherever the handle's owner left it
+	if (m_hFile)
+	{
+		LARGE_INTEGER z, cur;
+		z.QuadPart = 0;
+		if (SetFilePointerEx(m_hFile, z, &cur, FILE_CURRENT))
+			m_Pos = (uint64_t)cur.QuadPart;
+	}
 
 	if (!m_hFile)
 	{
@@ -68,12 +159,55 @@ CInputStream::CInputStream(HANDLE h)
 CInputStream::~CInputStream()
 {
 	Close();
+
+	for (auto &win : m_ReadAhead)
+	{
+		if (win.m_Work)
+			CloseThreadpoolWork(win.m_Work);
+
+		if (win.m_hEvent)
+			CloseHandle(win.m_hEvent);
+	}
+
+	if (m_hReadEvent)
+		CloseHandle(m_hReadEvent);
+
+	if (m_Shared)
+		m_Shared->DecRef();
+}
+
+
+void CInputStream::SetShared(CSharedInputFile *shared)
+{
+	if (shared)
+		shared->AddRef();
+
+	if (m_Shared)
+		m_Shared->DecRef();
+
+	m_Shared = shared;
+
+	// The shared handle is opened for overlapped I/O, so reads on it have to wait for themselves
+	if (m_Shared && !m_hReadEvent)
+		m_hReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 }
 
 
 void CInputStream::Release()
 {
-	delete this;
+	if (m_Pool)
+	{
+		Close();
+
+		m_Stats.Reset();
+		m_ModeFlags = 0;
+		m_BlockHook.Set(nullptr, nullptr);
+
+		m_Pool->Return(this);
+		return;
+	}
+
+	AllocDelete(m_Alloc, this);
 }
 
 
@@ -93,8 +227,27 @@ bool CInputStream::Open()
 	{
 		Close();
 
-		m_hFile = CreateFile(m_Filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		DWORD flags = (m_ModeFlags & STRMMODE_SEQUENTIALSCAN) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+
+		// In SWMR, the writer still has the file open
+		DWORD share = (m_ModeFlags & STRMMODE_SWMR) ? (FILE_SHARE_READ | FILE_SHARE_WRITE) : FILE_SHARE_READ;
+
+		m_hFile = CreateFile(m_Filename.c_str(), GENERIC_READ, share, NULL, OPEN_EXISTING, flags, NULL);
 		m_OwnsFile = true;
+		m_Pos = 0;
+		m_PeekPos = NOPEEK;
+
+		// if the file can't be mapped, it's just read the usual way
+		if (m_ModeFlags & STRMMODE_MAPPED)
+			MapFile();
+
+		// Readers start after the SWMR block, which only the stream needs to see
+		if (m_ModeFlags & STRMMODE_SWMR)
+		{
+			m_Committed = 0;
+			if (ReadCommitMarker())
+				m_Pos = sizeof(SSWMRHeader);
+		}
 	}
 
 	return (m_hFile != NULL);
@@ -106,11 +259,36 @@ void CInputStream::Close()
 	if (!m_hFile)
 		return;
 
+	DropReadAhead();
+
+	UnmapFile();
+
 	if (m_OwnsFile)
 		CloseHandle(m_hFile);
 
 	m_hFile = NULL;
 	m_OwnsFile = false;
+
+	m_StreamBlockStack.clear();
+
+	DropDecodedBlock();
+	m_Dictionary.clear();
+	m_DictionaryLoaded = false;
+
+	m_BlockIndex.clear();
+	m_BlockScanState.clear();
+	m_ChildDir.m_First = NOPARENT;
+	m_PeekPos = NOPEEK;
+
+	m_KeyIndex.clear();
+	m_KeyIndexLoaded = false;
+
+	m_Committed = UNBOUNDED;
+
+	if (m_hChangeNotify)
+		FindCloseChangeNotification(m_hChangeNotify);
+
+	m_hChangeNotify = NULL;
 }
 
 
@@ -133,9 +311,7 @@ size_t CInputStream::Read(void *data, size_t size, size_t number)
 
 		// fread returns the number of BLOCKS written, not the number of bytes, so
 		// we have to fix up this number by multiplying it by size
-		DWORD nread = 0;
-		ReadFile(m_hFile, data, DWORD(size * number), &nread, NULL);
-		ret = nread;
+		ret = OSRead(data, DWORD(size * number));
 
 		if (!m_StreamBlockStack.empty())
 		{
@@ -158,115 +334,1516 @@ size_t CInputStream::Read(void *data, size_t size, size_t number)
 }
 
 
-void CInputStream::Seek(genio::IStream::SEEK_MODE mode, int64_t count)
+size_t CInputStream::ReadV(const genio::SIOSegment *segments, size_t count)
 {
-	if (m_hFile)
+	if (!m_hFile || !segments)
+		return 0;
+
+	size_t ret = 0;
+
+	// small segments are collected in [first, i) until they fill the gather buffer or a large one turns up
+	size_t first = 0, total = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const genio::SIOSegment &s = segments[i];
+
+		if (s.m_Length >= IOV_DIRECTTHRESHOLD)
+		{
+			if (total)
+			{
+				size_t n = ReadGathered(segments, first, i, total);
+				ret += n;
+				if (n < total)
+					return ret;
+			}
+
+			size_t n = OSReadAll(s.m_Data, s.m_Length);
+			ret += n;
+			if (n < s.m_Length)
+				return ret;
+
+			first = i + 1;
+			total = 0;
+			continue;
+		}
+
+		if ((total + s.m_Length) > IOV_GATHERSIZE)
+		{
+			size_t n = ReadGathered(segments, first, i, total);
+			ret += n;
+			if (n < total)
+				return ret;
+
+			first = i;
+			total = 0;
+		}
+
+		total += s.m_Length;
+	}
+
+	if (total)
+		ret += ReadGathered(segments, first, count, total);
+
+	return ret;
+}
+
+
+size_t CInputStream::ReadAt(uint64_t offset, void *data, size_t len)
+{
+	if (!m_hFile || !data || m_StreamBlockStack.empty())
+		return 0;
+
+	const SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+	if (offset >= sbe.m_Info.m_Length)
+		return 0;
+
+	len = (size_t)std::min<uint64_t>(len, sbe.m_Info.m_Length - offset);
+
+	// reads are made at m_Pos, so point it at the range just for this
+	uint64_t pos = m_Pos;
+	m_Pos = sbe.m_BlockStart + offset;
+
+	size_t ret = OSReadAll(data, len);
+
+	m_Pos = pos;
+
+	return ret;
+}
+
+
+uint64_t CInputStream::SkipInBlock(uint64_t count)
+{
+	if (!m_hFile || m_StreamBlockStack.empty())
+		return 0;
+
+	const SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+
+	uint64_t end = sbe.m_BlockStart + sbe.m_Info.m_Length;
+	if (m_Pos >= end)
+		return 0;
+
+	count = std::min<uint64_t>(count, end - m_Pos);
+
+	Seek(genio::IStream::SEEK_MODE::SM_CURRENT, (int64_t)count);
+
+	return count;
+}
+
+
+size_t CInputStream::ReadGathered(const genio::SIOSegment *segments, size_t first, size_t end, size_t total)
+{
+	m_GatherBuffer.resize(total);
+
+	size_t n = OSReadAll(m_GatherBuffer.data(), total);
+
+	// hand out whatever was actually read
+	const uint8_t *p = m_GatherBuffer.data();
+	size_t left = n;
+	for (size_t i = first; (i < end) && left; i++)
+	{
+		size_t len = std::min(segments[i].m_Length, left);
+		memcpy(segments[i].m_Data, p, len);
+
+		p += len;
+		left -= len;
+	}
+
+	return n;
+}
+
+
+size_t CInputStream::OSReadAll(void *data, size_t size)
+{
+	size_t ret = 0;
+
+	while (ret < size)
 	{
-		LARGE_INTEGER i;
-		i.QuadPart = count;
-		SetFilePointer(m_hFile, i.LowPart, &i.HighPart, mode);
+		DWORD n = OSRead((uint8_t *)data + ret, (DWORD)std::min<size_t>(size - ret, IOV_MAXCALLSIZE));
+		if (!n)
+			break;
+
+		ret += n;
 	}
+
+	return ret;
+}
+
+
+void CInputStream::Seek(genio::IStream::SEEK_MODE mode, int64_t count)
+{
+	if (m_hFile)
+		OSSeek(mode, count);
 }
 
 
 size_t CInputStream::Pos() const
 {
 	if (m_hFile)
+		return OSTell();
+
+	return 0;
+}
+
+
+// Reads at the given offset, which the OVERLAPPED carries, so the handle's file pointer is never used. On a handle
+// opened for overlapped I/O, the read may still be going when ReadFile returns; it's waited for on the event given,
+// which must be the caller's own, since the handle is signaled when any read on it finishes
+static DWORD ReadFileAt(HANDLE h, void *data, DWORD size, uint64_t offset, HANDLE event)
+{
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(OVERLAPPED));
+	ov.Offset = (DWORD)offset;
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	ov.hEvent = event;
+
+	DWORD n = 0;
+	if (!ReadFile(h, data, size, &n, &ov))
 	{
-		LARGE_INTEGER z;
-		z.QuadPart = 0;
+		if (!event || (GetLastError() != ERROR_IO_PENDING) || !GetOverlappedResult(h, &ov, &n, TRUE))
+			n = 0;
+	}
+
+	return n;
+}
+
+
+DWORD CInputStream::OSRead(void *data, DWORD size)
+{
+	if (m_DecodedDepth && (m_Pos >= m_DecodedStart) && ((m_Pos - m_DecodedStart) < m_Decoded.size()))
+	{
+		size_t at = (size_t)(m_Pos - m_DecodedStart);
+
+		DWORD n = (DWORD)std::min<size_t>(size, m_Decoded.size() - at);
+		memcpy(data, m_Decoded.data() + at, n);
 
-		LARGE_INTEGER ret;
-		if (SetFilePointerEx(m_hFile, z, &ret, FILE_CURRENT))
-			return (size_t)ret.QuadPart;
+		m_Pos += n;
+
+		return n;
 	}
 
-	return 0;
+	if (m_View)
+	{
+		DWORD n = (m_Pos < m_ViewSize) ? (DWORD)std::min<uint64_t>(size, m_ViewSize - m_Pos) : 0;
+		memcpy(data, m_View + m_Pos, n);
+
+		m_Pos += n;
+
+		return n;
+	}
+
+	DWORD ret = 0;
+	if (m_ReadAheadEnd)
+	{
+		ret = ReadFromWindows(data, size);
+		if (ret == size)
+			return ret;
+
+		data = (uint8_t *)data + ret;
+		size -= ret;
+	}
+
+	CStreamStatsTimer t(m_Stats);
+
+	DWORD nread = ReadFileAt(m_hFile, data, size, m_Pos, m_hReadEvent);
+
+	m_Pos += nread;
+
+	m_Stats.OnRead(nread);
+
+	return ret + nread;
 }
 
 
-bool CInputStream::CanAccess() const
+void CALLBACK CInputStream::ReadAheadCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work)
 {
-	return (m_hFile != NULL);
+	SReadAheadWindow *win = (SReadAheadWindow *)context;
+
+	size_t got = 0;
+	while (got < win->m_Requested)
+	{
+		uint64_t pos = win->m_Start + got;
+
+		DWORD n = ReadFileAt(win->m_hFile, win->m_Data.data() + got, (DWORD)std::min<size_t>(win->m_Requested - got, IOV_MAXCALLSIZE), pos, win->m_hEvent);
+		if (!n)
+			break;
+
+		got += n;
+	}
+
+	win->m_Valid = got;
 }
 
 
-uint32_t CInputStream::NextBlockId()
+void CInputStream::BeginReadAhead(uint64_t start, uint64_t end)
 {
-	if (m_hFile)
+	// A block inside the one that's already being read ahead is read ahead as part of it
+	if ((start < m_ReadAheadStart) || (end > m_ReadAheadEnd))
 	{
-		genio::FOURCHARCODE tmpid;
-		DWORD nread = 0;
-		ReadFile(m_hFile, &tmpid, sizeof(genio::FOURCHARCODE), &nread, NULL);
+		DropReadAhead();
+
+		m_ReadAheadStart = start;
+		m_ReadAheadEnd = end;
+	}
+
+	RestartReadAhead(start);
+}
+
+
+void CInputStream::RestartReadAhead(uint64_t offset)
+{
+	if (FindWindow(offset))
+		return;
+
+	WaitWindow(m_ReadAhead[0], true);
+	WaitWindow(m_ReadAhead[1], true);
+
+	IssueWindow(m_ReadAhead[0], offset);
+}
+
+
+void CInputStream::DropReadAhead()
+{
+	WaitWindow(m_ReadAhead[0], true);
+	WaitWindow(m_ReadAhead[1], true);
+
+	m_ReadAheadStart = m_ReadAheadEnd = 0;
+}
+
+
+void CInputStream::IssueWindow(SReadAheadWindow &win, uint64_t offset)
+{
+	if (offset >= m_ReadAheadEnd)
+		return;
+
+	if (win.m_Requested && (win.m_Start == offset))
+		return;
 
-		// Go back the size of one uint32_t...
-		Seek(genio::IStream::SEEK_MODE::SM_CURRENT, -((int64_t)sizeof(genio::FOURCHARCODE)));
+	WaitWindow(win, true);
 
-		return ntohl(tmpid);
+	if (!win.m_Work)
+	{
+		win.m_Work = CreateThreadpoolWork(ReadAheadCallback, &win, NULL);
+		if (!win.m_Work)
+			return;
 	}
 
-	return 0;
+	// the window is filled on another thread, so it can't wait on the stream's own event
+	if (m_hReadEvent && !win.m_hEvent)
+	{
+		win.m_hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (!win.m_hEvent)
+			return;
+	}
+
+	win.m_hFile = m_hFile;
+	win.m_Start = offset;
+	win.m_Requested = (size_t)std::min<uint64_t>(m_ReadAheadEnd - offset, READAHEAD_WINDOWSIZE);
+	win.m_Valid = 0;
+	win.m_Data.resize(win.m_Requested);
+
+	win.m_Pending = true;
+	SubmitThreadpoolWork(win.m_Work);
 }
 
 
-size_t CInputStream::NextBlockSize()
+void CInputStream::WaitWindow(SReadAheadWindow &win, bool cancel)
 {
-	if (m_hFile)
+	if (win.m_Pending)
 	{
-		SStreamBlockEntry ssbe;
-		DWORD nread = 0;
-		ReadFile(m_hFile, &ssbe, sizeof(SStreamBlockEntry), &nread, NULL);
+		CStreamStatsTimer t(m_Stats);
 
-		// Go back the size of one uint32_t...
-		Seek(genio::IStream::SEEK_MODE::SM_CURRENT, -((int64_t)sizeof(SStreamBlockEntry)));
+		// cancelling only stops a read that hasn't started yet; one that has is waited for
+		WaitForThreadpoolWorkCallbacks(win.m_Work, cancel ? TRUE : FALSE);
+		win.m_Pending = false;
 
-		return ssbe.m_Info.m_Length;
+		m_Stats.OnRead(win.m_Valid);
 	}
 
-	return 0;
+	if (cancel)
+		win.m_Requested = 0;
 }
 
 
-bool CInputStream::BeginBlock(genio::FOURCHARCODE id)
+CInputStream::SReadAheadWindow *CInputStream::FindWindow(uint64_t offset)
 {
-	if (m_hFile)
+	for (auto &win : m_ReadAhead)
 	{
-		SStreamBlockEntry sbe;
+		if (win.m_Requested && (offset >= win.m_Start) && (offset < (win.m_Start + win.m_Requested)))
+			return &win;
+	}
 
-		DWORD nread = 0;
-		ReadFile(m_hFile, &sbe.m_Info, sizeof(SStreamBlockInfo), &nread, NULL);
-		if (nread != sizeof(SStreamBlockInfo))
-			return false;
+	return nullptr;
+}
 
-		sbe.m_Info.m_ID = ntohl(sbe.m_Info.m_ID);
 
-		if (sbe.m_Info.m_ID == id)
-		{
-			sbe.m_BlockStart = Pos();
+DWORD CInputStream::ReadFromWindows(void *data, DWORD size)
+{
+	DWORD ret = 0;
 
-			//sbe.m_RunningCrc = CRC32_INITVALUE;
+	while (ret < size)
+	{
+		SReadAheadWindow *win = FindWindow(m_Pos);
+		if (!win)
+			break;
 
-			m_StreamBlockStack.push_back(sbe);
+		WaitWindow(*win, false);
 
-			return true;
-		}
+		// start filling the other window with what comes after this one while this one is consumed
+		IssueWindow(m_ReadAhead[(win == &m_ReadAhead[0]) ? 1 : 0], win->m_Start + win->m_Requested);
+
+		size_t ofs = (size_t)(m_Pos - win->m_Start);
+		if (ofs >= win->m_Valid)
+			break;
 
-		this->Seek(genio::IStream::SEEK_MODE::SM_CURRENT, -((int64_t)sizeof(SStreamBlockInfo)));
+		DWORD n = (DWORD)std::min<size_t>(size - ret, win->m_Valid - ofs);
+		memcpy((uint8_t *)data + ret, win->m_Data.data() + ofs, n);
+
+		m_Pos += n;
+		ret += n;
 	}
 
-	return false;
+	return ret;
 }
 
 
-void CInputStream::EndBlock()
+void CInputStream::OSSeek(genio::IStream::SEEK_MODE mode, int64_t count)
 {
-	if (m_hFile)
+	switch (mode)
 	{
-		SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+		case genio::IStream::SEEK_MODE::SM_BEGIN:
+			m_Pos = (uint64_t)count;
+			break;
 
-		Seek(genio::IStream::SEEK_MODE::SM_BEGIN, sbe.m_BlockStart + sbe.m_Info.m_Length);
+		case genio::IStream::SEEK_MODE::SM_CURRENT:
+			m_Pos = (uint64_t)((int64_t)m_Pos + count);
+			break;
 
-		m_StreamBlockStack.pop_back();
+		case genio::IStream::SEEK_MODE::SM_END:
+		{
+			// in SWMR, the stream ends at the last commit
+			if (m_Committed != UNBOUNDED)
+			{
+				m_Pos = (uint64_t)((int64_t)m_Committed + count);
+				break;
+			}
+
+			CStreamStatsTimer t(m_Stats);
+
+			LARGE_INTEGER size;
+			if (GetFileSizeEx(m_hFile, &size))
+				m_Pos = (uint64_t)(size.QuadPart + count);
+
+			m_Stats.OnSeek();
+			break;
+		}
+	}
+}
+
+
+size_t CInputStream::OSTell() const
+{
+	return (size_t)m_Pos;
+}
+
+
+bool CInputStream::GetStats(genio::SStreamStats &stats) const
+{
+	return m_Stats.Get(stats);
+}
+
+
+void CInputStream::ResetStats()
+{
+	m_Stats.Reset();
+}
+
+
+void CInputStream::SetModeFlags(uint64_t flags)
+{
+	if (!(flags & STRMMODE_READAHEAD))
+		DropReadAhead();
+
+	m_ModeFlags = flags;
+}
+
+
+uint64_t CInputStream::GetModeFlags() const
+{
+	return m_ModeFlags;
+}
+
+
+void CInputStream::SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata)
+{
+	m_BlockHook.Set(func, userdata);
+}
+
+
+bool CInputStream::CanAccess() const
+{
+	return (m_hFile != NULL);
+}
+
+
+DWORD CInputStream::PeekHeader(SStreamBlockInfo &info)
+{
+	if (m_PeekPos == m_Pos)
+	{
+		info = m_PeekInfo;
+		return sizeof(SStreamBlockInfo);
+	}
+
+	// In SWMR, the top-level blocks after the last commit may not be finished
+	if (m_StreamBlockStack.empty() && (m_Pos >= m_Committed))
+		return 0;
+
+	DWORD n = OSRead(&info, sizeof(SStreamBlockInfo));
+
+	// Go back to the header; only as far as we got, in case this was the end of the file
+	Seek(genio::IStream::SEEK_MODE::SM_CURRENT, -((int64_t)n));
+
+	if (n == sizeof(SStreamBlockInfo))
+	{
+		m_PeekInfo = info;
+		m_PeekPos = m_Pos;
+	}
+
+	return n;
+}
+
+
+uint32_t CInputStream::NextBlockId()
+{
+	if (m_hFile)
+	{
+		SStreamBlockInfo info;
+		if (PeekHeader(info) < sizeof(genio::FOURCHARCODE))
+			return 0;
+
+		return ntohl(info.m_ID);
+	}
+
+	return 0;
+}
+
+
+size_t CInputStream::NextBlockSize()
+{
+	if (m_hFile)
+	{
+		SStreamBlockInfo info;
+		return (PeekHeader(info) == sizeof(SStreamBlockInfo)) ? info.m_Length : 0;
+	}
+
+	return 0;
+}
+
+
+bool CInputStream::ReadHeaderAt(uint64_t offset, SStreamBlockInfo &info)
+{
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)offset);
+
+	if (OSRead(&info, sizeof(SStreamBlockInfo)) != sizeof(SStreamBlockInfo))
+		return false;
+
+	info.m_ID = ntohl(info.m_ID);
+
+	return true;
+}
+
+
+bool CInputStream::LoadChildDirectory(uint64_t first, uint64_t end)
+{
+	if (m_ChildDir.m_First == first)
+		return m_ChildDir.m_Present;
+
+	m_ChildDir.m_First = first;
+	m_ChildDir.m_Present = false;
+	m_ChildDir.m_Bloom.clear();
+	m_ChildDir.m_Entries.clear();
+	m_ChildDir.m_EntriesLoaded = false;
+
+	SChildDirTrailer &cdt = m_ChildDir.m_Trailer;
+
+	if ((end - first) < (sizeof(SStreamBlockInfo) + sizeof(SChildDirTrailer)))
+		return false;
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)(end - sizeof(SChildDirTrailer)));
+	if ((OSRead(&cdt, sizeof(SChildDirTrailer)) != sizeof(SChildDirTrailer)) || (cdt.m_Magic != CHILDDIRECTORYID) || (cdt.m_BloomBits & 7))
+		return false;
+
+	uint64_t dirlen = (cdt.m_BloomBits / 8) + ((uint64_t)cdt.m_Count * sizeof(SChildDirEntry)) + sizeof(SChildDirTrailer);
+	if ((end - first) < (dirlen + sizeof(SStreamBlockInfo)))
+		return false;
+
+	// Read the directory's header and bloom filter together; the header has to agree with the trailer,
+	// otherwise this is just a block whose data happens to end with something that looks like one
+	TGenVector<uint8_t> buf(sizeof(SStreamBlockInfo) + (cdt.m_BloomBits / 8), 0, m_Alloc);
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)(end - dirlen - sizeof(SStreamBlockInfo)));
+	if (OSRead(buf.data(), (DWORD)buf.size()) != buf.size())
+		return false;
+
+	SStreamBlockInfo *info = (SStreamBlockInfo *)buf.data();
+	if ((ntohl(info->m_ID) != CHILDDIRECTORYID) || (info->m_Length != dirlen))
+		return false;
+
+	m_ChildDir.m_Bloom.assign(buf.begin() + sizeof(SStreamBlockInfo), buf.end());
+	m_ChildDir.m_Present = true;
+
+	return true;
+}
+
+
+bool CInputStream::ResolveChild(uint64_t parent, uint64_t first, uint64_t end, genio::FOURCHARCODE id, uint32_t occurrence, SBlockIndexEntry &entry)
+{
+	SBlockIndexKey key = { parent, id, occurrence };
+
+	auto it = m_BlockIndex.find(key);
+	if (it != m_BlockIndex.end())
+	{
+		entry = it->second;
+		return true;
+	}
+
+	// The top level has no end, so it can't have a directory
+	if ((end != UNBOUNDED) && LoadChildDirectory(first, end))
+	{
+		SChildDirTrailer &cdt = m_ChildDir.m_Trailer;
+
+		if (!SChildDirBloom::MayContain(m_ChildDir.m_Bloom.data(), cdt.m_BloomBits, id))
+			return false;
+
+		if (!m_ChildDir.m_EntriesLoaded)
+		{
+			m_ChildDir.m_Entries.resize(cdt.m_Count);
+
+			DWORD entlen = (DWORD)(cdt.m_Count * sizeof(SChildDirEntry));
+			OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)(end - sizeof(SChildDirTrailer) - entlen));
+			if (OSRead(m_ChildDir.m_Entries.data(), entlen) != entlen)
+			{
+				m_ChildDir.m_First = NOPARENT;
+				return false;
+			}
+
+			m_ChildDir.m_EntriesLoaded = true;
+		}
+
+		auto eit = std::lower_bound(m_ChildDir.m_Entries.begin(), m_ChildDir.m_Entries.end(), id, [](const SChildDirEntry &e, genio::FOURCHARCODE i)
+		{
+			return e.m_ID < i;
+		});
+
+		if ((size_t)(m_ChildDir.m_Entries.end() - eit) <= occurrence)
+			return false;
+
+		eit += occurrence;
+		if (eit->m_ID != id)
+			return false;
+
+		SStreamBlockInfo info;
+		if (!ReadHeaderAt(first + eit->m_Offset, info) || (info.m_ID != id))
+			return false;
+
+		SBlockIndexEntry e = { first + eit->m_Offset, info };
+		m_BlockIndex.insert(std::make_pair(key, e));
+
+		entry = e;
+		return true;
+	}
+
+	auto sit = m_BlockScanState.find(parent);
+	if (sit == m_BlockScanState.end())
+	{
+		SBlockScanState ss(m_Alloc);
+		ss.m_Next = first;
+		ss.m_Done = false;
+		sit = m_BlockScanState.insert(std::make_pair(parent, ss)).first;
+	}
+
+	SBlockScanState &ss = sit->second;
+
+	// Pick up the scan of this parent's children where the last one left off, indexing everything we pass
+	while (!ss.m_Done)
+	{
+		// in SWMR, the top level ends at the last commit until Refresh finds more
+		if ((parent == NOPARENT) && (ss.m_Next >= m_Committed))
+		{
+			ss.m_Done = true;
+			break;
+		}
+
+		SStreamBlockInfo info;
+		if (((end != UNBOUNDED) && ((ss.m_Next + sizeof(SStreamBlockInfo)) > end)) || !ReadHeaderAt(ss.m_Next, info))
+		{
+			ss.m_Done = true;
+			break;
+		}
+
+		uint64_t next = ss.m_Next + sizeof(SStreamBlockInfo) + info.m_Length;
+
+		// A child that claims to extend past its parent means the data is damaged; stop here
+		if ((end != UNBOUNDED) && (next > end))
+		{
+			ss.m_Done = true;
+			break;
+		}
+
+		SBlockIndexKey k = { parent, info.m_ID, ss.m_Counts[info.m_ID]++ };
+		SBlockIndexEntry e = { ss.m_Next, info };
+		m_BlockIndex.insert(std::make_pair(k, e));
+
+		ss.m_Next = next;
+
+		if ((k.m_ID == id) && (k.m_Occurrence == occurrence))
+		{
+			entry = e;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool CInputStream::Find(const TCHAR *path)
+{
+	if (!m_hFile || !path)
+		return false;
+
+	size_t startpos = Pos();
+
+	// Headers have to come from the file, not from a block that's been decompressed
+	size_t decoded = m_DecodedDepth;
+	m_DecodedDepth = 0;
+
+	TStreamBlockStack ancestors(m_Alloc);
+
+	uint64_t parent = NOPARENT, first = 0, end = UNBOUNDED;
+	SBlockIndexEntry e;
+	bool found = false;
+
+	const TCHAR *p = path;
+	if (*p == _T('/'))
+		p++;
+
+	while (*p)
+	{
+		genio::FOURCHARCODE id;
+		size_t len = StringToFourCC(p, _T("/["), id);
+		if (!len)
+			break;
+
+		p += len;
+
+		uint32_t occurrence = 0;
+		if (*p == _T('['))
+		{
+			TCHAR *close;
+			occurrence = (uint32_t)_tcstoul(p + 1, &close, 10);
+			if (*close != _T(']'))
+				break;
+
+			p = close + 1;
+		}
+
+		// The block found by the previous segment becomes the parent of this one
+		if (found)
+		{
+			SStreamBlockEntry sbe;
+			sbe.m_Info = e.m_Info;
+			sbe.m_BlockStart = (size_t)(e.m_Header + sizeof(SStreamBlockInfo));
+			ancestors.push_back(sbe);
+
+			parent = e.m_Header;
+			first = sbe.m_BlockStart;
+			end = first + e.m_Info.m_Length;
+		}
+
+		found = ResolveChild(parent, first, end, id, occurrence, e);
+		if (!found)
+			break;
+
+		if (*p == _T('/'))
+			p++;
+	}
+
+	if (!found || *p)
+	{
+		m_DecodedDepth = decoded;
+
+		Seek(genio::IStream::SEEK_MODE::SM_BEGIN, startpos);
+		return false;
+	}
+
+	// Abandon whatever blocks were open and enter the ancestors of the block that was found
+	AbandonBlocks();
+
+	for (auto &sbe : ancestors)
+	{
+		m_StreamBlockStack.push_back(sbe);
+		m_BlockHook.Fire(genio::SBlockEvent::BE_BEGIN, this, sbe.m_Info.m_ID, m_StreamBlockStack.size(), sbe.m_BlockStart, sbe.m_Info.m_Length);
+	}
+
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, e.m_Header);
+
+	return true;
+}
+
+
+void CInputStream::AbandonBlocks()
+{
+	DropDecodedBlock();
+
+	while (!m_StreamBlockStack.empty())
+	{
+		SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+		m_BlockHook.Fire(genio::SBlockEvent::BE_END, this, sbe.m_Info.m_ID, m_StreamBlockStack.size(), sbe.m_BlockStart, sbe.m_Info.m_Length);
+		m_StreamBlockStack.pop_back();
+	}
+}
+
+
+bool CInputStream::LoadKeyIndex()
+{
+	m_KeyIndexLoaded = true;
+	m_KeyIndex.clear();
+
+	uint64_t pos = m_Pos;
+
+	// The index has to come from the file, not from a block that's been decompressed
+	size_t decoded = m_DecodedDepth;
+	m_DecodedDepth = 0;
+
+	// It's the last thing in the file (or, in SWMR, the last thing committed)
+	OSSeek(genio::IStream::SEEK_MODE::SM_END, 0);
+	uint64_t end = m_Pos;
+
+	// One read of the end of the file gets the trailer, and usually the rest of the index with it
+	size_t tail = (size_t)std::min<uint64_t>(end, KEYINDEX_TAILREAD);
+
+	TGenVector<uint8_t> buf(m_Alloc);
+	buf.resize(tail);
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)(end - tail));
+	bool ok = (tail >= (sizeof(SStreamBlockInfo) + sizeof(SKeyIndexTrailer))) && (OSReadAll(buf.data(), tail) == tail);
+
+	SKeyIndexTrailer &kit = m_KeyIndexTrailer;
+	uint64_t entlen = 0;
+
+	if (ok)
+	{
+		memcpy(&kit, buf.data() + tail - sizeof(SKeyIndexTrailer), sizeof(SKeyIndexTrailer));
+
+		ok = (kit.m_Magic == KEYINDEXID) && kit.m_Count &&
+			(kit.m_Count <= ((end - sizeof(SStreamBlockInfo) - sizeof(SKeyIndexTrailer)) / sizeof(SKeyIndexEntry)));
+
+		entlen = kit.m_Count * sizeof(SKeyIndexEntry);
+	}
+
+	SStreamBlockInfo info;
+	uint64_t total = sizeof(SStreamBlockInfo) + entlen + sizeof(SKeyIndexTrailer);
+
+	if (ok && (total <= tail))
+	{
+		const uint8_t *p = buf.data() + tail - total;
+
+		memcpy(&info, p, sizeof(SStreamBlockInfo));
+		info.m_ID = ntohl(info.m_ID);
+
+		ok = (info.m_ID == KEYINDEXID) && (info.m_Length == (entlen + sizeof(SKeyIndexTrailer)));
+		if (ok)
+		{
+			m_KeyIndex.resize((size_t)kit.m_Count);
+			memcpy(m_KeyIndex.data(), p + sizeof(SStreamBlockInfo), (size_t)entlen);
+		}
+	}
+	else if (ok)
+	{
+		ok = ReadHeaderAt(end - total, info) && (info.m_ID == KEYINDEXID) && (info.m_Length == (entlen + sizeof(SKeyIndexTrailer)));
+		if (ok)
+		{
+			m_KeyIndex.resize((size_t)kit.m_Count);
+			ok = (OSReadAll(m_KeyIndex.data(), (size_t)entlen) == entlen);
+		}
+	}
+
+	if (!ok)
+		m_KeyIndex.clear();
+
+	m_DecodedDepth = decoded;
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)pos);
+
+	return ok;
+}
+
+
+bool CInputStream::FindByKey(uint64_t key)
+{
+	if (!m_hFile)
+		return false;
+
+	if (!m_KeyIndexLoaded)
+		LoadKeyIndex();
+
+	if (m_KeyIndex.empty())
+		return false;
+
+	// Only the entries within the index's error of where its line puts the key need searching; every entry with
+	// the key is in there, since they're all put in the same place
+	const SKeyIndexTrailer &kit = m_KeyIndexTrailer;
+
+	uint64_t p = PredictKeyIndex(kit, key);
+	uint64_t err = std::min<uint64_t>(kit.m_MaxError, kit.m_Count);
+
+	auto first = m_KeyIndex.begin() + (size_t)((p > err) ? (p - err) : 0);
+	auto last = m_KeyIndex.begin() + (size_t)std::min<uint64_t>(p + err + 1, kit.m_Count);
+
+	auto it = std::lower_bound(first, last, key, [](const SKeyIndexEntry &e, uint64_t k)
+	{
+		return e.m_Key < k;
+	});
+
+	if ((it == last) || (it->m_Key != key))
+		return false;
+
+	AbandonBlocks();
+
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)it->m_Offset);
+
+	return true;
+}
+
+
+size_t CInputStream::NextArrayCount()
+{
+	if (!m_hFile)
+		return 0;
+
+	uint8_t buf[sizeof(SStreamBlockInfo) + sizeof(SArrayHeader)];
+	DWORD n = OSRead(buf, sizeof(buf));
+
+	Seek(genio::IStream::SEEK_MODE::SM_CURRENT, -((int64_t)n));
+
+	if (n != sizeof(buf))
+		return 0;
+
+	return (size_t)((SArrayHeader *)(buf + sizeof(SStreamBlockInfo)))->m_Count;
+}
+
+
+bool CInputStream::BeginArray(genio::FOURCHARCODE id, SArrayHeader::ELEMENT_TYPE type, SArrayHeader &ah)
+{
+	if (!BeginBlock(id))
+		return false;
+
+	if ((Read(&ah, sizeof(SArrayHeader)) != sizeof(SArrayHeader)) || (ah.m_ElementType != type))
+	{
+		EndBlock();
+		return false;
+	}
+
+	return true;
+}
+
+
+bool CInputStream::ReadArrayData(size_t &len)
+{
+	SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+
+	len = (sbe.m_Info.m_Length > sizeof(SArrayHeader)) ? (sbe.m_Info.m_Length - sizeof(SArrayHeader)) : 0;
+
+	m_CodecBuffer.resize(len + ARRAYCODEC_INPUTPADDING);
+
+	return (Read(m_CodecBuffer.data(), len) == len);
+}
+
+
+size_t CInputStream::ReadArrayINT64(genio::FOURCHARCODE id, int64_t *data, size_t maxcount)
+{
+	SArrayHeader ah;
+	if (!data || !BeginArray(id, SArrayHeader::AET_INT64, ah))
+		return 0;
+
+	size_t count = (size_t)ah.m_Count;
+	size_t ret = std::min(count, maxcount);
+	size_t len;
+
+	switch (ah.m_Codec)
+	{
+		case genio::IStream::AC_RAW:
+			if (Read(data, sizeof(int64_t) * ret) != (sizeof(int64_t) * ret))
+				ret = 0;
+			break;
+
+		case genio::IStream::AC_DELTADELTA:
+		{
+			// the whole array has to be decoded, so if the caller wants less of it, decode to scratch space
+			int64_t *dst = data;
+			if (count > maxcount)
+			{
+				m_ArrayScratch.resize(count);
+				dst = (int64_t *)m_ArrayScratch.data();
+			}
+
+			if (!ReadArrayData(len) || !DeltaDeltaDecode(m_CodecBuffer.data(), len, dst, count))
+				ret = 0;
+			else if (dst != data)
+				memcpy(data, dst, ret * sizeof(int64_t));
+			break;
+		}
+
+		default:
+			ret = 0;
+			break;
+	}
+
+	EndBlock();
+
+	return ret;
+}
+
+
+size_t CInputStream::ReadArrayDouble(genio::FOURCHARCODE id, double *data, size_t maxcount)
+{
+	SArrayHeader ah;
+	if (!data || !BeginArray(id, SArrayHeader::AET_DOUBLE, ah))
+		return 0;
+
+	size_t count = (size_t)ah.m_Count;
+	size_t ret = std::min(count, maxcount);
+	size_t len;
+
+	switch (ah.m_Codec)
+	{
+		case genio::IStream::AC_RAW:
+			if (Read(data, sizeof(double) * ret) != (sizeof(double) * ret))
+				ret = 0;
+			break;
+
+		case genio::IStream::AC_XOR:
+		{
+			double *dst = data;
+			if (count > maxcount)
+			{
+				m_ArrayScratch.resize(count);
+				dst = (double *)m_ArrayScratch.data();
+			}
+
+			if (!ReadArrayData(len) || !XorDecode(m_CodecBuffer.data(), len, dst, count))
+				ret = 0;
+			else if (dst != data)
+				memcpy(data, dst, ret * sizeof(double));
+			break;
+		}
+
+		default:
+			ret = 0;
+			break;
+	}
+
+	EndBlock();
+
+	return ret;
+}
+
+
+bool CInputStream::MapFile()
+{
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_hFile, &size) || !size.QuadPart || ((uint64_t)size.QuadPart > SIZE_MAX))
+		return false;
+
+	m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_hMapping)
+		return false;
+
+	m_View = (const uint8_t *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_View)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+		return false;
+	}
+
+	m_ViewSize = (uint64_t)size.QuadPart;
+
+	return true;
+}
+
+
+void CInputStream::UnmapFile()
+{
+	if (m_View)
+		UnmapViewOfFile(m_View);
+
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+
+	m_hMapping = NULL;
+	m_View = nullptr;
+	m_ViewSize = 0;
+}
+
+
+bool CInputStream::DecompressBlock(SStreamBlockEntry &sbe)
+{
+	// compressed blocks don't have children, so one is never entered inside another
+	if (m_DecodedDepth || (sbe.m_Info.m_Length > COMPRESSION_MAXBLOCK))
+		return false;
+
+	if (!m_DictionaryLoaded)
+		LoadDictionary();
+
+	size_t len = sbe.m_Info.m_Length;
+
+	m_CodecBuffer.resize(len);
+	if ((OSReadAll(m_CodecBuffer.data(), len) != len) ||
+		!LZDecompress(m_CodecBuffer.data(), len, m_Dictionary.data(), m_Dictionary.size(), m_Decoded))
+		return false;
+
+	m_DecodedStart = sbe.m_BlockStart;
+	m_DecodedEnd = sbe.m_BlockStart + len;
+	m_DecodedDepth = m_StreamBlockStack.size() + 1;
+
+	sbe.m_Info.m_Length = m_Decoded.size();
+
+	// the block is read from its start again, decompressed this time; anything peeked at there was compressed
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, sbe.m_BlockStart);
+	m_PeekPos = NOPEEK;
+
+	return true;
+}
+
+
+void CInputStream::LoadDictionary()
+{
+	m_DictionaryLoaded = true;
+	m_Dictionary.clear();
+
+	uint64_t pos = m_Pos;
+
+	// the dictionary comes first, unless there's a SWMR block
+	uint64_t at = 0;
+
+	SStreamBlockInfo info;
+	if (ReadHeaderAt(0, info) && (info.m_ID == SWMRHEADERID))
+		at = sizeof(SStreamBlockInfo) + info.m_Length;
+
+	if (ReadHeaderAt(at, info) && (info.m_ID == COMPRESSIONDICTIONARYID) && (info.m_Length <= COMPRESSION_MAXDICTIONARY))
+	{
+		m_Dictionary.resize(info.m_Length);
+		if (OSReadAll(m_Dictionary.data(), info.m_Length) != info.m_Length)
+			m_Dictionary.clear();
+	}
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)pos);
+}
+
+
+bool CInputStream::ReadCommitMarker()
+{
+	uint64_t pos = m_Pos;
+
+	SSWMRHeader sh;
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, 0);
+	DWORD n = OSRead(&sh, sizeof(SSWMRHeader));
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)pos);
+
+	if ((n == sizeof(SSWMRHeader)) && (ntohl(sh.m_Info.m_ID) == SWMRHEADERID) && (sh.m_Version == SWMR_VERSION))
+	{
+		// the marker only ever moves forward
+		if (sh.m_Committed > m_Committed)
+			m_Committed = sh.m_Committed;
+
+		return true;
+	}
+
+	// A whole file that wasn't written in SWMR is all there; less than a SWMR block may be one that's being written
+	if (n == sizeof(SSWMRHeader))
+		m_Committed = UNBOUNDED;
+
+	return false;
+}
+
+
+bool CInputStream::Refresh()
+{
+	if (!m_hFile || !(m_ModeFlags & STRMMODE_SWMR))
+		return false;
+
+	uint64_t committed = m_Committed;
+
+	bool swmr = ReadCommitMarker();
+	if (m_Committed == committed)
+		return false;
+
+	// The end of the top level has moved, so whatever was learned about it there is out of date
+	m_PeekPos = NOPEEK;
+
+	auto sit = m_BlockScanState.find(NOPARENT);
+	if (sit != m_BlockScanState.end())
+		sit->second.m_Done = false;
+
+	// neither may the dictionary or the key index have been written the last time they were looked for
+	if (m_Dictionary.empty())
+		m_DictionaryLoaded = false;
+
+	if (m_KeyIndex.empty())
+		m_KeyIndexLoaded = false;
+
+	// the view has to cover the new blocks; the file may have been empty when it was opened
+	if ((m_ModeFlags & STRMMODE_MAPPED) && (m_Committed > m_ViewSize))
+	{
+		DropReadAhead();
+		UnmapFile();
+		MapFile();
+	}
+
+	// If the SWMR block wasn't there when the stream was opened, the stream still starts after it
+	if (swmr && !committed && !m_Pos && m_StreamBlockStack.empty())
+		m_Pos = sizeof(SSWMRHeader);
+
+	return true;
+}
+
+
+uint64_t CInputStream::FirstBlockPos() const
+{
+	// In SWMR, the file may be too new to have the SWMR block yet, but it will start with one
+	return ((m_ModeFlags & STRMMODE_SWMR) && (m_Committed != UNBOUNDED)) ? sizeof(SSWMRHeader) : 0;
+}
+
+
+bool CInputStream::WaitForCommit(uint32_t timeout)
+{
+	if (!m_hFile || !(m_ModeFlags & STRMMODE_SWMR))
+		return false;
+
+	if (Refresh())
+		return true;
+
+	// The file grows with each block the writer finishes, so its folder is watched for size changes
+	if (!m_hChangeNotify && !m_Filename.empty())
+	{
+		size_t sep = m_Filename.find_last_of(_T("\\/"));
+		TGenString<TCHAR> folder(m_Alloc);
+		folder = (sep == m_Filename.npos) ? _T(".") : m_Filename.substr(0, sep + 1).c_str();
+
+		m_hChangeNotify = FindFirstChangeNotification(folder.c_str(), FALSE, FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+		if (m_hChangeNotify == INVALID_HANDLE_VALUE)
+			m_hChangeNotify = NULL;
+	}
+
+	ULONGLONG start = GetTickCount64();
+
+	for (;;)
+	{
+		ULONGLONG elapsed = GetTickCount64() - start;
+		if ((timeout != INFINITE) && (elapsed >= timeout))
+			return false;
+
+		// notifications can be late or missing (i.e. for the marker, which doesn't change the size), so never wait long
+		DWORD wait = (timeout == INFINITE) ? SWMR_POLLINTERVAL : (DWORD)std::min<ULONGLONG>(timeout - elapsed, SWMR_POLLINTERVAL);
+
+		if (m_hChangeNotify)
+		{
+			if (WaitForSingleObject(m_hChangeNotify, wait) == WAIT_OBJECT_0)
+				FindNextChangeNotification(m_hChangeNotify);
+		}
+		else
+		{
+			Sleep(wait);
+		}
+
+		if (Refresh())
+			return true;
+	}
+}
+
+
+void CInputStream::DropDecodedBlock()
+{
+	// positions in the block's data are file positions again, so what was peeked at in it is no good
+	if (m_DecodedDepth)
+		m_PeekPos = NOPEEK;
+
+	m_DecodedDepth = 0;
+}
+
+
+bool CInputStream::BeginTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, uint64_t &count, STypedArrayHeader &th)
+{
+	size_t header = Pos();
+
+	SArrayHeader ah;
+	if (!BeginArray(id, SArrayHeader::AET_TYPED, ah))
+		return false;
+
+	SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+
+	uint64_t avail = sbe.m_Info.m_Length - std::min<uint64_t>(sbe.m_Info.m_Length, sizeof(SArrayHeader) + sizeof(STypedArrayHeader));
+
+	if ((Read(&th, sizeof(STypedArrayHeader)) == sizeof(STypedArrayHeader)) && (th.m_ElementType == type) &&
+		(th.m_ElementSize == ElementTypeSize(type)) && (th.m_Padding <= avail) && (ah.m_Count <= ((avail - th.m_Padding) / th.m_ElementSize)))
+	{
+		Seek(genio::IStream::SEEK_MODE::SM_CURRENT, th.m_Padding);
+
+		count = ah.m_Count;
+
+		return true;
+	}
+
+	EndBlock();
+
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, header);
+
+	return false;
+}
+
+
+const void *CInputStream::MapTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, size_t &count)
+{
+	count = 0;
+
+	if (!m_View)
+		return nullptr;
+
+	size_t header = Pos();
+
+	uint64_t n;
+	STypedArrayHeader th;
+	if (!BeginTypedArray(id, type, n, th))
+		return nullptr;
+
+	const uint8_t *p = m_View + Pos();
+
+	// the writer aligned the elements in the file, and views start on a page, but check rather than trust it
+	if ((((th.m_Flags & STypedArrayHeader::TAF_BIGENDIAN) != 0) != HostIsBigEndian()) || ((uintptr_t)p % th.m_ElementSize) || m_DecodedDepth)
+	{
+		EndBlock();
+
+		Seek(genio::IStream::SEEK_MODE::SM_BEGIN, header);
+
+		return nullptr;
+	}
+
+	EndBlock();
+
+	count = (size_t)n;
+
+	return p;
+}
+
+
+size_t CInputStream::ReadTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, void *data, size_t maxcount)
+{
+	uint64_t count;
+	STypedArrayHeader th;
+	if (!data || !BeginTypedArray(id, type, count, th))
+		return 0;
+
+	size_t ret = (size_t)std::min<uint64_t>(count, maxcount);
+
+	if (Read(data, th.m_ElementSize * ret) != (th.m_ElementSize * ret))
+		ret = 0;
+	else if (((th.m_Flags & STypedArrayHeader::TAF_BIGENDIAN) != 0) != HostIsBigEndian())
+		SwapElements(data, ret, th.m_ElementSize);
+
+	EndBlock();
+
+	return ret;
+}
+
+
+uint32_t CInputStream::CountTopLevel(genio::FOURCHARCODE id)
+{
+	if (!m_hFile)
+		return 0;
+
+	size_t startpos = Pos();
+
+	size_t decoded = m_DecodedDepth;
+	m_DecodedDepth = 0;
+
+	// asking for an occurrence that can't exist finishes the scan of the top level
+	SBlockIndexEntry e;
+	ResolveChild(NOPARENT, 0, UNBOUNDED, id, UINT32_MAX, e);
+
+	m_DecodedDepth = decoded;
+
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, startpos);
+
+	auto sit = m_BlockScanState.find(NOPARENT);
+	if (sit == m_BlockScanState.end())
+		return 0;
+
+	auto cit = sit->second.m_Counts.find(id);
+
+	return (cit != sit->second.m_Counts.end()) ? cit->second : 0;
+}
+
+
+bool CInputStream::FindChild(genio::FOURCHARCODE id, uint32_t index)
+{
+	// compressed blocks don't have children
+	if (!m_hFile || m_DecodedDepth)
+		return false;
+
+	size_t startpos = Pos();
+
+	uint64_t parent = NOPARENT, first = 0, end = UNBOUNDED;
+	if (!m_StreamBlockStack.empty())
+	{
+		SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+
+		parent = sbe.m_BlockStart - sizeof(SStreamBlockInfo);
+		first = sbe.m_BlockStart;
+		end = first + sbe.m_Info.m_Length;
+	}
+
+	SBlockIndexEntry e;
+	if (!ResolveChild(parent, first, end, id, index, e))
+	{
+		Seek(genio::IStream::SEEK_MODE::SM_BEGIN, startpos);
+		return false;
+	}
+
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, e.m_Header);
+
+	return true;
+}
+
+
+bool CInputStream::SaveCursor(genio::SStreamCursor &cursor) const
+{
+	// a position in a decompressed block means nothing once it's gone
+	if (!m_hFile || m_DecodedDepth || (m_StreamBlockStack.size() > STREAMCURSOR_MAXDEPTH))
+		return false;
+
+	cursor.m_Pos = Pos();
+	cursor.m_Depth = (uint32_t)m_StreamBlockStack.size();
+
+	for (size_t i = 0; i < m_StreamBlockStack.size(); i++)
+	{
+		const SStreamBlockEntry &sbe = m_StreamBlockStack[i];
+
+		cursor.m_Blocks[i].m_Start = sbe.m_BlockStart;
+		cursor.m_Blocks[i].m_Length = sbe.m_Info.m_Length;
+		cursor.m_Blocks[i].m_ID = sbe.m_Info.m_ID;
+		cursor.m_Blocks[i].m_Flags = sbe.m_Info.m_Flags.Get();
+	}
+
+	return true;
+}
+
+
+bool CInputStream::RestoreCursor(const genio::SStreamCursor &cursor)
+{
+	if (!m_hFile || (cursor.m_Depth > STREAMCURSOR_MAXDEPTH))
+		return false;
+
+	DropDecodedBlock();
+
+	m_StreamBlockStack.clear();
+
+	for (uint32_t i = 0; i < cursor.m_Depth; i++)
+	{
+		SStreamBlockEntry sbe;
+		sbe.m_Info.m_ID = cursor.m_Blocks[i].m_ID;
+		sbe.m_Info.m_Length = (size_t)cursor.m_Blocks[i].m_Length;
+		sbe.m_Info.m_Crc = 0;
+		sbe.m_Info.m_Flags = cursor.m_Blocks[i].m_Flags;
+		sbe.m_BlockStart = (size_t)cursor.m_Blocks[i].m_Start;
+		sbe.m_RunningCrc = 0;
+		sbe.m_FirstChild = 0;
+
+		m_StreamBlockStack.push_back(sbe);
+	}
+
+	Seek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)cursor.m_Pos);
+
+	return true;
+}
+
+
+bool CInputStream::BeginBlock(genio::FOURCHARCODE id)
+{
+	if (m_hFile)
+	{
+		SStreamBlockEntry sbe;
+
+		if (PeekHeader(sbe.m_Info) != sizeof(SStreamBlockInfo))
+			return false;
+
+		sbe.m_Info.m_ID = ntohl(sbe.m_Info.m_ID);
+
+		if (sbe.m_Info.m_ID == id)
+		{
+			Seek(genio::IStream::SEEK_MODE::SM_CURRENT, sizeof(SStreamBlockInfo));
+
+			sbe.m_BlockStart = Pos();
+
+			if (sbe.m_Info.m_Flags.IsSet(STRMFLG_COMPRESSED) && !DecompressBlock(sbe))
+			{
+				Seek(genio::IStream::SEEK_MODE::SM_BEGIN, sbe.m_BlockStart - sizeof(SStreamBlockInfo));
+				return false;
+			}
+
+			//sbe.m_RunningCrc = CRC32_INITVALUE;
+
+			m_StreamBlockStack.push_back(sbe);
+
+			if ((m_ModeFlags & STRMMODE_READAHEAD) && !m_View && !m_DecodedDepth && (sbe.m_Info.m_Length >= READAHEAD_MINBLOCK))
+				BeginReadAhead(sbe.m_BlockStart, sbe.m_BlockStart + sbe.m_Info.m_Length);
+
+			m_Stats.OnBeginBlock(m_StreamBlockStack.size());
+
+			m_BlockHook.Fire(genio::SBlockEvent::BE_BEGIN, this, id, m_StreamBlockStack.size(), sbe.m_BlockStart, sbe.m_Info.m_Length);
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void CInputStream::EndBlock()
+{
+	if (m_hFile)
+	{
+		SStreamBlockEntry &sbe = m_StreamBlockStack.back();
+
+		m_BlockHook.Fire(genio::SBlockEvent::BE_END, this, sbe.m_Info.m_ID, m_StreamBlockStack.size(), sbe.m_BlockStart, sbe.m_Info.m_Length);
+
+		uint64_t end = sbe.m_BlockStart + sbe.m_Info.m_Length;
+
+		// A decompressed block ends where its compressed data does
+		if (m_DecodedDepth == m_StreamBlockStack.size())
+		{
+			end = m_DecodedEnd;
+			DropDecodedBlock();
+		}
+
+		// Leaving the block that's being read ahead means none of it is wanted any more; skipping the rest of
+		// a block inside it means reading ahead should pick up after the block instead of going through it
+		if (m_ReadAheadEnd)
+		{
+			if (end >= m_ReadAheadEnd)
+				DropReadAhead();
+			else if (Pos() < end)
+				RestartReadAhead(end);
+		}
+
+		Seek(genio::IStream::SEEK_MODE::SM_BEGIN, end);
+
+		m_StreamBlockStack.pop_back();
+
+		m_Stats.OnEndBlock();
 	}
 }
 
@@ -36,6 +36,13 @@
 
 #include <GenIO.h>
 #include <GenIOPrivate.h>
+#include <GenStreamStats.h>
+#include <GenCodec.h>
+#include <GenCompress.h>
+
+
+class CStreamPool;
+class CSharedInputFile;
 
 
 // Implements input file streaming class
@@ -46,12 +53,18 @@ class CInputStream : public genio::IInputStream
 
 public:
 
-	CInputStream();
-	CInputStream(HANDLE h);
+	CInputStream(genio::IAllocator *alloc = nullptr);
+	CInputStream(HANDLE h, genio::IAllocator *alloc);
 	virtual ~CInputStream();
 
 	virtual void Release();
 
+	// Makes Release give this stream back to the given pool instead of deleting it
+	void SetPool(CStreamPool *pool) { m_Pool = pool; }
+
+	// Makes this stream a cursor of the given shared file, holding a reference to it until it's deleted
+	void SetShared(CSharedInputFile *shared);
+
 	virtual bool Assign(const TCHAR *filename);
 	virtual bool Open();
 	virtual void Close();
@@ -63,10 +76,36 @@ public:
 
 	virtual genio::FOURCHARCODE NextBlockId();
 	virtual size_t NextBlockSize();
+	virtual bool Find(const TCHAR *path);
+	virtual bool FindChild(genio::FOURCHARCODE id, uint32_t index = 0);
+	virtual bool SaveCursor(genio::SStreamCursor &cursor) const;
+	virtual bool RestoreCursor(const genio::SStreamCursor &cursor);
 	virtual bool BeginBlock(genio::FOURCHARCODE id);
 	virtual void EndBlock();
 
+	virtual bool GetStats(genio::SStreamStats &stats) const;
+	virtual void ResetStats();
+
+	virtual void SetModeFlags(uint64_t flags);
+	virtual uint64_t GetModeFlags() const;
+
+	virtual void SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata = nullptr);
+
+	virtual size_t NextArrayCount();
+	virtual size_t ReadArrayINT64(genio::FOURCHARCODE id, int64_t *data, size_t maxcount);
+	virtual size_t ReadArrayDouble(genio::FOURCHARCODE id, double *data, size_t maxcount);
+	virtual const void *MapTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, size_t &count);
+	virtual size_t ReadTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, void *data, size_t maxcount);
+
 	virtual size_t Read(void *data, size_t size, size_t number = 1);
+	virtual size_t ReadV(const genio::SIOSegment *segments, size_t count);
+	virtual size_t ReadAt(uint64_t offset, void *data, size_t len);
+	virtual uint64_t SkipInBlock(uint64_t count);
+
+	virtual bool Refresh();
+	virtual bool WaitForCommit(uint32_t timeout);
+
+	virtual bool FindByKey(uint64_t key);
 
 	virtual void ReadINT64		(int64_t	&d);
 	virtual void ReadUINT64		(uint64_t	&d);
@@ -84,11 +123,218 @@ public:
 	virtual void ReadStringA	(char		*d);
 	virtual void ReadStringW	(wchar_t	*d);
 
+	// Returns the number of top-level blocks with the given id, leaving the position unchanged
+	uint32_t CountTopLevel(genio::FOURCHARCODE id);
+
+	// Returns where the first block is, i.e. after the SWMR block, if the file has one
+	uint64_t FirstBlockPos() const;
+
+	// Returns the number of blocks that are open, e.g. the ancestors Find entered
+	size_t OpenBlockCount() const { return m_StreamBlockStack.size(); }
+
 protected:
-	tstring m_Filename;
+	// All OS file access goes through these so that it can be counted. Reads are made at m_Pos, which is
+	// the stream's own, so seeking and asking for the position don't need to go to the OS at all
+	DWORD OSRead(void *data, DWORD size);
+	void OSSeek(genio::IStream::SEEK_MODE mode, int64_t count);
+	size_t OSTell() const;
+
+	// Reads any amount of data, splitting it into calls the OS can take
+	size_t OSReadAll(void *data, size_t size);
+
+	// Gets the block header at the current position without moving past it, returning the number of bytes of it
+	// that were there. A whole header is kept, so that the BeginBlock that usually follows NextBlockId doesn't read it again
+	DWORD PeekHeader(SStreamBlockInfo &info);
+
+	// Read-ahead, for STRMMODE_READAHEAD. The extent of the outermost large block that has been entered is read
+	// on the thread pool into two windows; while one is being consumed, the one after it is being filled
+
+	struct SReadAheadWindow
+	{
+		HANDLE m_hFile;
+		HANDLE m_hEvent;				// for waiting on reads from a shared file; NULL otherwise
+		uint64_t m_Start;
+		size_t m_Requested;				// 0 if the window isn't in use
+		size_t m_Valid;					// how much was actually read; only meaningful once the read is no longer pending
+		bool m_Pending;
+		PTP_WORK m_Work;				// created the first time the window is used, then reused
+		TGenVector<uint8_t> m_Data;
+	};
+
+	static void CALLBACK ReadAheadCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work);
+
+	// Starts reading ahead through the block whose data spans [start, end)
+	void BeginReadAhead(uint64_t start, uint64_t end);
+
+	// Makes sure the window that read ahead from offset is the one being filled, unless one already holds it
+	void RestartReadAhead(uint64_t offset);
+
+	// Stops reading ahead and forgets the windows
+	void DropReadAhead();
+
+	// Starts filling the window from offset, up to the end of the read-ahead extent
+	void IssueWindow(SReadAheadWindow &win, uint64_t offset);
+
+	// Waits for the window to be filled, or, if cancel is set, abandons it
+	void WaitWindow(SReadAheadWindow &win, bool cancel);
+
+	// Returns the window that holds (or will hold) offset, or nullptr
+	SReadAheadWindow *FindWindow(uint64_t offset);
+
+	// Copies as much as it can from the windows, starting at m_Pos; returns the number of bytes copied
+	DWORD ReadFromWindows(void *data, DWORD size);
+
+	SReadAheadWindow m_ReadAhead[2];
+	uint64_t m_ReadAheadStart, m_ReadAheadEnd;		// both 0 if nothing is being read ahead
+
+	// Reads the total size of segments [first, end) into the gather buffer with one call, then scatters it to them
+	size_t ReadGathered(const genio::SIOSegment *segments, size_t first, size_t end, size_t total);
+
+	// Reads the header at the given offset, converting the id to host order
+	bool ReadHeaderAt(uint64_t offset, SStreamBlockInfo &info);
+
+	// Enters an array block and reads its header, making sure it holds the given type of element
+	bool BeginArray(genio::FOURCHARCODE id, SArrayHeader::ELEMENT_TYPE type, SArrayHeader &ah);
+
+	// Reads the rest of the current array block into m_CodecBuffer, with padding for the decoders
+	bool ReadArrayData(size_t &len);
+
+	// Enters a typed array block and moves to its first element; on failure, the position is unchanged
+	bool BeginTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, uint64_t &count, STypedArrayHeader &th);
+
+	// For STRMMODE_MAPPED; the whole file is mapped, read-only, when it's opened. Reads are copies out of the
+	// view rather than calls to the OS, and typed arrays can be handed out from it in place
+	bool MapFile();
+	void UnmapFile();
+
+	// For blocks written in STRMMODE_COMPRESS. A compressed block is decompressed whole when it's entered, and while
+	// it's open, reads from its data come out of m_Decoded and its length is the decompressed one. The stream's
+	// dictionary is loaded the first time a compressed block is entered
+	bool DecompressBlock(SStreamBlockEntry &sbe);
+	void LoadDictionary();
+	void DropDecodedBlock();
+
+	// Closes whatever blocks are open without moving, for Find and FindByKey
+	void AbandonBlocks();
+
+	// The key index, for FindByKey. It's read from the end of the file the first time it's needed, and kept
+	bool LoadKeyIndex();
+
+	bool m_KeyIndexLoaded;
+	SKeyIndexTrailer m_KeyIndexTrailer;
+	TGenVector<SKeyIndexEntry> m_KeyIndex;
+
+	// For STRMMODE_SWMR. Nothing at the top level past m_Committed is visible; it's moved forward by reading the
+	// commit marker in the SWMR block again. Returns false if the file doesn't start with a SWMR block (yet)
+	bool ReadCommitMarker();
+
+	// Block index, used by Find. Every header that is read while resolving a path is remembered
+	// by (parent header offset, id, occurrence), and each parent's children are scanned at most once
+
+	enum : uint64_t
+	{
+		NOPARENT = UINT64_MAX,		// the "parent" of the top-level blocks
+		UNBOUNDED = UINT64_MAX,		// the top level ends wherever the file does
+		NOPEEK = UINT64_MAX
+	};
+
+	struct SBlockIndexKey
+	{
+		uint64_t m_Parent;
+		genio::FOURCHARCODE m_ID;
+		uint32_t m_Occurrence;
+
+		bool operator <(const SBlockIndexKey &k) const
+		{
+			if (m_Parent != k.m_Parent)
+				return m_Parent < k.m_Parent;
+
+			if (m_ID != k.m_ID)
+				return m_ID < k.m_ID;
+
+			return m_Occurrence < k.m_Occurrence;
+		}
+	};
+
+	struct SBlockIndexEntry
+	{
+		uint64_t m_Header;
+		SStreamBlockInfo m_Info;
+	};
+
+	struct SBlockScanState
+	{
+		SBlockScanState(genio::IAllocator *alloc = nullptr) : m_Counts(alloc) { }
+
+		uint64_t m_Next;									// the offset of the next unscanned child header
+		bool m_Done;										// true once all children have been seen
+		TGenMap<genio::FOURCHARCODE, uint32_t> m_Counts;	// occurrences of each id seen so far
+	};
+
+	// Finds the given occurrence of a child of the block whose header is at parent and whose data spans [first, end),
+	// using the block's child directory if it has one and scanning its children's headers if it doesn't
+	bool ResolveChild(uint64_t parent, uint64_t first, uint64_t end, genio::FOURCHARCODE id, uint32_t occurrence, SBlockIndexEntry &entry);
+
+	TGenMap<SBlockIndexKey, SBlockIndexEntry> m_BlockIndex;
+	TGenMap<uint64_t, SBlockScanState> m_BlockScanState;
+
+	// The child directory of the most recently queried parent. The trailer and bloom filter are
+	// read when a parent is first queried; the entries are only read if the bloom filter passes
+	struct SChildDirCache
+	{
+		uint64_t m_First;							// the start of the parent's data; NOPARENT if nothing is cached
+		bool m_Present;								// false if the parent has no directory
+		SChildDirTrailer m_Trailer;
+		TGenVector<uint8_t> m_Bloom;
+		TGenVector<SChildDirEntry> m_Entries;
+		bool m_EntriesLoaded;
+	};
+
+	// Loads the child directory of the block whose data spans [first, end); false if it doesn't have one
+	bool LoadChildDirectory(uint64_t first, uint64_t end);
+
+	SChildDirCache m_ChildDir;
+
+	uint64_t m_ModeFlags;
+
+	TGenVector<uint8_t> m_CodecBuffer;
+
+	TGenVector<uint8_t> m_GatherBuffer;
+	TGenVector<uint64_t> m_ArrayScratch;		// arrays are decoded here when the caller only wants part of them
+
+	TGenString<TCHAR> m_Filename;
 	bool m_OwnsFile;
 	HANDLE m_hFile;
+	uint64_t m_Pos;
+
+	HANDLE m_hMapping;
+	const uint8_t *m_View;
+	uint64_t m_ViewSize;
+
+	TGenVector<uint8_t> m_Dictionary;
+	bool m_DictionaryLoaded;
+
+	TGenVector<uint8_t> m_Decoded;
+	uint64_t m_DecodedStart;			// where the decompressed block's data starts; its positions run on from there
+	uint64_t m_DecodedEnd;				// where its compressed data ends in the file
+	size_t m_DecodedDepth;				// its depth in the block stack; 0 if no block is decompressed
+
+	uint64_t m_Committed;				// UNBOUNDED unless in SWMR
+	HANDLE m_hChangeNotify;				// watches the file's folder while waiting for a commit; NULL until then
+
+	SStreamBlockInfo m_PeekInfo;		// as it is in the file, i.e. the id isn't byte-swapped
+	uint64_t m_PeekPos;					// where m_PeekInfo was read from; NOPEEK if it isn't valid
 
 	TStreamBlockStack m_StreamBlockStack;
 
+	mutable CStreamStats m_Stats;
+
+	SBlockHook m_BlockHook;
+
+	CStreamPool *m_Pool;
+	CSharedInputFile *m_Shared;
+	HANDLE m_hReadEvent;				// for waiting on reads from a shared file, which is opened for overlapped I/O; NULL otherwise
+
+	genio::IAllocator *m_Alloc;			// everything the stream allocates, itself included, comes from here
+
 };
@@ -32,29 +32,68 @@
 
 #include "stdafx.h"
 #include <GenStreamOut.h>
+#include <GenStreamPool.h>
 #include <fileapi.h>
 //#include <Crc.h>
 
 
-genio::IOutputStream *genio::IOutputStream::Create(HANDLE h)
+genio::IOutputStream *genio::IOutputStream::Create(HANDLE h, genio::IAllocator *alloc)
 {
-	return (genio::IOutputStream *)(new COutputStream(h));
+	return (genio::IOutputStream *)(AllocNew<COutputStream>(alloc, h, alloc));
 }
 
 // ************************************************************************
 // Output Stream Methods
 
-COutputStream::COutputStream()
+COutputStream::COutputStream(genio::IAllocator *alloc) :
+	m_Filename(alloc),
+	m_StreamBlockStack(alloc),
+	m_ChildRecords(alloc),
+	m_ChildBloom(alloc),
+	m_CodecBuffer(alloc),
+	m_HeldData(alloc),
+	m_CompressBuffer(alloc),
+	m_Compressor(alloc),
+	m_GatherBuffer(alloc),
+	m_CopyBuffer(alloc),
+	m_WriteBuffer(alloc),
+	m_Keys(alloc)
 {
+	m_Alloc = alloc;
 	m_hFile = NULL;
 	m_OwnsFile = true;
+	m_ModeFlags = 0;
+	m_Holding = false;
+	m_WriteBufferStart = 0;
+	m_Committed = 0;
+	m_LastTopLevel = NOBLOCK;
+	m_Pool = nullptr;
 }
 
 
-COutputStream::COutputStream(HANDLE h)
+COutputStream::COutputStream(HANDLE h, genio::IAllocator *alloc) :
+	m_Filename(alloc),
+	m_StreamBlockStack(alloc),
+	m_ChildRecords(alloc),
+	m_ChildBloom(alloc),
+	m_CodecBuffer(alloc),
+	m_HeldData(alloc),
+	m_CompressBuffer(alloc),
+	m_Compressor(alloc),
+	m_GatherBuffer(alloc),
+	m_CopyBuffer(alloc),
+	m_WriteBuffer(alloc),
+	m_Keys(alloc)
 {
+	m_Alloc = alloc;
 	m_hFile = h;
 	m_OwnsFile = (m_hFile == NULL) ? true : false;
+	m_ModeFlags = 0;
+	m_Holding = false;
+	m_WriteBufferStart = 0;
+	m_Committed = 0;
+	m_LastTopLevel = NOBLOCK;
+	m_Pool = nullptr;
 
 	if (!m_hFile)
 	{
@@ -73,7 +112,19 @@ COutputStream::~COutputStream()
 
 void COutputStream::Release()
 {
-	delete this;
+	if (m_Pool)
+	{
+		Close();
+
+		m_Stats.Reset();
+		m_ModeFlags = 0;
+		m_BlockHook.Set(nullptr, nullptr);
+
+		m_Pool->Return(this);
+		return;
+	}
+
+	AllocDelete(m_Alloc, this);
 }
 
 
@@ -88,13 +139,47 @@ bool COutputStream::Assign(const TCHAR *filename)
 
 
 bool COutputStream::Open()
+{
+	return OpenFile(false);
+}
+
+
+bool COutputStream::OpenFile(bool append)
 {
 	if (!m_Filename.empty())
 	{
 		Close();
 
-		m_hFile = CreateFile(m_Filename.c_str(), GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		bool swmr = (m_ModeFlags & STRMMODE_SWMR) ? true : false;
+
+		// In SWMR, readers open the file while it's being written, so it isn't truncated until Close
+		DWORD share = swmr ? FILE_SHARE_READ : 0;
+		DWORD disposition = (swmr || append) ? OPEN_ALWAYS : CREATE_ALWAYS;
+
+		// resuming an SWMR file means reading its commit marker back
+		DWORD access = (swmr && append) ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_WRITE;
+
+		m_hFile = CreateFile(m_Filename.c_str(), access, share, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
 		m_OwnsFile = true;
+
+		if (m_hFile && swmr)
+		{
+			LARGE_INTEGER size;
+			if (!append || (GetFileSizeEx(m_hFile, &size) && !size.QuadPart))
+			{
+				BeginSWMR();
+			}
+			else if (!ResumeSWMR((uint64_t)size.QuadPart))
+			{
+				// it isn't an SWMR file, and writing a header at the start would overwrite what's there
+				Close();
+				return false;
+			}
+		}
+		else if (m_hFile && append)
+		{
+			OSSeek(genio::IStream::SEEK_MODE::SM_END, 0);
+		}
 	}
 
 	return (m_hFile != NULL);
@@ -108,11 +193,10 @@ size_t COutputStream::Write(const void *data, size_t size, size_t number)
 
 	// fwrite returns the number of BLOCKS written, not the number of bytes, so
 	// we have to fix up this number by multiplying it by size
-	DWORD ret = 0, nwritten = 0;
+	DWORD ret = 0;
 	while (number)
 	{
-		WriteFile(m_hFile, data, (DWORD)size, &nwritten, NULL);
-		ret += nwritten;
+		ret += (DWORD)WriteBlockData(data, size);
 		number--;
 		data = (const uint8_t *)data + size;
 	}
@@ -133,15 +217,126 @@ size_t COutputStream::Write(const void *data, size_t size, size_t number)
 }
 
 
-bool COutputStream::Append()
+size_t COutputStream::WriteV(const genio::SIOSegment *segments, size_t count)
 {
-	bool ret = Open();
-	this->Seek(genio::IStream::SEEK_MODE::SM_END, 0);
+	if (!m_hFile || !segments)
+		return 0;
+
+	size_t ret = 0;
+
+	// while a block's data is being held back, there's nothing to gather
+	if (m_Holding)
+	{
+		for (size_t i = 0; i < count; i++)
+			ret += WriteBlockData(segments[i].m_Data, segments[i].m_Length);
+
+		m_StreamBlockStack.back().m_Info.m_Length += ret;
+
+		return ret;
+	}
+
+	m_GatherBuffer.clear();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const genio::SIOSegment &s = segments[i];
+		if (!s.m_Length)
+			continue;
+
+		if (s.m_Length >= IOV_DIRECTTHRESHOLD)
+		{
+			// keep everything in order; what's been gathered so far goes first
+			if (!m_GatherBuffer.empty())
+			{
+				ret += OSWriteAll(m_GatherBuffer.data(), m_GatherBuffer.size());
+				m_GatherBuffer.clear();
+			}
+
+			ret += OSWriteAll(s.m_Data, s.m_Length);
+			continue;
+		}
+
+		if ((m_GatherBuffer.size() + s.m_Length) > IOV_GATHERSIZE)
+		{
+			ret += OSWriteAll(m_GatherBuffer.data(), m_GatherBuffer.size());
+			m_GatherBuffer.clear();
+		}
+
+		m_GatherBuffer.insert(m_GatherBuffer.end(), (const uint8_t *)s.m_Data, (const uint8_t *)s.m_Data + s.m_Length);
+	}
+
+	if (!m_GatherBuffer.empty())
+		ret += OSWriteAll(m_GatherBuffer.data(), m_GatherBuffer.size());
+
+	// account for everything at once
+	if (!m_StreamBlockStack.empty())
+		m_StreamBlockStack.back().m_Info.m_Length += ret;
 
 	return ret;
 }
 
 
+bool COutputStream::Append()
+{
+	return OpenFile(true);
+}
+
+
+void COutputStream::BeginSWMR()
+{
+	SSWMRHeader sh;
+	sh.m_Info.m_ID = htonl(SWMRHEADERID);
+	sh.m_Info.m_Length = sizeof(SSWMRHeader) - sizeof(SStreamBlockInfo);
+	sh.m_Info.m_Crc = 0;
+	sh.m_Info.m_Flags = 0;
+	sh.m_Version = SWMR_VERSION;
+#if (SIZE_MAX == UINT32_MAX)
+	sh.m_Reserved = 0;
+#endif
+	sh.m_Committed = sizeof(SSWMRHeader);
+
+	// readers may already be looking, so the header goes straight to the file
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, 0);
+	OSWriteDirect(&sh, sizeof(SSWMRHeader));
+
+	m_Committed = sh.m_Committed;
+}
+
+
+bool COutputStream::ResumeSWMR(uint64_t filesize)
+{
+	SSWMRHeader sh;
+	DWORD br = 0;
+	OVERLAPPED ov = {0};
+	if (!ReadFile(m_hFile, &sh, sizeof(SSWMRHeader), &br, &ov) || (br != sizeof(SSWMRHeader)))
+		return false;
+
+	if ((ntohl(sh.m_Info.m_ID) != SWMRHEADERID) || (sh.m_Version != SWMR_VERSION) ||
+		(sh.m_Committed < sizeof(SSWMRHeader)) || (sh.m_Committed > filesize))
+		return false;
+
+	// anything past the marker was never committed, so it's written over
+	m_Committed = sh.m_Committed;
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)m_Committed);
+
+	return true;
+}
+
+
+void COutputStream::Commit()
+{
+	uint64_t pos = Pos();
+	if (pos == m_Committed)
+		return;
+
+	// The blocks have to be in the file before the marker says they are
+	FlushWriteBuffer();
+
+	m_Committed = pos;
+	WriteAt(offsetof(SSWMRHeader, m_Committed), &m_Committed, sizeof(uint64_t));
+}
+
+
 void COutputStream::Close()
 {
 	if (!m_hFile)
@@ -153,6 +348,30 @@ void COutputStream::Close()
 		EndBlock();
 	}
 
+	if (!m_Keys.empty())
+		WriteKeyIndex();
+
+	m_Keys.clear();
+	m_LastTopLevel = NOBLOCK;
+
+	// anything written at the top level without a block around it is committed too
+	if (m_Committed)
+		Commit();
+
+	FlushWriteBuffer();
+
+	// Anything an earlier, longer file left past the end has to go, or the key index wouldn't be the last thing in it
+	if (m_Committed)
+	{
+		OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)m_Committed);
+		SetEndOfFile(m_hFile);
+	}
+
+	// the dictionary belongs to the file
+	m_Compressor.SetDictionary(nullptr, 0);
+
+	m_Committed = 0;
+
 	if (m_OwnsFile)
 		CloseHandle(m_hFile);
 
@@ -166,6 +385,8 @@ void COutputStream::Flush()
 	if (!m_hFile)
 		return;
 
+	FlushWriteBuffer();
+
 	FlushFileBuffers(m_hFile);
 }
 
@@ -174,9 +395,12 @@ void COutputStream::Seek(genio::IStream::SEEK_MODE mode, int64_t count)
 {
 	if (m_hFile)
 	{
-		LARGE_INTEGER i;
-		i.QuadPart = count;
-		SetFilePointerEx(m_hFile, i, NULL, mode);
+		// data that's been held back has to be where it belongs before moving around
+		ReleaseHeldData();
+
+		FlushWriteBuffer();
+
+		OSSeek(mode, count);
 	}
 }
 
@@ -185,13 +409,174 @@ size_t COutputStream::Pos() const
 {
 	if (m_hFile)
 	{
-		return SetFilePointer(m_hFile, 0, NULL, FILE_CURRENT);
+		// data that's being held back (see STRMMODE_COMPRESS) counts as written
+		size_t held = m_HeldData.size();
+
+		// nothing in the buffer has reached the file yet, so the file pointer is still at its start
+		if (!m_WriteBuffer.empty())
+			return (size_t)(m_WriteBufferStart + m_WriteBuffer.size()) + held;
+
+		return OSTell() + held;
+	}
+
+	return 0;
+}
+
+
+DWORD COutputStream::OSWrite(const void *data, DWORD size)
+{
+	if (!(m_ModeFlags & STRMMODE_WRITEBUFFER))
+		return OSWriteDirect(data, size);
+
+	if ((m_WriteBuffer.size() + size) > WRITEBUFFER_SIZE)
+		FlushWriteBuffer();
+
+	if (size >= WRITEBUFFER_SIZE)
+		return OSWriteDirect(data, size);
+
+	if (m_WriteBuffer.empty())
+	{
+		m_WriteBuffer.reserve(WRITEBUFFER_SIZE);
+		m_WriteBufferStart = OSTell();
+	}
+
+	m_WriteBuffer.insert(m_WriteBuffer.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+
+	return size;
+}
+
+
+DWORD COutputStream::OSWriteDirect(const void *data, DWORD size)
+{
+	CStreamStatsTimer t(m_Stats);
+
+	DWORD nwritten = 0;
+	WriteFile(m_hFile, data, size, &nwritten, NULL);
+
+	m_Stats.OnWrite(nwritten);
+
+	return nwritten;
+}
+
+
+void COutputStream::FlushWriteBuffer()
+{
+	if (m_WriteBuffer.empty())
+		return;
+
+	size_t done = 0;
+	while (done < m_WriteBuffer.size())
+	{
+		DWORD n = OSWriteDirect(m_WriteBuffer.data() + done, (DWORD)(m_WriteBuffer.size() - done));
+		if (!n)
+			break;
+
+		done += n;
+	}
+
+	m_WriteBuffer.clear();
+}
+
+
+void COutputStream::WriteAt(uint64_t offset, const void *data, DWORD size)
+{
+	// If it hasn't gone to the file yet, it can be changed where it is
+	if (!m_WriteBuffer.empty() && (offset >= m_WriteBufferStart) && ((offset + size) <= (m_WriteBufferStart + m_WriteBuffer.size())))
+	{
+		memcpy(m_WriteBuffer.data() + (offset - m_WriteBufferStart), data, size);
+		return;
+	}
+
+	size_t tmppos = Pos();
+
+	FlushWriteBuffer();
+
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)offset);
+	OSWriteDirect(data, size);
+	OSSeek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)tmppos);
+}
+
+
+size_t COutputStream::OSWriteAll(const void *data, size_t size)
+{
+	size_t ret = 0;
+
+	while (ret < size)
+	{
+		DWORD n = OSWrite((const uint8_t *)data + ret, (DWORD)std::min<size_t>(size - ret, IOV_MAXCALLSIZE));
+		if (!n)
+			break;
+
+		ret += n;
 	}
 
+	return ret;
+}
+
+
+void COutputStream::OSSeek(genio::IStream::SEEK_MODE mode, int64_t count)
+{
+	CStreamStatsTimer t(m_Stats);
+
+	LARGE_INTEGER i;
+	i.QuadPart = count;
+	SetFilePointerEx(m_hFile, i, NULL, mode);
+
+	m_Stats.OnSeek();
+}
+
+
+size_t COutputStream::OSTell() const
+{
+	CStreamStatsTimer t(m_Stats);
+
+	LARGE_INTEGER z;
+	z.QuadPart = 0;
+
+	m_Stats.OnSeek();
+
+	// SetFilePointer would only give us the low 32 bits
+	LARGE_INTEGER ret;
+	if (SetFilePointerEx(m_hFile, z, &ret, FILE_CURRENT))
+		return (size_t)ret.QuadPart;
+
 	return 0;
 }
 
 
+bool COutputStream::GetStats(genio::SStreamStats &stats) const
+{
+	return m_Stats.Get(stats);
+}
+
+
+void COutputStream::ResetStats()
+{
+	m_Stats.Reset();
+}
+
+
+void COutputStream::SetModeFlags(uint64_t flags)
+{
+	if (!(flags & STRMMODE_WRITEBUFFER))
+		FlushWriteBuffer();
+
+	m_ModeFlags = flags;
+}
+
+
+uint64_t COutputStream::GetModeFlags() const
+{
+	return m_ModeFlags;
+}
+
+
+void COutputStream::SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata)
+{
+	m_BlockHook.Set(func, userdata);
+}
+
+
 bool COutputStream::CanAccess() const
 {
 	return (m_hFile != NULL);
@@ -200,24 +585,46 @@ bool COutputStream::CanAccess() const
 
 bool COutputStream::BeginBlock(genio::FOURCHARCODE id)
 {
+	// The parent has a child, so it won't be compressed
+	if (m_Holding)
+		ReleaseHeldData();
+
 	SStreamBlockEntry sbe;
 
 	// Set the id, and initialize length to 0
 	sbe.m_Info.m_ID = htonl(id);
 	sbe.m_Info.m_Length = 0;
+	sbe.m_Info.m_Crc = 0;
 	sbe.m_Info.m_Flags = 0;
 
 	// Reset the block's crc... we'll calculate this as we add data to the block
 	//sbe.runningcrc = CRC32_INITVALUE;
 
-	DWORD nwritten = 0;
-	WriteFile(m_hFile, &sbe.m_Info, sizeof(SStreamBlockInfo), &nwritten, NULL);
+	// Remember where this block is in its parent, for the parent's child directory; terminators aren't worth finding
+	if ((m_ModeFlags & STRMMODE_CHILDDIRECTORY) && !m_StreamBlockStack.empty() && (id != genio::IStream::ENDBLOCKID))
+	{
+		SChildDirEntry cde;
+		cde.m_ID = id;
+		cde.m_Offset = Pos() - m_StreamBlockStack.back().m_BlockStart;
+		m_ChildRecords.push_back(cde);
+	}
+
+	sbe.m_FirstChild = m_ChildRecords.size();
+
+	OSWrite(&sbe.m_Info, sizeof(SStreamBlockInfo));
 
 	// Store the start of this block after we have written the block header to the file
 	sbe.m_BlockStart = Pos();
 
 	m_StreamBlockStack.push_back(sbe);
 
+	// Any block might turn out to have no children; the dictionary itself has to stay readable, though
+	m_Holding = (m_ModeFlags & STRMMODE_COMPRESS) && (id != genio::IStream::ENDBLOCKID) && (id != COMPRESSIONDICTIONARYID);
+
+	m_Stats.OnBeginBlock(m_StreamBlockStack.size());
+
+	m_BlockHook.Fire(genio::SBlockEvent::BE_BEGIN, this, id, m_StreamBlockStack.size(), sbe.m_BlockStart, 0);
+
 	return true;
 }
 
@@ -228,26 +635,392 @@ void COutputStream::EndBlock()
 	{
 		SStreamBlockEntry &sbe = m_StreamBlockStack.back();
 
+		// Only the innermost block can be holding its data, and it has no children
+		if (m_Holding)
+			CompressHeldData(sbe);
+
+		// The directory goes last, after any terminator, so that readers following the usual load pattern never see it
+		if (m_ChildRecords.size() > sbe.m_FirstChild)
+		{
+			WriteChildDirectory(sbe);
+			m_ChildRecords.resize(sbe.m_FirstChild);
+		}
+
 		size_t tmppos = Pos();
 
 		// the length of the block when we end it, is the current position, minus the position we started it at
 		sbe.m_Info.m_Length = tmppos - sbe.m_BlockStart;
 
-		// Go to the start of the current block...  and back a few bytes to it's block header
-		this->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, sbe.m_BlockStart - sizeof(SStreamBlockInfo));
+		// Write the updated header (this now includes the block crc and length) over the one at the start of the block,
+		// then come back to where we left off...
+		WriteAt(sbe.m_BlockStart - sizeof(SStreamBlockInfo), &sbe.m_Info, sizeof(SStreamBlockInfo));
 
-		// Write the updated header (this now includes the block crc and length)
-		DWORD nwritten = 0;
-		WriteFile(m_hFile, &sbe.m_Info, sizeof(SStreamBlockInfo), &nwritten, NULL);
+		genio::FOURCHARCODE id = ntohl(sbe.m_Info.m_ID);
 
-		// From there, skip over the block to where we left off...
-		this->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, tmppos);
+		m_BlockHook.Fire(genio::SBlockEvent::BE_END, this, id, m_StreamBlockStack.size(), sbe.m_BlockStart, sbe.m_Info.m_Length);
+
+		uint64_t header = sbe.m_BlockStart - sizeof(SStreamBlockInfo);
 
 		m_StreamBlockStack.pop_back();
+
+		m_Stats.OnEndBlock();
+
+		if (m_StreamBlockStack.empty())
+		{
+			if (!IsInternalBlockID(id))
+				m_LastTopLevel = header;
+
+			if (m_Committed)
+				Commit();
+		}
+	}
+}
+
+
+bool COutputStream::CopyBlockFrom(genio::IInputStream *is)
+{
+	if (!m_hFile || !is)
+		return false;
+
+	if (m_Holding)
+		ReleaseHeldData();
+
+	// The header is read raw too, so that its flags come across; its id stays in network order
+	SStreamBlockEntry sbe;
+	if (is->Read(&sbe.m_Info, sizeof(SStreamBlockInfo)) != sizeof(SStreamBlockInfo))
+		return false;
+
+	genio::FOURCHARCODE id = ntohl(sbe.m_Info.m_ID);
+
+	if ((m_ModeFlags & STRMMODE_CHILDDIRECTORY) && !m_StreamBlockStack.empty() && (id != genio::IStream::ENDBLOCKID))
+	{
+		SChildDirEntry cde;
+		cde.m_ID = id;
+		cde.m_Offset = Pos() - m_StreamBlockStack.back().m_BlockStart;
+		m_ChildRecords.push_back(cde);
+	}
+
+	OSWrite(&sbe.m_Info, sizeof(SStreamBlockInfo));
+
+	sbe.m_BlockStart = Pos();
+
+	m_Stats.OnBeginBlock(m_StreamBlockStack.size() + 1);
+
+	m_BlockHook.Fire(genio::SBlockEvent::BE_BEGIN, this, id, m_StreamBlockStack.size() + 1, sbe.m_BlockStart, sbe.m_Info.m_Length);
+
+	// The data, children and all, comes across in large chunks; nothing in it needs to be looked at
+	size_t remaining = sbe.m_Info.m_Length;
+	m_CopyBuffer.resize(std::min<size_t>(remaining, BLOCKCOPY_CHUNKSIZE));
+
+	while (remaining)
+	{
+		size_t n = is->Read(m_CopyBuffer.data(), 1, std::min<size_t>(remaining, m_CopyBuffer.size()));
+		if (!n)
+			break;
+
+		OSWriteAll(m_CopyBuffer.data(), n);
+		remaining -= n;
+	}
+
+	// If the input ran out early, fix the header up so that this stream can still be walked
+	if (remaining)
+	{
+		sbe.m_Info.m_Length -= remaining;
+
+		WriteAt(sbe.m_BlockStart - sizeof(SStreamBlockInfo), &sbe.m_Info, sizeof(SStreamBlockInfo));
+	}
+
+	m_BlockHook.Fire(genio::SBlockEvent::BE_END, this, id, m_StreamBlockStack.size() + 1, sbe.m_BlockStart, sbe.m_Info.m_Length);
+
+	m_Stats.OnEndBlock();
+
+	if (m_StreamBlockStack.empty())
+	{
+		if (!IsInternalBlockID(id))
+			m_LastTopLevel = sbe.m_BlockStart - sizeof(SStreamBlockInfo);
+
+		if (m_Committed)
+			Commit();
+	}
+
+	return (remaining == 0);
+}
+
+
+bool COutputStream::SetCompressionDictionary(const void *dict, size_t len)
+{
+	// Readers only look for the dictionary at the start of the stream, after the SWMR block if there is one
+	uint64_t start = m_Committed ? sizeof(SSWMRHeader) : 0;
+	if (!m_hFile || !dict || !len || (len > COMPRESSION_MAXDICTIONARY) || !m_StreamBlockStack.empty() || (Pos() != start))
+		return false;
+
+	if (!BeginBlock(COMPRESSIONDICTIONARYID))
+		return false;
+
+	Write(dict, len);
+
+	EndBlock();
+
+	m_Compressor.SetDictionary(dict, len);
+
+	return true;
+}
+
+
+bool COutputStream::AddKey(uint64_t key)
+{
+	if (!m_hFile)
+		return false;
+
+	SKeyIndexEntry kie;
+	kie.m_Key = key;
+
+	if (!m_StreamBlockStack.empty())
+	{
+		if (IsInternalBlockID(ntohl(m_StreamBlockStack[0].m_Info.m_ID)))
+			return false;
+
+		kie.m_Offset = m_StreamBlockStack[0].m_BlockStart - sizeof(SStreamBlockInfo);
+	}
+	else if (m_LastTopLevel != NOBLOCK)
+	{
+		kie.m_Offset = m_LastTopLevel;
+	}
+	else
+	{
+		return false;
+	}
+
+	m_Keys.push_back(kie);
+
+	return true;
+}
+
+
+void COutputStream::WriteKeyIndex()
+{
+	// Blocks with the same key stay in the order they were written, without the temporary buffer a stable sort would allocate
+	std::sort(m_Keys.begin(), m_Keys.end(), [](const SKeyIndexEntry &a, const SKeyIndexEntry &b)
+	{
+		return (a.m_Key != b.m_Key) ? (a.m_Key < b.m_Key) : (a.m_Offset < b.m_Offset);
+	});
+
+	SKeyIndexTrailer kit;
+	kit.m_Count = m_Keys.size();
+	kit.m_MinKey = m_Keys.front().m_Key;
+	kit.m_MaxKey = m_Keys.back().m_Key;
+	kit.m_MaxError = 0;
+	kit.m_Magic = KEYINDEXID;
+
+	for (uint64_t i = 0; i < kit.m_Count; i++)
+	{
+		uint64_t p = PredictKeyIndex(kit, m_Keys[(size_t)i].m_Key);
+		kit.m_MaxError = std::max(kit.m_MaxError, (p > i) ? (p - i) : (i - p));
+	}
+
+	// it's written as it is, never compressed, so that readers can go straight to the entry they want
+	SStreamBlockInfo info;
+	info.m_ID = htonl(KEYINDEXID);
+	info.m_Length = (size_t)(kit.m_Count * sizeof(SKeyIndexEntry)) + sizeof(SKeyIndexTrailer);
+	info.m_Crc = 0;
+	info.m_Flags = 0;
+
+	OSWrite(&info, sizeof(SStreamBlockInfo));
+	OSWriteAll(m_Keys.data(), (size_t)(kit.m_Count * sizeof(SKeyIndexEntry)));
+	OSWrite(&kit, sizeof(SKeyIndexTrailer));
+}
+
+
+size_t COutputStream::WriteBlockData(const void *data, size_t size)
+{
+	if (m_Holding)
+	{
+		if ((m_HeldData.size() + size) <= COMPRESSION_MAXBLOCK)
+		{
+			m_HeldData.insert(m_HeldData.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+			return size;
+		}
+
+		ReleaseHeldData();
+	}
+
+	return OSWriteAll(data, size);
+}
+
+
+void COutputStream::ReleaseHeldData()
+{
+	m_Holding = false;
+
+	if (!m_HeldData.empty())
+	{
+		OSWriteAll(m_HeldData.data(), m_HeldData.size());
+		m_HeldData.clear();
 	}
 }
 
 
+void COutputStream::CompressHeldData(SStreamBlockEntry &sbe)
+{
+	m_Holding = false;
+
+	if (m_HeldData.empty())
+		return;
+
+	if (m_Compressor.Compress(m_HeldData.data(), m_HeldData.size(), m_CompressBuffer) < m_HeldData.size())
+	{
+		OSWriteAll(m_CompressBuffer.data(), m_CompressBuffer.size());
+		sbe.m_Info.m_Flags.Set(STRMFLG_COMPRESSED);
+	}
+	else
+	{
+		OSWriteAll(m_HeldData.data(), m_HeldData.size());
+	}
+
+	m_HeldData.clear();
+}
+
+
+void COutputStream::WriteChildDirectory(SStreamBlockEntry &sbe)
+{
+	// Sort by id; children were recorded in the order they were written, so ordering those with the same id by
+	// offset keeps them that way, without the temporary buffer a stable sort would allocate
+	std::sort(m_ChildRecords.begin() + sbe.m_FirstChild, m_ChildRecords.end(), [](const SChildDirEntry &a, const SChildDirEntry &b)
+	{
+		return (a.m_ID != b.m_ID) ? (a.m_ID < b.m_ID) : (a.m_Offset < b.m_Offset);
+	});
+
+	SChildDirTrailer cdt;
+	cdt.m_Count = (uint32_t)(m_ChildRecords.size() - sbe.m_FirstChild);
+	cdt.m_BloomBits = SChildDirBloom::BitsFor(cdt.m_Count);
+	cdt.m_Magic = CHILDDIRECTORYID;
+
+	m_ChildBloom.assign(cdt.m_BloomBits / 8, 0);
+	for (size_t i = sbe.m_FirstChild; i < m_ChildRecords.size(); i++)
+		SChildDirBloom::Add(m_ChildBloom.data(), cdt.m_BloomBits, m_ChildRecords[i].m_ID);
+
+	// The bloom filter comes right after the header so that a reader can get both in one read
+	SStreamBlockInfo info;
+	info.m_ID = htonl(CHILDDIRECTORYID);
+	info.m_Length = m_ChildBloom.size() + (cdt.m_Count * sizeof(SChildDirEntry)) + sizeof(SChildDirTrailer);
+	info.m_Crc = 0;
+	info.m_Flags = 0;
+
+	OSWrite(&info, sizeof(SStreamBlockInfo));
+	OSWrite(m_ChildBloom.data(), (DWORD)m_ChildBloom.size());
+	OSWrite(&m_ChildRecords[sbe.m_FirstChild], (DWORD)(cdt.m_Count * sizeof(SChildDirEntry)));
+	OSWrite(&cdt, sizeof(SChildDirTrailer));
+}
+
+
+bool COutputStream::WriteArray(genio::FOURCHARCODE id, const SArrayHeader &ah, const void *raw, size_t elemsize)
+{
+	if (!BeginBlock(id))
+		return false;
+
+	Write(&ah, sizeof(SArrayHeader));
+
+	// write everything in one go; Write makes a call to the OS per element
+	if (ah.m_Codec == genio::IStream::AC_RAW)
+		Write(raw, (size_t)(elemsize * ah.m_Count));
+	else
+		Write(m_CodecBuffer.data(), m_CodecBuffer.size());
+
+	EndBlock();
+
+	return true;
+}
+
+
+bool COutputStream::WriteArrayINT64(genio::FOURCHARCODE id, const int64_t *data, size_t count, genio::IStream::ARRAY_CODEC codec)
+{
+	if (!m_hFile || (!data && count))
+		return false;
+
+	SArrayHeader ah;
+	ah.m_Codec = (codec == genio::IStream::AC_DELTADELTA) ? codec : genio::IStream::AC_RAW;
+	ah.m_ElementType = SArrayHeader::AET_INT64;
+	ah.m_Reserved = 0;
+	ah.m_Count = count;
+
+	m_CodecBuffer.clear();
+	if (ah.m_Codec == genio::IStream::AC_DELTADELTA)
+		DeltaDeltaEncode(data, count, m_CodecBuffer);
+
+	return WriteArray(id, ah, data, sizeof(int64_t));
+}
+
+
+bool COutputStream::WriteArrayDouble(genio::FOURCHARCODE id, const double *data, size_t count, genio::IStream::ARRAY_CODEC codec)
+{
+	if (!m_hFile || (!data && count))
+		return false;
+
+	SArrayHeader ah;
+	ah.m_Codec = (codec == genio::IStream::AC_XOR) ? codec : genio::IStream::AC_RAW;
+	ah.m_ElementType = SArrayHeader::AET_DOUBLE;
+	ah.m_Reserved = 0;
+	ah.m_Count = count;
+
+	m_CodecBuffer.clear();
+	if (ah.m_Codec == genio::IStream::AC_XOR)
+		XorEncode(data, count, m_CodecBuffer);
+
+	return WriteArray(id, ah, data, sizeof(double));
+}
+
+
+bool COutputStream::WriteTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, const void *data, size_t count, size_t alignment)
+{
+	size_t elemsize = ElementTypeSize(type);
+
+	if (!m_hFile || (!data && count) || !elemsize)
+		return false;
+
+	// the elements have to be at least as aligned as they need to be in memory
+	alignment = std::max(alignment, elemsize);
+	if ((alignment & (alignment - 1)) || (alignment > TYPEDARRAY_MAXALIGNMENT))
+		return false;
+
+	if (!BeginBlock(id))
+		return false;
+
+	// Typed arrays are never compressed, so that they can be used in place
+	ReleaseHeldData();
+
+	SArrayHeader ah;
+	ah.m_Codec = genio::IStream::AC_RAW;
+	ah.m_ElementType = SArrayHeader::AET_TYPED;
+	ah.m_Reserved = 0;
+	ah.m_Count = count;
+
+	STypedArrayHeader th;
+	th.m_ElementType = (uint8_t)type;
+	th.m_ElementSize = (uint8_t)elemsize;
+	th.m_Flags = HostIsBigEndian() ? STypedArrayHeader::TAF_BIGENDIAN : 0;
+	th.m_Alignment = (uint16_t)alignment;
+
+	uint64_t first = Pos() + sizeof(SArrayHeader) + sizeof(STypedArrayHeader);
+	th.m_Padding = (uint16_t)((alignment - (first & (alignment - 1))) & (alignment - 1));
+
+	static const uint8_t zeroes[TYPEDARRAY_MAXALIGNMENT] = { 0 };
+
+	genio::SIOSegment seg[4] =
+	{
+		{ &ah, sizeof(SArrayHeader) },
+		{ &th, sizeof(STypedArrayHeader) },
+		{ (void *)zeroes, th.m_Padding },
+		{ (void *)data, elemsize * count }
+	};
+
+	WriteV(seg, 4);
+
+	EndBlock();
+
+	return true;
+}
+
+
 void COutputStream::WriteINT64(int64_t d)
 {
 	Write((void *)&d, sizeof(d));
@@ -36,6 +36,12 @@
 
 #include <GenIO.h>
 #include <GenIOPrivate.h>
+#include <GenStreamStats.h>
+#include <GenCodec.h>
+#include <GenCompress.h>
+
+
+class CStreamPool;
 
 
 // Implements output file streaming class
@@ -46,14 +52,19 @@ class COutputStream : public genio::IOutputStream
 
 public:
 
-	COutputStream();
-	COutputStream(HANDLE h);
+	COutputStream(genio::IAllocator *alloc = nullptr);
+	COutputStream(HANDLE h, genio::IAllocator *alloc);
 	virtual ~COutputStream();
 
 	virtual void Release();
 
+	// Makes Release give this stream back to the given pool instead of deleting it
+	void SetPool(CStreamPool *pool) { m_Pool = pool; }
+
 	virtual bool Assign(const TCHAR *filename);
 	virtual bool Open();
+	// Like Open, but keeps what's in the file and writes after it. Readers only find a key index at the very end
+	// of a file, so one already in it is no longer found once anything is appended
 	virtual bool Append();
 	virtual void Close();
 	virtual void Flush();
@@ -65,7 +76,26 @@ public:
 	virtual bool BeginBlock(genio::FOURCHARCODE id);
 	virtual void EndBlock();
 
+	virtual bool GetStats(genio::SStreamStats &stats) const;
+	virtual void ResetStats();
+
+	virtual void SetModeFlags(uint64_t flags);
+	virtual uint64_t GetModeFlags() const;
+
+	virtual void SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata = nullptr);
+
 	virtual size_t Write(const void *data, size_t size, size_t number = 1);
+	virtual size_t WriteV(const genio::SIOSegment *segments, size_t count);
+
+	virtual bool WriteArrayINT64(genio::FOURCHARCODE id, const int64_t *data, size_t count, genio::IStream::ARRAY_CODEC codec = genio::IStream::AC_DELTADELTA);
+	virtual bool WriteArrayDouble(genio::FOURCHARCODE id, const double *data, size_t count, genio::IStream::ARRAY_CODEC codec = genio::IStream::AC_XOR);
+	virtual bool WriteTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, const void *data, size_t count, size_t alignment = GENIO_DEFAULTALIGN);
+
+	virtual bool CopyBlockFrom(genio::IInputStream *is);
+
+	virtual bool SetCompressionDictionary(const void *dict, size_t len);
+
+	virtual bool AddKey(uint64_t key);
 
 	virtual void WriteINT64		(int64_t	d);
 	virtual void WriteUINT64	(uint64_t	d);
@@ -83,10 +113,100 @@ public:
 	virtual void WriteStringW	(const wchar_t	*d);
 
 protected:
-	tstring m_Filename;
+	// Opens the assigned file for Open or Append
+	bool OpenFile(bool append);
+
+	// All OS file access goes through these so that it can be counted; in STRMMODE_WRITEBUFFER,
+	// OSWrite only goes to the OS when the write buffer fills up
+	DWORD OSWrite(const void *data, DWORD size);
+	DWORD OSWriteDirect(const void *data, DWORD size);
+	void OSSeek(genio::IStream::SEEK_MODE mode, int64_t count);
+	size_t OSTell() const;
+
+	// Writes any amount of data, splitting it into calls the OS can take
+	size_t OSWriteAll(const void *data, size_t size);
+
+	// Writes whatever is in the write buffer to the file
+	void FlushWriteBuffer();
+
+	// Overwrites data that has already been written, i.e. a block header, leaving the position where it was
+	void WriteAt(uint64_t offset, const void *data, DWORD size);
+
+	// Writes the directory of the given block's children, as a child of that block
+	void WriteChildDirectory(SStreamBlockEntry &sbe);
+
+	// Writes an array block; the data is either the raw elements or m_CodecBuffer, depending on the header's codec
+	bool WriteArray(genio::FOURCHARCODE id, const SArrayHeader &ah, const void *raw, size_t elemsize);
+
+	// For STRMMODE_COMPRESS. The data of the innermost block is held back in m_HeldData until the block ends, when
+	// it's compressed; if the block turns out to have children, or gets too big, what's held is written as it is
+
+	// Holds the data back if a block's data is being held, otherwise writes it
+	size_t WriteBlockData(const void *data, size_t size);
+
+	// Writes whatever is held as it is and stops holding
+	void ReleaseHeldData();
+
+	// Writes whatever is held compressed, if that makes it smaller, marking the block STRMFLG_COMPRESSED
+	void CompressHeldData(SStreamBlockEntry &sbe);
+
+	// For STRMMODE_SWMR. The file is shared with readers, which only look as far as the commit marker in the
+	// SWMR block at its start. Commit moves the marker to the current position once everything before it is in
+	// the file; it's called whenever a top-level block is finished
+
+	// Writes a new SWMR block, with nothing committed after it
+	void BeginSWMR();
+
+	// For Append; picks up the commit marker of the SWMR block already at the start of the file
+	bool ResumeSWMR(uint64_t filesize);
+
+	void Commit();
+
+	uint64_t m_Committed;						// 0 unless in SWMR
+
+	// Writes the key index block, for the keys given to AddKey
+	void WriteKeyIndex();
+
+	TGenVector<SKeyIndexEntry> m_Keys;
+	uint64_t m_LastTopLevel;					// the header offset of the last top-level block the application wrote; NOBLOCK if none
+
+	enum : uint64_t
+	{
+		NOBLOCK = UINT64_MAX
+	};
+
+	TGenString<TCHAR> m_Filename;
 	HANDLE m_hFile;
 	bool m_OwnsFile;
 
 	TStreamBlockStack m_StreamBlockStack;
 
+	uint64_t m_ModeFlags;
+
+	// The children of every open block, in the order they were begun; each block's
+	// records start at its SStreamBlockEntry::m_FirstChild
+	TGenVector<SChildDirEntry> m_ChildRecords;
+	TGenVector<uint8_t> m_ChildBloom;
+
+	TGenVector<uint8_t> m_CodecBuffer;
+
+	bool m_Holding;
+	TGenVector<uint8_t> m_HeldData;
+	TGenVector<uint8_t> m_CompressBuffer;
+	CLZCompressor m_Compressor;
+
+	TGenVector<uint8_t> m_GatherBuffer;
+	TGenVector<uint8_t> m_CopyBuffer;
+
+	TGenVector<uint8_t> m_WriteBuffer;
+	uint64_t m_WriteBufferStart;				// the file offset of the first byte in the write buffer
+
+	mutable CStreamStats m_Stats;
+
+	SBlockHook m_BlockHook;
+
+	CStreamPool *m_Pool;
+
+	genio::IAllocator *m_Alloc;			// everything the stream allocates, itself included, comes from here
+
 };
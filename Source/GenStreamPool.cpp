@@ -0,0 +1,175 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "stdafx.h"
+#include <GenStreamPool.h>
+
+
+genio::IStreamPool *genio::IStreamPool::Create(size_t reserve, genio::IAllocator *alloc)
+{
+	return (genio::IStreamPool *)(AllocNew<CStreamPool>(alloc, reserve, alloc));
+}
+
+
+// ************************************************************************
+// Stream Pool Methods
+
+CStreamPool::CStreamPool(size_t reserve, genio::IAllocator *alloc) :
+	m_AllInput(alloc),
+	m_FreeInput(alloc),
+	m_AllOutput(alloc),
+	m_FreeOutput(alloc)
+{
+	m_Alloc = alloc;
+
+	InitializeSRWLock(&m_Lock);
+
+	m_FreeInput.reserve(reserve);
+	m_FreeOutput.reserve(reserve);
+
+	for (size_t i = 0; i < reserve; i++)
+	{
+		m_FreeInput.push_back(NewInputStream());
+		m_FreeOutput.push_back(NewOutputStream());
+	}
+}
+
+
+CStreamPool::~CStreamPool()
+{
+	// Streams that are still out delete themselves when they're released
+	for (auto is : m_AllInput)
+		is->SetPool(nullptr);
+
+	for (auto os : m_AllOutput)
+		os->SetPool(nullptr);
+
+	for (auto is : m_FreeInput)
+		AllocDelete(m_Alloc, is);
+
+	for (auto os : m_FreeOutput)
+		AllocDelete(m_Alloc, os);
+}
+
+
+void CStreamPool::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+CInputStream *CStreamPool::NewInputStream()
+{
+	CInputStream *is = AllocNew<CInputStream>(m_Alloc, m_Alloc);
+	is->SetPool(this);
+
+	m_AllInput.push_back(is);
+
+	return is;
+}
+
+
+COutputStream *CStreamPool::NewOutputStream()
+{
+	COutputStream *os = AllocNew<COutputStream>(m_Alloc, m_Alloc);
+	os->SetPool(this);
+
+	m_AllOutput.push_back(os);
+
+	return os;
+}
+
+
+genio::IInputStream *CStreamPool::AcquireInputStream()
+{
+	CInputStream *ret;
+
+	AcquireSRWLockExclusive(&m_Lock);
+
+	if (!m_FreeInput.empty())
+	{
+		ret = m_FreeInput.back();
+		m_FreeInput.pop_back();
+	}
+	else
+	{
+		ret = NewInputStream();
+		m_FreeInput.reserve(m_AllInput.size());
+	}
+
+	ReleaseSRWLockExclusive(&m_Lock);
+
+	return (genio::IInputStream *)ret;
+}
+
+
+genio::IOutputStream *CStreamPool::AcquireOutputStream()
+{
+	COutputStream *ret;
+
+	AcquireSRWLockExclusive(&m_Lock);
+
+	if (!m_FreeOutput.empty())
+	{
+		ret = m_FreeOutput.back();
+		m_FreeOutput.pop_back();
+	}
+	else
+	{
+		ret = NewOutputStream();
+		m_FreeOutput.reserve(m_AllOutput.size());
+	}
+
+	ReleaseSRWLockExclusive(&m_Lock);
+
+	return (genio::IOutputStream *)ret;
+}
+
+
+void CStreamPool::Return(CInputStream *is)
+{
+	AcquireSRWLockExclusive(&m_Lock);
+
+	m_FreeInput.push_back(is);
+
+	ReleaseSRWLockExclusive(&m_Lock);
+}
+
+
+void CStreamPool::Return(COutputStream *os)
+{
+	AcquireSRWLockExclusive(&m_Lock);
+
+	m_FreeOutput.push_back(os);
+
+	ReleaseSRWLockExclusive(&m_Lock);
+}
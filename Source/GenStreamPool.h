@@ -0,0 +1,77 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenStreamIn.h>
+#include <GenStreamOut.h>
+
+
+// Implements the stream pool; pooled streams call Return from their Release
+
+
+class CStreamPool : public genio::IStreamPool
+{
+
+public:
+
+	CStreamPool(size_t reserve, genio::IAllocator *alloc);
+	virtual ~CStreamPool();
+
+	virtual genio::IInputStream *AcquireInputStream();
+	virtual genio::IOutputStream *AcquireOutputStream();
+	virtual void Release();
+
+	void Return(CInputStream *is);
+	void Return(COutputStream *os);
+
+protected:
+	CInputStream *NewInputStream();
+	COutputStream *NewOutputStream();
+
+	SRWLOCK m_Lock;
+
+	// Every stream the pool has made, and those that aren't out. The free lists are kept with at least as
+	// much capacity as there are streams, so giving a stream back never allocates
+	TGenVector<CInputStream *> m_AllInput;
+	TGenVector<CInputStream *> m_FreeInput;
+
+	TGenVector<COutputStream *> m_AllOutput;
+	TGenVector<COutputStream *> m_FreeOutput;
+
+	genio::IAllocator *m_Alloc;			// the pool and its streams come from here
+
+};
@@ -0,0 +1,1334 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#include "stdafx.h"
+#include <GenStreamSegmented.h>
+
+
+genio::ISegmentedOutputStream *genio::ISegmentedOutputStream::Create(uint64_t segment_size, genio::IAllocator *alloc)
+{
+	return (genio::ISegmentedOutputStream *)(AllocNew<CSegmentedOutputStream>(alloc, segment_size, alloc));
+}
+
+
+genio::ISegmentedInputStream *genio::ISegmentedInputStream::Create(genio::IAllocator *alloc)
+{
+	return (genio::ISegmentedInputStream *)(AllocNew<CSegmentedInputStream>(alloc, alloc));
+}
+
+
+// ************************************************************************
+// Segment Manifests
+
+#define SEGMENTMANIFEST_VERSION		1
+
+
+static bool WriteSegmentManifest(const TCHAR *filename, const TSegmentInfoArray &segments)
+{
+	COutputStream os;
+	if (!os.Assign(filename) || !os.Open())
+		return false;
+
+	os.BeginBlock('GSMF');
+
+	os.BeginBlock('MHDR');
+	os.WriteUINT32(SEGMENTMANIFEST_VERSION);
+	os.WriteUINT32((uint32_t)segments.size());
+	os.EndBlock();
+
+	for (const SSegmentInfo &s : segments)
+	{
+		os.BeginBlock('SEGM');
+		os.WriteUINT64(s.m_Start);
+		os.WriteUINT64(s.m_Length);
+		os.WriteUINT16((uint16_t)(s.m_Filename.length() + 1));
+		os.WriteString(s.m_Filename.c_str());
+		os.EndBlock();
+	}
+
+	os.BeginBlock(genio::IStream::ENDBLOCKID);
+	os.EndBlock();
+
+	os.EndBlock();
+
+	os.Close();
+
+	return true;
+}
+
+
+static bool ReadSegmentManifest(const TCHAR *filename, TSegmentInfoArray &segments)
+{
+	segments.clear();
+
+	CInputStream is;
+	if (!is.Assign(filename) || !is.Open() || !is.BeginBlock('GSMF'))
+		return false;
+
+	uint32_t count = 0;
+
+	for (genio::FOURCHARCODE id = is.NextBlockId(); id != genio::IStream::ENDBLOCKID; id = is.NextBlockId())
+	{
+		if (!is.BeginBlock(id))
+			break;
+
+		switch (id)
+		{
+			case 'MHDR':
+			{
+				uint32_t version;
+				is.ReadUINT32(version);
+				is.ReadUINT32(count);
+				break;
+			}
+
+			case 'SEGM':
+			{
+				SSegmentInfo s;
+				is.ReadUINT64(s.m_Start);
+				is.ReadUINT64(s.m_Length);
+
+				uint16_t len;
+				is.ReadUINT16(len);
+
+				std::vector<TCHAR> name((size_t)len + 1, _T('\0'));
+				is.ReadString(name.data());
+				s.m_Filename = name.data();
+
+				segments.push_back(s);
+				break;
+			}
+		}
+
+		is.EndBlock();
+	}
+
+	is.EndBlock();
+
+	return (!segments.empty() && (segments.size() == count));
+}
+
+
+// Relative segment filenames are relative to the folder the manifest is in
+static tstring ResolveSegmentFilename(const tstring &manifest, const tstring &filename)
+{
+	if ((filename.length() > 1) && ((filename[1] == _T(':')) || (filename[0] == _T('\\')) || (filename[0] == _T('/'))))
+		return filename;
+
+	size_t slash = manifest.find_last_of(_T("\\/"));
+	if (slash == tstring::npos)
+		return filename;
+
+	return manifest.substr(0, slash + 1) + filename;
+}
+
+
+// ************************************************************************
+// Segmented Output Stream Methods
+
+CSegmentedOutputStream::CSegmentedOutputStream(uint64_t segment_size, genio::IAllocator *alloc) :
+	m_Folders(alloc),
+	m_Segments(alloc),
+	m_Dictionary(alloc)
+{
+	m_Alloc = alloc;
+	m_SegmentSize = segment_size;
+	m_Segment = nullptr;
+	m_Depth = 0;
+	m_ModeFlags = 0;
+
+	memset(&m_EndedStats, 0, sizeof(genio::SStreamStats));
+}
+
+
+CSegmentedOutputStream::~CSegmentedOutputStream()
+{
+	Close();
+}
+
+
+void CSegmentedOutputStream::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+bool CSegmentedOutputStream::Assign(const TCHAR *filename)
+{
+	Close();
+
+	m_Filename = filename;
+
+	return true;
+}
+
+
+bool CSegmentedOutputStream::Open()
+{
+	if (m_Filename.empty())
+		return false;
+
+	Close();
+
+	m_Segments.clear();
+
+	return NextSegment();
+}
+
+
+void CSegmentedOutputStream::Close()
+{
+	if (!m_Segment)
+		return;
+
+	EndSegment();
+
+	m_Depth = 0;
+
+	m_Dictionary.clear();
+
+	WriteSegmentManifest(m_Filename.c_str(), m_Segments);
+}
+
+
+void CSegmentedOutputStream::Flush()
+{
+	if (m_Segment)
+		m_Segment->Flush();
+}
+
+
+void CSegmentedOutputStream::Seek(genio::IStream::SEEK_MODE mode, int64_t count)
+{
+	if (!m_Segment)
+		return;
+
+	// Only the current segment is open, so absolute positions have to be made relative to it
+	if (mode == genio::IStream::SEEK_MODE::SM_BEGIN)
+	{
+		uint64_t start = m_Segments.back().m_Start;
+		if ((uint64_t)count < start)
+			return;
+
+		count -= (int64_t)start;
+	}
+
+	m_Segment->Seek(mode, count);
+}
+
+
+size_t CSegmentedOutputStream::Pos() const
+{
+	if (m_Segment)
+		return (size_t)(m_Segments.back().m_Start + m_Segment->Pos());
+
+	return 0;
+}
+
+
+bool CSegmentedOutputStream::CanAccess() const
+{
+	return (m_Segment && m_Segment->CanAccess());
+}
+
+
+bool CSegmentedOutputStream::NextSegment()
+{
+	uint64_t start = 0;
+	if (m_Segment)
+	{
+		EndSegment();
+
+		start = m_Segments.back().m_Start + m_Segments.back().m_Length;
+	}
+
+	size_t index = m_Segments.size();
+
+	TCHAR ext[16];
+	_stprintf_s(ext, _T(".%03u"), (unsigned int)index);
+
+	size_t slash = m_Filename.find_last_of(_T("\\/"));
+	tstring basename = (slash == tstring::npos) ? m_Filename : m_Filename.substr(slash + 1);
+
+	// Segments next to the manifest are stored by name only, so that the whole set can be moved around together
+	SSegmentInfo s;
+	tstring path;
+	if (m_Folders.empty())
+	{
+		s.m_Filename = basename + ext;
+		path = m_Filename + ext;
+	}
+	else
+	{
+		path = m_Folders[index % m_Folders.size()] + basename + ext;
+		s.m_Filename = path;
+	}
+
+	s.m_Start = start;
+	s.m_Length = 0;
+
+	DeleteFile(path.c_str());
+
+	// Some flags, like STRMMODE_SWMR, only take effect when the file is opened
+	COutputStream *seg = AllocNew<COutputStream>(m_Alloc, m_Alloc);
+	seg->SetModeFlags(m_ModeFlags);
+
+	if (!seg->Assign(path.c_str()) || !seg->Open())
+	{
+		seg->Release();
+		return false;
+	}
+
+	if (!m_Dictionary.empty())
+		seg->SetCompressionDictionary(m_Dictionary.data(), m_Dictionary.size());
+
+	if (m_BlockHook.m_Func)
+		seg->SetBlockCallback(BlockCallback, this);
+
+	m_Segments.push_back(s);
+	m_Segment = seg;
+
+	return true;
+}
+
+
+void CSegmentedOutputStream::EndSegment()
+{
+	if (!m_Segment)
+		return;
+
+	// closing the segment ends any blocks that are still open, so measure it afterwards
+	m_Segment->Close();
+
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	tstring path = ResolveSegmentFilename(m_Filename, m_Segments.back().m_Filename);
+	if (GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &fad))
+		m_Segments.back().m_Length = ((uint64_t)fad.nFileSizeHigh << 32) | (uint64_t)fad.nFileSizeLow;
+
+	genio::SStreamStats stats;
+	if (m_Segment->GetStats(stats))
+		AccumulateStreamStats(m_EndedStats, stats);
+
+	m_Segment->Release();
+	m_Segment = nullptr;
+}
+
+
+bool CSegmentedOutputStream::GetStats(genio::SStreamStats &stats) const
+{
+	stats = m_EndedStats;
+
+	genio::SStreamStats cur;
+	if (m_Segment && m_Segment->GetStats(cur))
+		AccumulateStreamStats(stats, cur);
+
+#if !defined(GENIO_NOSTATS)
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void CSegmentedOutputStream::ResetStats()
+{
+	memset(&m_EndedStats, 0, sizeof(genio::SStreamStats));
+
+	if (m_Segment)
+		m_Segment->ResetStats();
+}
+
+
+void CSegmentedOutputStream::SetModeFlags(uint64_t flags)
+{
+	m_ModeFlags = flags;
+
+	if (m_Segment)
+		m_Segment->SetModeFlags(flags);
+}
+
+
+uint64_t CSegmentedOutputStream::GetModeFlags() const
+{
+	return m_ModeFlags;
+}
+
+
+void CSegmentedOutputStream::BlockCallback(const genio::SBlockEvent &ev, void *userdata)
+{
+	CSegmentedOutputStream *_this = (CSegmentedOutputStream *)userdata;
+	if (!_this->m_BlockHook.m_Func)
+		return;
+
+	genio::SBlockEvent sev = ev;
+	sev.m_Stream = _this;
+	sev.m_Offset += _this->m_Segments.back().m_Start;
+
+	_this->m_BlockHook.m_Func(sev, _this->m_BlockHook.m_UserData);
+}
+
+
+void CSegmentedOutputStream::SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata)
+{
+	m_BlockHook.Set(func, userdata);
+
+	if (m_Segment)
+		m_Segment->SetBlockCallback(func ? BlockCallback : nullptr, func ? this : nullptr);
+}
+
+
+void CSegmentedOutputStream::SetSegmentSize(uint64_t size)
+{
+	m_SegmentSize = size;
+}
+
+
+void CSegmentedOutputStream::AddSegmentFolder(const TCHAR *folder)
+{
+	if (!folder || !*folder)
+		return;
+
+	tstring f = folder;
+	if ((f.back() != _T('\\')) && (f.back() != _T('/')))
+		f += _T('\\');
+
+	m_Folders.push_back(f);
+}
+
+
+size_t CSegmentedOutputStream::GetSegmentCount() const
+{
+	return m_Segments.size();
+}
+
+
+bool CSegmentedOutputStream::RollOver()
+{
+	if (!m_Segment)
+		return false;
+
+	// Only roll over between top-level blocks, so that every segment can be read on its own
+	if (!m_Depth && m_SegmentSize && (m_Segment->Pos() >= m_SegmentSize))
+		return NextSegment();
+
+	return true;
+}
+
+
+bool CSegmentedOutputStream::BeginBlock(genio::FOURCHARCODE id)
+{
+	if (!RollOver())
+		return false;
+
+	if (!m_Segment->BeginBlock(id))
+		return false;
+
+	m_Depth++;
+
+	return true;
+}
+
+
+void CSegmentedOutputStream::EndBlock()
+{
+	if (m_Segment && m_Depth)
+	{
+		m_Segment->EndBlock();
+		m_Depth--;
+	}
+}
+
+
+size_t CSegmentedOutputStream::Write(const void *data, size_t size, size_t number)
+{
+	if (!m_Segment)
+		return 0;
+
+	return m_Segment->Write(data, size, number);
+}
+
+
+size_t CSegmentedOutputStream::WriteV(const genio::SIOSegment *segments, size_t count)
+{
+	if (!m_Segment)
+		return 0;
+
+	return m_Segment->WriteV(segments, count);
+}
+
+
+bool CSegmentedOutputStream::WriteArrayINT64(genio::FOURCHARCODE id, const int64_t *data, size_t count, genio::IStream::ARRAY_CODEC codec)
+{
+	if (!RollOver())
+		return false;
+
+	return m_Segment->WriteArrayINT64(id, data, count, codec);
+}
+
+
+bool CSegmentedOutputStream::WriteArrayDouble(genio::FOURCHARCODE id, const double *data, size_t count, genio::IStream::ARRAY_CODEC codec)
+{
+	if (!RollOver())
+		return false;
+
+	return m_Segment->WriteArrayDouble(id, data, count, codec);
+}
+
+
+bool CSegmentedOutputStream::WriteTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, const void *data, size_t count, size_t alignment)
+{
+	if (!RollOver())
+		return false;
+
+	return m_Segment->WriteTypedArray(id, type, data, count, alignment);
+}
+
+
+bool CSegmentedOutputStream::CopyBlockFrom(genio::IInputStream *is)
+{
+	if (!RollOver())
+		return false;
+
+	return m_Segment->CopyBlockFrom(is);
+}
+
+
+bool CSegmentedOutputStream::SetCompressionDictionary(const void *dict, size_t len)
+{
+	if (!m_Segment || !m_Segment->SetCompressionDictionary(dict, len))
+		return false;
+
+	m_Dictionary.assign((const uint8_t *)dict, (const uint8_t *)dict + len);
+
+	return true;
+}
+
+
+bool CSegmentedOutputStream::AddKey(uint64_t key)
+{
+	// each segment gets an index of its own blocks when it's closed
+	return m_Segment ? m_Segment->AddKey(key) : false;
+}
+
+
+void CSegmentedOutputStream::WriteINT64(int64_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteUINT64(uint64_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteINT32(int32_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteUINT32(uint32_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteDWORD(DWORD d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteINT16(int16_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteUINT16(uint16_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteINT8(int8_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteUINT8(uint8_t d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteDouble(double d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteFloat(float d)
+{
+	Write((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedOutputStream::WriteStringA(const char *d)
+{
+	if (m_Segment)
+		m_Segment->WriteStringA(d);
+}
+
+
+void CSegmentedOutputStream::WriteStringW(const wchar_t *d)
+{
+	if (m_Segment)
+		m_Segment->WriteStringW(d);
+}
+
+
+// ************************************************************************
+// Segmented Input Stream Methods
+
+CSegmentedInputStream::CSegmentedInputStream(genio::IAllocator *alloc) :
+	m_Segments(alloc),
+	m_Streams(alloc)
+{
+	m_Alloc = alloc;
+	m_Current = 0;
+	m_Depth = 0;
+	m_ModeFlags = 0;
+
+	memset(&m_ClosedStats, 0, sizeof(genio::SStreamStats));
+}
+
+
+CSegmentedInputStream::~CSegmentedInputStream()
+{
+	Close();
+}
+
+
+void CSegmentedInputStream::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+bool CSegmentedInputStream::Assign(const TCHAR *filename)
+{
+	Close();
+
+	m_Filename = filename;
+
+	return true;
+}
+
+
+bool CSegmentedInputStream::Open()
+{
+	if (m_Filename.empty())
+		return false;
+
+	Close();
+
+	if (!ReadSegmentManifest(m_Filename.c_str(), m_Segments))
+		return false;
+
+	for (SSegmentInfo &s : m_Segments)
+		s.m_Filename = ResolveSegmentFilename(m_Filename, s.m_Filename);
+
+	m_Streams.resize(m_Segments.size(), nullptr);
+
+	return (Segment(0) != nullptr);
+}
+
+
+void CSegmentedInputStream::Close()
+{
+	for (CInputStream *s : m_Streams)
+	{
+		if (!s)
+			continue;
+
+		genio::SStreamStats stats;
+		if (s->GetStats(stats))
+			AccumulateStreamStats(m_ClosedStats, stats);
+
+		s->Release();
+	}
+
+	m_Streams.clear();
+	m_Segments.clear();
+
+	m_Current = 0;
+	m_Depth = 0;
+}
+
+
+void CSegmentedInputStream::Flush()
+{
+}
+
+
+CInputStream *CSegmentedInputStream::Segment(size_t segment)
+{
+	if (segment >= m_Streams.size())
+		return nullptr;
+
+	if (!m_Streams[segment])
+	{
+		CInputStream *is = AllocNew<CInputStream>(m_Alloc, m_Alloc);
+
+		// some of the mode flags apply to opening the file
+		is->SetModeFlags(m_ModeFlags);
+
+		if (!is->Assign(m_Segments[segment].m_Filename.c_str()) || !is->Open())
+		{
+			is->Release();
+			return nullptr;
+		}
+
+		if (m_BlockHook.m_Func)
+			is->SetBlockCallback(BlockCallback, this);
+
+		m_Streams[segment] = is;
+	}
+
+	return m_Streams[segment];
+}
+
+
+void CSegmentedInputStream::SetCurrent(size_t segment, uint64_t offset)
+{
+	CInputStream *is = Segment(segment);
+	if (!is)
+		return;
+
+	m_Current = segment;
+	is->Seek(genio::IStream::SEEK_MODE::SM_BEGIN, (int64_t)offset);
+}
+
+
+void CSegmentedInputStream::Advance()
+{
+	if (m_Depth)
+		return;
+
+	while (((m_Current + 1) < m_Segments.size()) && m_Streams[m_Current] && (m_Streams[m_Current]->Pos() >= m_Segments[m_Current].m_Length))
+	{
+		CInputStream *is = Segment(m_Current + 1);
+		if (!is)
+			break;
+
+		// in STRMMODE_SWMR, every segment starts with an SWMR block of its own
+		SetCurrent(m_Current + 1, is->FirstBlockPos());
+	}
+}
+
+
+void CSegmentedInputStream::Seek(genio::IStream::SEEK_MODE mode, int64_t count)
+{
+	if (m_Segments.empty())
+		return;
+
+	int64_t target = count;
+	if (mode == genio::IStream::SEEK_MODE::SM_CURRENT)
+		target += (int64_t)Pos();
+	else if (mode == genio::IStream::SEEK_MODE::SM_END)
+		target += (int64_t)(m_Segments.back().m_Start + m_Segments.back().m_Length);
+
+	if (target < 0)
+		target = 0;
+
+	// find the last segment that starts at or before the target
+	auto it = std::upper_bound(m_Segments.begin(), m_Segments.end(), (uint64_t)target, [](uint64_t t, const SSegmentInfo &s)
+	{
+		return t < s.m_Start;
+	});
+
+	size_t segment = (it == m_Segments.begin()) ? 0 : (size_t)((it - m_Segments.begin()) - 1);
+
+	SetCurrent(segment, (uint64_t)target - m_Segments[segment].m_Start);
+}
+
+
+size_t CSegmentedInputStream::Pos() const
+{
+	if (m_Current < m_Streams.size() && m_Streams[m_Current])
+		return (size_t)(m_Segments[m_Current].m_Start + m_Streams[m_Current]->Pos());
+
+	return 0;
+}
+
+
+bool CSegmentedInputStream::CanAccess() const
+{
+	return (m_Current < m_Streams.size() && m_Streams[m_Current] && m_Streams[m_Current]->CanAccess());
+}
+
+
+genio::FOURCHARCODE CSegmentedInputStream::NextBlockId()
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->NextBlockId() : genio::IStream::ENDBLOCKID;
+}
+
+
+size_t CSegmentedInputStream::NextBlockSize()
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->NextBlockSize() : 0;
+}
+
+
+bool CSegmentedInputStream::Find(const TCHAR *path)
+{
+	if (m_Segments.empty() || !path)
+		return false;
+
+	// The top-level part of the path is counted across all segments, so parse it here, find
+	// the segment that holds the requested occurrence and let that segment resolve the rest
+	const TCHAR *p = path;
+	if (*p == _T('/'))
+		p++;
+
+	genio::FOURCHARCODE id;
+	size_t len = StringToFourCC(p, _T("/["), id);
+	if (!len)
+		return false;
+
+	const TCHAR *rest = p + len;
+
+	uint32_t occurrence = 0;
+	if (*rest == _T('['))
+	{
+		TCHAR *close;
+		occurrence = (uint32_t)_tcstoul(rest + 1, &close, 10);
+		if (*close != _T(']'))
+			return false;
+
+		rest = close + 1;
+	}
+
+	for (size_t i = 0; i < m_Segments.size(); i++)
+	{
+		CInputStream *is = Segment(i);
+		if (!is)
+			return false;
+
+		uint32_t count = is->CountTopLevel(id);
+		if (occurrence >= count)
+		{
+			occurrence -= count;
+			continue;
+		}
+
+		TCHAR head[32];
+		FourCCToString(id, head);
+		_stprintf_s(head + 4, 28, _T("[%u]"), occurrence);
+
+		tstring segpath = head;
+		segpath += rest;
+
+		if (!is->Find(segpath.c_str()))
+			return false;
+
+		m_Current = i;
+		m_Depth = is->OpenBlockCount();
+
+		return true;
+	}
+
+	return false;
+}
+
+
+bool CSegmentedInputStream::FindChild(genio::FOURCHARCODE id, uint32_t index)
+{
+	if (m_Segments.empty())
+		return false;
+
+	if (m_Depth)
+	{
+		CInputStream *is = Segment(m_Current);
+		return is ? is->FindChild(id, index) : false;
+	}
+
+	// At the top level, every segment's blocks are children
+	for (size_t i = 0; i < m_Segments.size(); i++)
+	{
+		CInputStream *is = Segment(i);
+		if (!is)
+			return false;
+
+		uint32_t count = is->CountTopLevel(id);
+		if (index >= count)
+		{
+			index -= count;
+			continue;
+		}
+
+		if (!is->FindChild(id, index))
+			return false;
+
+		m_Current = i;
+
+		return true;
+	}
+
+	return false;
+}
+
+
+bool CSegmentedInputStream::SaveCursor(genio::SStreamCursor &cursor) const
+{
+	if (m_Current >= m_Streams.size() || !m_Streams[m_Current] || !m_Streams[m_Current]->SaveCursor(cursor))
+		return false;
+
+	// the segment saves offsets within itself; make them offsets within the whole stream
+	uint64_t start = m_Segments[m_Current].m_Start;
+
+	cursor.m_Pos += start;
+	for (uint32_t i = 0; i < cursor.m_Depth; i++)
+		cursor.m_Blocks[i].m_Start += start;
+
+	return true;
+}
+
+
+bool CSegmentedInputStream::RestoreCursor(const genio::SStreamCursor &cursor)
+{
+	if (m_Segments.empty() || (cursor.m_Depth > STREAMCURSOR_MAXDEPTH))
+		return false;
+
+	// Blocks never span segments, so the outermost open block (or, at the top level, the position)
+	// says which segment the cursor is in; a position at the very end of a segment is still inside its blocks
+	uint64_t anchor = cursor.m_Depth ? cursor.m_Blocks[0].m_Start : cursor.m_Pos;
+
+	auto it = std::upper_bound(m_Segments.begin(), m_Segments.end(), anchor, [](uint64_t t, const SSegmentInfo &s)
+	{
+		return t < s.m_Start;
+	});
+
+	size_t segment = (it == m_Segments.begin()) ? 0 : (size_t)((it - m_Segments.begin()) - 1);
+
+	CInputStream *is = Segment(segment);
+	if (!is)
+		return false;
+
+	uint64_t start = m_Segments[segment].m_Start;
+
+	genio::SStreamCursor local = cursor;
+	local.m_Pos -= start;
+	for (uint32_t i = 0; i < local.m_Depth; i++)
+		local.m_Blocks[i].m_Start -= start;
+
+	if (!is->RestoreCursor(local))
+		return false;
+
+	m_Current = segment;
+	m_Depth = cursor.m_Depth;
+
+	return true;
+}
+
+
+bool CSegmentedInputStream::BeginBlock(genio::FOURCHARCODE id)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+	if (!is || !is->BeginBlock(id))
+		return false;
+
+	m_Depth++;
+
+	return true;
+}
+
+
+void CSegmentedInputStream::EndBlock()
+{
+	if (!m_Depth)
+		return;
+
+	CInputStream *is = Segment(m_Current);
+	if (is)
+		is->EndBlock();
+
+	m_Depth--;
+}
+
+
+bool CSegmentedInputStream::GetStats(genio::SStreamStats &stats) const
+{
+	stats = m_ClosedStats;
+
+	for (CInputStream *is : m_Streams)
+	{
+		genio::SStreamStats s;
+		if (is && is->GetStats(s))
+			AccumulateStreamStats(stats, s);
+	}
+
+#if !defined(GENIO_NOSTATS)
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void CSegmentedInputStream::ResetStats()
+{
+	memset(&m_ClosedStats, 0, sizeof(genio::SStreamStats));
+
+	for (CInputStream *is : m_Streams)
+	{
+		if (is)
+			is->ResetStats();
+	}
+}
+
+
+void CSegmentedInputStream::SetModeFlags(uint64_t flags)
+{
+	m_ModeFlags = flags;
+
+	for (CInputStream *is : m_Streams)
+	{
+		if (is)
+			is->SetModeFlags(flags);
+	}
+}
+
+
+uint64_t CSegmentedInputStream::GetModeFlags() const
+{
+	return m_ModeFlags;
+}
+
+
+void CSegmentedInputStream::BlockCallback(const genio::SBlockEvent &ev, void *userdata)
+{
+	CSegmentedInputStream *_this = (CSegmentedInputStream *)userdata;
+	if (!_this->m_BlockHook.m_Func)
+		return;
+
+	// events only come from the current segment
+	genio::SBlockEvent sev = ev;
+	sev.m_Stream = _this;
+	sev.m_Offset += _this->m_Segments[_this->m_Current].m_Start;
+
+	_this->m_BlockHook.m_Func(sev, _this->m_BlockHook.m_UserData);
+}
+
+
+void CSegmentedInputStream::SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata)
+{
+	m_BlockHook.Set(func, userdata);
+
+	for (CInputStream *is : m_Streams)
+	{
+		if (is)
+			is->SetBlockCallback(func ? BlockCallback : nullptr, func ? this : nullptr);
+	}
+}
+
+
+size_t CSegmentedInputStream::GetSegmentCount() const
+{
+	return m_Segments.size();
+}
+
+
+uint64_t CSegmentedInputStream::GetSegmentStart(size_t segment) const
+{
+	return (segment < m_Segments.size()) ? m_Segments[segment].m_Start : 0;
+}
+
+
+genio::IInputStream *CSegmentedInputStream::OpenSegment(size_t segment, genio::IAllocator *alloc) const
+{
+	if (segment >= m_Segments.size())
+		return nullptr;
+
+	CInputStream *is = AllocNew<CInputStream>(alloc, alloc);
+
+	// some of the mode flags apply to opening the file
+	is->SetModeFlags(m_ModeFlags);
+
+	if (!is->Assign(m_Segments[segment].m_Filename.c_str()) || !is->Open())
+	{
+		is->Release();
+		return nullptr;
+	}
+
+	return is;
+}
+
+
+size_t CSegmentedInputStream::NextArrayCount()
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->NextArrayCount() : 0;
+}
+
+
+size_t CSegmentedInputStream::ReadArrayINT64(genio::FOURCHARCODE id, int64_t *data, size_t maxcount)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->ReadArrayINT64(id, data, maxcount) : 0;
+}
+
+
+size_t CSegmentedInputStream::ReadArrayDouble(genio::FOURCHARCODE id, double *data, size_t maxcount)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->ReadArrayDouble(id, data, maxcount) : 0;
+}
+
+
+const void *CSegmentedInputStream::MapTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, size_t &count)
+{
+	count = 0;
+
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->MapTypedArray(id, type, count) : nullptr;
+}
+
+
+size_t CSegmentedInputStream::ReadTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, void *data, size_t maxcount)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->ReadTypedArray(id, type, data, maxcount) : 0;
+}
+
+
+size_t CSegmentedInputStream::Read(void *data, size_t size, size_t number)
+{
+	size_t total = size * number;
+	size_t ret = 0;
+
+	// Reads between top-level blocks may run on into the next segment
+	while (ret < total)
+	{
+		Advance();
+
+		CInputStream *is = Segment(m_Current);
+		if (!is)
+			break;
+
+		size_t n = is->Read((uint8_t *)data + ret, 1, total - ret);
+		if (!n)
+			break;
+
+		ret += n;
+	}
+
+	return ret;
+}
+
+
+size_t CSegmentedInputStream::ReadV(const genio::SIOSegment *segments, size_t count)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+
+	return is ? is->ReadV(segments, count) : 0;
+}
+
+
+size_t CSegmentedInputStream::ReadAt(uint64_t offset, void *data, size_t len)
+{
+	// blocks don't span segments, so an open block is always in the current one
+	CInputStream *is = m_Depth ? Segment(m_Current) : nullptr;
+
+	return is ? is->ReadAt(offset, data, len) : 0;
+}
+
+
+uint64_t CSegmentedInputStream::SkipInBlock(uint64_t count)
+{
+	CInputStream *is = m_Depth ? Segment(m_Current) : nullptr;
+
+	return is ? is->SkipInBlock(count) : 0;
+}
+
+
+bool CSegmentedInputStream::Refresh()
+{
+	// segments are only listed in the manifest once they're finished, so there's never more to find
+	return false;
+}
+
+
+bool CSegmentedInputStream::WaitForCommit(uint32_t timeout)
+{
+	return false;
+}
+
+
+bool CSegmentedInputStream::FindByKey(uint64_t key)
+{
+	// Each segment has an index of its own blocks
+	for (size_t i = 0; i < m_Segments.size(); i++)
+	{
+		CInputStream *is = Segment(i);
+		if (!is)
+			return false;
+
+		if (is->FindByKey(key))
+		{
+			m_Current = i;
+			m_Depth = 0;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void CSegmentedInputStream::ReadINT64(int64_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadUINT64(uint64_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadINT32(int32_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadUINT32(uint32_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadDWORD(DWORD &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadINT16(int16_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadUINT16(uint16_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadINT8(int8_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadUINT8(uint8_t &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadDouble(double &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadFloat(float &d)
+{
+	Read((void *)&d, sizeof(d));
+}
+
+
+void CSegmentedInputStream::ReadStringA(char *d)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+	if (is)
+		is->ReadStringA(d);
+}
+
+
+void CSegmentedInputStream::ReadStringW(wchar_t *d)
+{
+	Advance();
+
+	CInputStream *is = Segment(m_Current);
+	if (is)
+		is->ReadStringW(d);
+}
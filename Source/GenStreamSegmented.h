@@ -0,0 +1,254 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+#include <GenStreamStats.h>
+#include <GenStreamIn.h>
+#include <GenStreamOut.h>
+
+
+// Implements segmented (multi-file) output and input streams on top of the file streams
+
+
+// The manifest is a GenIO stream with one 'GSMF' block that holds a 'MHDR' block and one 'SEGM' block per segment
+struct SSegmentInfo
+{
+	tstring m_Filename;				// as stored in the manifest; relative names are relative to the manifest's folder
+	uint64_t m_Start;				// logical position of the segment's first byte
+	uint64_t m_Length;
+};
+
+typedef TGenVector<SSegmentInfo> TSegmentInfoArray;
+
+
+class CSegmentedOutputStream : public genio::ISegmentedOutputStream
+{
+
+public:
+
+	CSegmentedOutputStream(uint64_t segment_size, genio::IAllocator *alloc);
+	virtual ~CSegmentedOutputStream();
+
+	virtual void Release();
+
+	virtual bool Assign(const TCHAR *filename);
+	virtual bool Open();
+	virtual void Close();
+	virtual void Flush();
+	virtual void Seek(genio::IStream::SEEK_MODE mode, int64_t count);
+	virtual size_t Pos() const;
+
+	virtual bool CanAccess() const;
+
+	virtual bool BeginBlock(genio::FOURCHARCODE id);
+	virtual void EndBlock();
+
+	virtual bool GetStats(genio::SStreamStats &stats) const;
+	virtual void ResetStats();
+
+	virtual void SetModeFlags(uint64_t flags);
+	virtual uint64_t GetModeFlags() const;
+
+	virtual void SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata = nullptr);
+
+	virtual void SetSegmentSize(uint64_t size);
+	virtual void AddSegmentFolder(const TCHAR *folder);
+	virtual size_t GetSegmentCount() const;
+
+	virtual size_t Write(const void *data, size_t size, size_t number = 1);
+	virtual size_t WriteV(const genio::SIOSegment *segments, size_t count);
+
+	virtual bool WriteArrayINT64(genio::FOURCHARCODE id, const int64_t *data, size_t count, genio::IStream::ARRAY_CODEC codec = genio::IStream::AC_DELTADELTA);
+	virtual bool WriteArrayDouble(genio::FOURCHARCODE id, const double *data, size_t count, genio::IStream::ARRAY_CODEC codec = genio::IStream::AC_XOR);
+	virtual bool WriteTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, const void *data, size_t count, size_t alignment = GENIO_DEFAULTALIGN);
+
+	virtual bool CopyBlockFrom(genio::IInputStream *is);
+
+	virtual bool SetCompressionDictionary(const void *dict, size_t len);
+
+	virtual bool AddKey(uint64_t key);
+
+	virtual void WriteINT64		(int64_t	d);
+	virtual void WriteUINT64	(uint64_t	d);
+	virtual void WriteINT32		(int32_t	d);
+	virtual void WriteUINT32	(uint32_t	d);
+	virtual void WriteINT16		(int16_t	d);
+	virtual void WriteUINT16	(uint16_t	d);
+	virtual void WriteINT8		(int8_t		d);
+	virtual void WriteUINT8		(uint8_t	d);
+	virtual void WriteDouble	(double		d);
+	virtual void WriteFloat		(float		d);
+	virtual void WriteDWORD		(DWORD		d);
+
+	virtual void WriteStringA	(const char		*d);
+	virtual void WriteStringW	(const wchar_t	*d);
+
+protected:
+	// Finishes the current segment (if there is one) and starts the next
+	bool NextSegment();
+
+	// Starts a new segment if a top-level block is about to begin and the current one is full
+	bool RollOver();
+
+	// Closes the current segment, recording its length and stats
+	void EndSegment();
+
+	// Re-issues the segments' block events as this stream's, with logical offsets
+	static void BlockCallback(const genio::SBlockEvent &ev, void *userdata);
+
+	tstring m_Filename;
+	uint64_t m_SegmentSize;
+	TGenVector<tstring> m_Folders;
+
+	TSegmentInfoArray m_Segments;
+	COutputStream *m_Segment;		// the segment being written; always the last one in m_Segments
+	size_t m_Depth;
+
+	uint64_t m_ModeFlags;
+
+	TGenVector<uint8_t> m_Dictionary;		// written at the start of every segment, so that each can be read on its own
+
+	genio::SStreamStats m_EndedStats;	// the totals of the segments that have been closed
+
+	genio::IAllocator *m_Alloc;			// this stream and its segment streams come from here
+
+	SBlockHook m_BlockHook;
+
+};
+
+
+class CSegmentedInputStream : public genio::ISegmentedInputStream
+{
+
+public:
+
+	CSegmentedInputStream(genio::IAllocator *alloc);
+	virtual ~CSegmentedInputStream();
+
+	virtual void Release();
+
+	virtual bool Assign(const TCHAR *filename);
+	virtual bool Open();
+	virtual void Close();
+	virtual void Flush();
+	virtual void Seek(genio::IStream::SEEK_MODE mode, int64_t count);
+	virtual size_t Pos() const;
+
+	virtual bool CanAccess() const;
+
+	virtual genio::FOURCHARCODE NextBlockId();
+	virtual size_t NextBlockSize();
+	virtual bool Find(const TCHAR *path);
+	virtual bool FindChild(genio::FOURCHARCODE id, uint32_t index = 0);
+	virtual bool SaveCursor(genio::SStreamCursor &cursor) const;
+	virtual bool RestoreCursor(const genio::SStreamCursor &cursor);
+	virtual bool BeginBlock(genio::FOURCHARCODE id);
+	virtual void EndBlock();
+
+	virtual bool GetStats(genio::SStreamStats &stats) const;
+	virtual void ResetStats();
+
+	virtual void SetModeFlags(uint64_t flags);
+	virtual uint64_t GetModeFlags() const;
+
+	virtual void SetBlockCallback(genio::BLOCK_CALLBACK func, void *userdata = nullptr);
+
+	virtual size_t GetSegmentCount() const;
+	virtual uint64_t GetSegmentStart(size_t segment) const;
+	virtual genio::IInputStream *OpenSegment(size_t segment, genio::IAllocator *alloc = nullptr) const;
+
+	virtual size_t NextArrayCount();
+	virtual size_t ReadArrayINT64(genio::FOURCHARCODE id, int64_t *data, size_t maxcount);
+	virtual size_t ReadArrayDouble(genio::FOURCHARCODE id, double *data, size_t maxcount);
+	virtual const void *MapTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, size_t &count);
+	virtual size_t ReadTypedArray(genio::FOURCHARCODE id, genio::IStream::ELEMENT_TYPE type, void *data, size_t maxcount);
+
+	virtual size_t Read(void *data, size_t size, size_t number = 1);
+	virtual size_t ReadV(const genio::SIOSegment *segments, size_t count);
+	virtual size_t ReadAt(uint64_t offset, void *data, size_t len);
+	virtual uint64_t SkipInBlock(uint64_t count);
+
+	virtual bool Refresh();
+	virtual bool WaitForCommit(uint32_t timeout);
+
+	virtual bool FindByKey(uint64_t key);
+
+	virtual void ReadINT64		(int64_t	&d);
+	virtual void ReadUINT64		(uint64_t	&d);
+	virtual void ReadINT32		(int32_t	&d);
+	virtual void ReadUINT32		(uint32_t	&d);
+	virtual void ReadINT16		(int16_t	&d);
+	virtual void ReadUINT16		(uint16_t	&d);
+	virtual void ReadINT8		(int8_t		&d);
+	virtual void ReadUINT8		(uint8_t	&d);
+	virtual void ReadDouble		(double		&d);
+	virtual void ReadFloat		(float		&d);
+	virtual void ReadDWORD		(DWORD		&d);
+
+	// If you use this, store the string length in the stream and pre-allocate space
+	virtual void ReadStringA	(char		*d);
+	virtual void ReadStringW	(wchar_t	*d);
+
+protected:
+	// Returns the stream for the given segment, opening it if it hasn't been yet
+	CInputStream *Segment(size_t segment);
+
+	// Makes the given segment current and moves to the given offset within it
+	void SetCurrent(size_t segment, uint64_t offset);
+
+	// Between top-level blocks, moves on to the next segment if the current one has been used up
+	void Advance();
+
+	static void BlockCallback(const genio::SBlockEvent &ev, void *userdata);
+
+	tstring m_Filename;
+
+	TSegmentInfoArray m_Segments;
+	TGenVector<CInputStream *> m_Streams;		// parallels m_Segments; NULL until the segment is first used
+	size_t m_Current;
+	size_t m_Depth;
+
+	uint64_t m_ModeFlags;
+
+	genio::SStreamStats m_ClosedStats;	// the totals of the segment streams that have been closed
+
+	genio::IAllocator *m_Alloc;			// this stream and its segment streams come from here
+
+	SBlockHook m_BlockHook;
+
+};
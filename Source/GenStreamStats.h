@@ -0,0 +1,147 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#pragma once
+
+
+#include <GenIO.h>
+
+
+// Per-stream I/O counters. Streams are not shared between threads, so these are plain members
+// of the stream that owns them; define GENIO_NOSTATS to compile all of the counting out.
+
+class CStreamStats
+{
+
+public:
+
+	CStreamStats() { Reset(); }
+
+#if !defined(GENIO_NOSTATS)
+
+	inline void Reset()
+	{
+		memset(&m_Stats, 0, sizeof(genio::SStreamStats));
+		m_OSTicks = 0;
+	}
+
+	inline void OnRead(size_t bytes) { m_Stats.m_OSReads++; m_Stats.m_BytesRead += bytes; }
+	inline void OnWrite(size_t bytes) { m_Stats.m_OSWrites++; m_Stats.m_BytesWritten += bytes; }
+	inline void OnSeek() { m_Stats.m_OSSeeks++; }
+
+	inline void OnBeginBlock(size_t depth)
+	{
+		m_Stats.m_BlocksBegun++;
+		if (depth > m_Stats.m_MaxDepth)
+			m_Stats.m_MaxDepth = (uint32_t)depth;
+	}
+
+	inline void OnEndBlock() { m_Stats.m_BlocksEnded++; }
+
+	inline void AddTicks(int64_t ticks) { m_OSTicks += ticks; }
+
+	inline static int64_t Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t.QuadPart;
+	}
+
+	bool Get(genio::SStreamStats &stats) const
+	{
+		static LARGE_INTEGER freq = { 0 };
+		if (!freq.QuadPart)
+			QueryPerformanceFrequency(&freq);
+
+		stats = m_Stats;
+		stats.m_OSMicroseconds = (uint64_t)((m_OSTicks * 1000000) / freq.QuadPart);
+
+		return true;
+	}
+
+protected:
+	genio::SStreamStats m_Stats;
+	int64_t m_OSTicks;
+
+#else
+
+	inline void Reset() { }
+
+	inline void OnRead(size_t bytes) { }
+	inline void OnWrite(size_t bytes) { }
+	inline void OnSeek() { }
+	inline void OnBeginBlock(size_t depth) { }
+	inline void OnEndBlock() { }
+	inline void AddTicks(int64_t ticks) { }
+	inline static int64_t Now() { return 0; }
+
+	bool Get(genio::SStreamStats &stats) const
+	{
+		memset(&stats, 0, sizeof(genio::SStreamStats));
+		return false;
+	}
+
+#endif
+
+};
+
+
+// Adds one set of counters to another, i.e. to total up the streams behind a segmented stream
+inline void AccumulateStreamStats(genio::SStreamStats &total, const genio::SStreamStats &stats)
+{
+	total.m_BytesRead += stats.m_BytesRead;
+	total.m_BytesWritten += stats.m_BytesWritten;
+	total.m_OSReads += stats.m_OSReads;
+	total.m_OSWrites += stats.m_OSWrites;
+	total.m_OSSeeks += stats.m_OSSeeks;
+	total.m_BlocksBegun += stats.m_BlocksBegun;
+	total.m_BlocksEnded += stats.m_BlocksEnded;
+	total.m_MaxDepth = std::max(total.m_MaxDepth, stats.m_MaxDepth);
+	total.m_OSMicroseconds += stats.m_OSMicroseconds;
+}
+
+
+// Times the OS call made in the scope it is declared in and adds it to the stream's total
+class CStreamStatsTimer
+{
+
+public:
+
+	CStreamStatsTimer(CStreamStats &stats) : m_Stats(stats) { m_Start = CStreamStats::Now(); }
+	~CStreamStatsTimer() { m_Stats.AddTicks(CStreamStats::Now() - m_Start); }
+
+protected:
+	CStreamStats &m_Stats;
+	int64_t m_Start;
+
+};
@@ -0,0 +1,401 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+#include "stdafx.h"
+#include <GenTable.h>
+#include <GenCodec.h>
+
+
+genio::ITableWriter *genio::ITableWriter::Create(const genio::STableColumn *columns, size_t numcolumns, genio::IAllocator *alloc)
+{
+	if (!columns || !numcolumns)
+		return nullptr;
+
+	for (size_t i = 0; i < numcolumns; i++)
+	{
+		if (!ColumnTypeSize(columns[i].m_Type) || (columns[i].m_ID == genio::IStream::ENDBLOCKID) || (columns[i].m_ID == TABLESCHEMAID))
+			return nullptr;
+
+		for (size_t j = 0; j < i; j++)
+		{
+			if (columns[j].m_ID == columns[i].m_ID)
+				return nullptr;
+		}
+	}
+
+	return (genio::ITableWriter *)(AllocNew<CTableWriter>(alloc, columns, numcolumns, alloc));
+}
+
+
+genio::ITableReader *genio::ITableReader::Create(genio::IAllocator *alloc)
+{
+	return (genio::ITableReader *)(AllocNew<CTableReader>(alloc, alloc));
+}
+
+
+// ************************************************************************
+// Table Writer Methods
+
+CTableWriter::CTableWriter(const genio::STableColumn *columns, size_t numcolumns, genio::IAllocator *alloc) :
+	m_Columns(alloc),
+	m_Data(alloc)
+{
+	m_Alloc = alloc;
+
+	m_Columns.assign(columns, columns + numcolumns);
+
+	// codecs only apply to some types; store everything else raw so the schema says what's really there
+	for (genio::STableColumn &c : m_Columns)
+	{
+		bool int64col = (c.m_Type == genio::STableColumn::CT_INT64) || (c.m_Type == genio::STableColumn::CT_UINT64);
+		bool doublecol = (c.m_Type == genio::STableColumn::CT_DOUBLE);
+
+		if (!(int64col && (c.m_Codec == genio::IStream::AC_DELTADELTA)) && !(doublecol && (c.m_Codec == genio::IStream::AC_XOR)))
+			c.m_Codec = genio::IStream::AC_RAW;
+	}
+
+	m_Data.assign(numcolumns, TGenVector<uint8_t>(alloc));
+	m_Rows = 0;
+}
+
+
+CTableWriter::~CTableWriter()
+{
+}
+
+
+void CTableWriter::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+void CTableWriter::AppendRow(const void *record)
+{
+	AppendRows(record, 1, 0);
+}
+
+
+void CTableWriter::AppendRows(const void *records, size_t count, size_t stride)
+{
+	if (!records || !count)
+		return;
+
+	for (size_t c = 0; c < m_Columns.size(); c++)
+	{
+		const genio::STableColumn &col = m_Columns[c];
+		size_t size = ColumnTypeSize(col.m_Type);
+
+		TGenVector<uint8_t> &data = m_Data[c];
+		size_t pos = data.size();
+		data.resize(pos + (size * count));
+
+		const uint8_t *src = (const uint8_t *)records + col.m_Offset;
+		uint8_t *dst = &data[pos];
+
+		for (size_t r = 0; r < count; r++, src += stride, dst += size)
+			memcpy(dst, src, size);
+	}
+
+	m_Rows += count;
+}
+
+
+size_t CTableWriter::GetRowCount() const
+{
+	return m_Rows;
+}
+
+
+bool CTableWriter::Write(genio::IOutputStream *os, genio::FOURCHARCODE id)
+{
+	if (!os || !os->BeginBlock(id))
+		return false;
+
+	os->BeginBlock(TABLESCHEMAID);
+	os->WriteUINT32((uint32_t)m_Columns.size());
+	os->WriteUINT64(m_Rows);
+	for (const genio::STableColumn &c : m_Columns)
+	{
+		os->WriteUINT32(c.m_ID);
+		os->WriteUINT8((uint8_t)c.m_Type);
+		os->WriteUINT8((uint8_t)c.m_Codec);
+	}
+	os->EndBlock();
+
+	for (size_t i = 0; i < m_Columns.size(); i++)
+	{
+		const genio::STableColumn &c = m_Columns[i];
+
+		switch (c.m_Type)
+		{
+			case genio::STableColumn::CT_INT64:
+			case genio::STableColumn::CT_UINT64:
+				os->WriteArrayINT64(c.m_ID, (const int64_t *)m_Data[i].data(), m_Rows, c.m_Codec);
+				break;
+
+			case genio::STableColumn::CT_DOUBLE:
+				os->WriteArrayDouble(c.m_ID, (const double *)m_Data[i].data(), m_Rows, c.m_Codec);
+				break;
+
+			default:
+				os->BeginBlock(c.m_ID);
+				if (!m_Data[i].empty())
+					os->Write(m_Data[i].data(), m_Data[i].size());
+				os->EndBlock();
+				break;
+		}
+	}
+
+	os->BeginBlock(genio::IStream::ENDBLOCKID);
+	os->EndBlock();
+
+	os->EndBlock();
+
+	for (TGenVector<uint8_t> &d : m_Data)
+		d.clear();
+
+	m_Rows = 0;
+
+	return true;
+}
+
+
+// ************************************************************************
+// Table Reader Methods
+
+CTableReader::CTableReader(genio::IAllocator *alloc) :
+	m_Columns(alloc),
+	m_Data(alloc),
+	m_Loaded(alloc)
+{
+	m_Alloc = alloc;
+	m_Rows = 0;
+}
+
+
+CTableReader::~CTableReader()
+{
+}
+
+
+void CTableReader::Release()
+{
+	AllocDelete(m_Alloc, this);
+}
+
+
+bool CTableReader::Read(genio::IInputStream *is, genio::FOURCHARCODE id, const genio::FOURCHARCODE *columns, size_t numcolumns)
+{
+	m_Columns.clear();
+	m_Data.clear();
+	m_Loaded.clear();
+	m_Rows = 0;
+
+	if (!is || !is->BeginBlock(id))
+		return false;
+
+	// the schema always comes first
+	if (!is->BeginBlock(TABLESCHEMAID))
+	{
+		is->EndBlock();
+		return false;
+	}
+
+	uint32_t count = 0;
+	uint64_t rows = 0;
+	is->ReadUINT32(count);
+	is->ReadUINT64(rows);
+
+	// Each column takes up 6 bytes of the schema, so a count that the block can't hold is corrupt and mustn't be allocated for
+	uint64_t schemalen = sizeof(uint32_t) + sizeof(uint64_t) + ((uint64_t)count * (sizeof(uint32_t) + (2 * sizeof(uint8_t))));
+	uint8_t last;
+	if ((count && (is->ReadAt(schemalen - 1, &last, 1) != 1)) || (rows > SIZE_MAX))
+	{
+		is->EndBlock();
+		is->EndBlock();
+		return false;
+	}
+
+	m_Columns.resize(count);
+	for (genio::STableColumn &c : m_Columns)
+	{
+		uint8_t type, codec;
+		is->ReadUINT32(c.m_ID);
+		is->ReadUINT8(type);
+		is->ReadUINT8(codec);
+
+		c.m_Type = (genio::STableColumn::COLUMN_TYPE)type;
+		c.m_Codec = (genio::IStream::ARRAY_CODEC)codec;
+		c.m_Offset = 0;
+	}
+
+	is->EndBlock();
+
+	m_Rows = (size_t)rows;
+	m_Data.assign(count, TGenVector<uint8_t>(m_Alloc));
+	m_Loaded.resize(count, false);
+
+	bool ret = true;
+
+	for (size_t i = 0; i < m_Columns.size(); i++)
+	{
+		if (columns)
+		{
+			if (std::find(columns, columns + numcolumns, m_Columns[i].m_ID) == (columns + numcolumns))
+				continue;
+		}
+
+		// go straight to the column's block; everything in between is skipped over
+		if (!is->FindChild(m_Columns[i].m_ID) || !ReadColumn(is, i))
+		{
+			ret = false;
+			break;
+		}
+	}
+
+	is->EndBlock();
+
+	return ret;
+}
+
+
+bool CTableReader::ReadColumn(genio::IInputStream *is, size_t index)
+{
+	const genio::STableColumn &c = m_Columns[index];
+
+	size_t size = ColumnTypeSize(c.m_Type);
+	if (!size)
+		return false;
+
+	if (!CheckColumnRows(is, c, size))
+		return false;
+
+	TGenVector<uint8_t> &data = m_Data[index];
+	data.resize(size * m_Rows);
+
+	switch (c.m_Type)
+	{
+		case genio::STableColumn::CT_INT64:
+		case genio::STableColumn::CT_UINT64:
+			if (is->ReadArrayINT64(c.m_ID, (int64_t *)data.data(), m_Rows) != m_Rows)
+				return false;
+			break;
+
+		case genio::STableColumn::CT_DOUBLE:
+			if (is->ReadArrayDouble(c.m_ID, (double *)data.data(), m_Rows) != m_Rows)
+				return false;
+			break;
+
+		default:
+		{
+			if (!is->BeginBlock(c.m_ID))
+				return false;
+
+			size_t n = data.empty() ? 0 : is->Read(data.data(), data.size());
+			is->EndBlock();
+
+			if (n != data.size())
+				return false;
+			break;
+		}
+	}
+
+	m_Loaded[index] = true;
+
+	return true;
+}
+
+
+bool CTableReader::CheckColumnRows(genio::IInputStream *is, const genio::STableColumn &c, size_t size)
+{
+	if (m_Rows > (SIZE_MAX / size))
+		return false;
+
+	genio::SStreamCursor cursor;
+	if (!is->SaveCursor(cursor) || !is->BeginBlock(c.m_ID))
+		return false;
+
+	// Both are read from the decoded block, so compressed columns are measured by what they hold
+	bool ret;
+	if ((c.m_Type == genio::STableColumn::CT_INT64) || (c.m_Type == genio::STableColumn::CT_UINT64) || (c.m_Type == genio::STableColumn::CT_DOUBLE))
+	{
+		// encoded arrays can be far smaller than their elements, but their header says how many there are
+		SArrayHeader ah;
+		ret = (is->ReadAt(0, &ah, sizeof(SArrayHeader)) == sizeof(SArrayHeader)) && (ah.m_Count == m_Rows);
+	}
+	else
+	{
+		uint8_t last;
+		ret = !m_Rows || (is->ReadAt((size * m_Rows) - 1, &last, 1) == 1);
+	}
+
+	is->EndBlock();
+
+	return is->RestoreCursor(cursor) && ret;
+}
+
+
+size_t CTableReader::GetRowCount() const
+{
+	return m_Rows;
+}
+
+
+size_t CTableReader::GetColumnCount() const
+{
+	return m_Columns.size();
+}
+
+
+bool CTableReader::GetColumnInfo(size_t index, genio::STableColumn &column) const
+{
+	if (index >= m_Columns.size())
+		return false;
+
+	column = m_Columns[index];
+
+	return true;
+}
+
+
+const void *CTableReader::GetColumn(genio::FOURCHARCODE id) const
+{
+	for (size_t i = 0; i < m_Columns.size(); i++)
+	{
+		if ((m_Columns[i].m_ID == id) && m_Loaded[i])
+			return m_Data[i].data();
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,119 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+
+
+#pragma once
+
+
+#include <GenIO.h>
+#include <GenIOPrivate.h>
+
+
+// Implements table (struct-of-arrays) writers and readers
+//
+// A table block contains a 'TSCH' schema block (UINT32 column count, UINT64 row count, then each
+// column's id, UINT8 type and UINT8 codec), followed by a block for every column and a terminator.
+// 64-bit integer and double columns are array blocks (see IOutputStream::WriteArrayINT64), so they
+// may be encoded; every other column block just holds its raw values.
+
+#define TABLESCHEMAID		'TSCH'
+
+
+// Returns the size of one element of the given column type, or 0 if the type is invalid
+inline size_t ColumnTypeSize(genio::STableColumn::COLUMN_TYPE type)
+{
+	static const size_t sizes[genio::STableColumn::CT_NUMTYPES] =
+	{
+		sizeof(int8_t), sizeof(uint8_t), sizeof(int16_t), sizeof(uint16_t), sizeof(int32_t),
+		sizeof(uint32_t), sizeof(int64_t), sizeof(uint64_t), sizeof(float), sizeof(double)
+	};
+
+	return ((unsigned)type < genio::STableColumn::CT_NUMTYPES) ? sizes[type] : 0;
+}
+
+
+class CTableWriter : public genio::ITableWriter
+{
+
+public:
+
+	CTableWriter(const genio::STableColumn *columns, size_t numcolumns, genio::IAllocator *alloc);
+	virtual ~CTableWriter();
+
+	virtual void AppendRow(const void *record);
+	virtual void AppendRows(const void *records, size_t count, size_t stride);
+	virtual size_t GetRowCount() const;
+	virtual bool Write(genio::IOutputStream *os, genio::FOURCHARCODE id);
+	virtual void Release();
+
+protected:
+	TGenVector<genio::STableColumn> m_Columns;
+	TGenVector<TGenVector<uint8_t>> m_Data;		// one array of values per column
+	size_t m_Rows;
+
+	genio::IAllocator *m_Alloc;
+
+};
+
+
+class CTableReader : public genio::ITableReader
+{
+
+public:
+
+	CTableReader(genio::IAllocator *alloc);
+	virtual ~CTableReader();
+
+	virtual bool Read(genio::IInputStream *is, genio::FOURCHARCODE id, const genio::FOURCHARCODE *columns = nullptr, size_t numcolumns = 0);
+	virtual size_t GetRowCount() const;
+	virtual size_t GetColumnCount() const;
+	virtual bool GetColumnInfo(size_t index, genio::STableColumn &column) const;
+	virtual const void *GetColumn(genio::FOURCHARCODE id) const;
+	virtual void Release();
+
+protected:
+	// Reads the column block at the stream's current position
+	bool ReadColumn(genio::IInputStream *is, size_t index);
+
+	// Returns true if the column block at the stream's current position really has m_Rows elements of the given
+	// size, leaving the position unchanged; the row count comes from the schema, so it can't be trusted otherwise
+	bool CheckColumnRows(genio::IInputStream *is, const genio::STableColumn &c, size_t size);
+
+	TGenVector<genio::STableColumn> m_Columns;
+	TGenVector<TGenVector<uint8_t>> m_Data;		// parallels m_Columns; empty for columns that weren't loaded
+	TGenVector<bool> m_Loaded;
+	size_t m_Rows;
+
+	genio::IAllocator *m_Alloc;
+
+};
@@ -33,10 +33,11 @@
 #include "stdafx.h"
 #include <GenIO.h>
 #include "GenTextOut.h"
+#include <GenAllocator.h>
 #include <io.h>
 #include <fcntl.h>
 
-genio::ITextOutput *genio::ITextOutput::Create(HANDLE h)
+genio::ITextOutput *genio::ITextOutput::Create(HANDLE h, genio::IAllocator *alloc)
 {
 	FILE *f = NULL;
 	if (h)
@@ -45,29 +46,30 @@ genio::ITextOutput *genio::ITextOutput::Create(HANDLE h)
 		f = _fdopen(fd, "w");
 	}
 
-	return (genio::ITextOutput *)(new CGenTextOutput(f, false));
+	return (genio::ITextOutput *)(AllocNew<CGenTextOutput>(alloc, f, false, alloc));
 }
 
-genio::ITextOutput *genio::ITextOutput::Create(const TCHAR *filename)
+genio::ITextOutput *genio::ITextOutput::Create(const TCHAR *filename, genio::IAllocator *alloc)
 {
 	FILE *f = nullptr;
 	_tfopen_s(&f, filename, _T("wt"));
 	if (!f)
 		return nullptr;
 
-	return (genio::ITextOutput *)(new CGenTextOutput(f, true));
+	return (genio::ITextOutput *)(AllocNew<CGenTextOutput>(alloc, f, true, alloc));
 }
 
 void CGenTextOutput::Release()
 {
-	delete this;
+	AllocDelete(m_Alloc, this);
 }
 
 // ************************************************************************
 // Text Output Stream Methods
 
-CGenTextOutput::CGenTextOutput(FILE *f, bool owner)
+CGenTextOutput::CGenTextOutput(FILE *f, bool owner, genio::IAllocator *alloc)
 {
+	m_Alloc = alloc;
 	m_f = f;
 	m_OwnsFile = owner;
 	indentchar = _T('\t');
@@ -37,7 +37,7 @@
 class CGenTextOutput : public genio::ITextOutput
 {
 public:
-	CGenTextOutput(FILE *f, bool owner);
+	CGenTextOutput(FILE *f, bool owner, genio::IAllocator *alloc);
 	virtual ~CGenTextOutput();
 
 	virtual void Flush();
@@ -78,4 +78,6 @@ protected:
 	bool m_OwnsFile;
 	FILE *m_f;
 
+	genio::IAllocator *m_Alloc;
+
 };
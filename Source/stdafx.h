@@ -53,6 +53,7 @@
 #include <deque>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <algorithm>
 #include <assert.h>
@@ -0,0 +1,358 @@
+/*
+	GenIO Library Source File
+
+	Copyright  2009-2021, Keelan Stuart. All rights reserved.
+
+	GenIO is an I/O library, providing classes that stream data in and out
+	in a way that forward- and backward-compatible de/serialization is easy.
+	Additionally, text streams that support indentation and a C-syntax
+	tokenizing parser are provided.
+
+	GenIO is free software; you can redistribute it and/or modify it under
+	the terms of the MIT License:
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// GenIOTool.cpp : command line utilities for working with GenIO files.
+//
+// Usage: GenIOTool <command> [options]
+//
+//   merge [-key id] [-tombstone id] -out file input [input ...]
+//       Merges the inputs into one file, copying their top-level blocks across as they are and adding a
+//       directory of them at the end. With -key, objects whose 'id' child blocks hold the same data are the
+//       same object, and only the one from the last input is kept; with -tombstone, an object with an 'id'
+//       child block deletes that object. Block ids are four characters, i.e. INF0
+//
+//   diff -out patch old new
+//       Writes a compressed patch that turns old into new, copying the blocks they have in common from old
+//
+//   patch -out new old patch
+//       Rebuilds new from old and a patch made by diff
+
+#include <GenIO.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+
+// Parses a block id of up to four characters the same way the compiler reads 'INF0'
+static bool ParseFourCC(const TCHAR *s, genio::FOURCHARCODE &id)
+{
+	size_t len = _tcslen(s);
+	if (!len || (len > 4))
+		return false;
+
+	id = 0;
+	for (size_t i = 0; i < len; i++)
+		id = (id << 8) | (uint8_t)s[i];
+
+	return true;
+}
+
+
+// ************************************************************************
+// merge
+
+static int Merge(int argc, TCHAR **argv)
+{
+	genio::FOURCHARCODE keyid = genio::IStream::ENDBLOCKID;
+	genio::FOURCHARCODE tombstoneid = genio::IStream::ENDBLOCKID;
+	const TCHAR *outname = nullptr;
+	std::vector<const TCHAR *> innames;
+
+	for (int i = 0; i < argc; i++)
+	{
+		const TCHAR *arg = argv[i];
+		const TCHAR *val = (i < (argc - 1)) ? argv[i + 1] : nullptr;
+
+		if (arg[0] != _T('-'))
+		{
+			innames.push_back(arg);
+			continue;
+		}
+
+		if (!val)
+		{
+			_ftprintf(stderr, _T("missing value for %s\n"), arg);
+			return -1;
+		}
+
+		if (!_tcsicmp(arg, _T("-key")))
+		{
+			if (!ParseFourCC(val, keyid))
+			{
+				_ftprintf(stderr, _T("bad block id %s\n"), val);
+				return -1;
+			}
+		}
+		else if (!_tcsicmp(arg, _T("-tombstone")))
+		{
+			if (!ParseFourCC(val, tombstoneid))
+			{
+				_ftprintf(stderr, _T("bad block id %s\n"), val);
+				return -1;
+			}
+		}
+		else if (!_tcsicmp(arg, _T("-out")))
+			outname = val;
+		else
+		{
+			_ftprintf(stderr, _T("unrecognized option %s\n"), arg);
+			return -1;
+		}
+
+		i++;
+	}
+
+	if (!outname || innames.empty())
+	{
+		_ftprintf(stderr, _T("merge needs an output file and at least one input\n"));
+		return -1;
+	}
+
+	int ret = 0;
+
+	std::vector<genio::IInputStream *> inputs;
+	for (const TCHAR *name : innames)
+	{
+		genio::IInputStream *is = genio::IInputStream::Create();
+		if (!is->Assign(name) || !is->Open() || !is->CanAccess())
+		{
+			_ftprintf(stderr, _T("unable to open %s\n"), name);
+			is->Release();
+			ret = -1;
+			break;
+		}
+
+		inputs.push_back(is);
+	}
+
+	if (!ret)
+	{
+		genio::IOutputStream *os = genio::IOutputStream::Create();
+		if (os->Assign(outname) && os->Open())
+		{
+			os->SetModeFlags(os->GetModeFlags() | STRMMODE_WRITEBUFFER);
+
+			genio::IStreamMerger *merger = genio::IStreamMerger::Create();
+			merger->SetKeyBlock(keyid);
+			merger->SetTombstoneBlock(tombstoneid);
+
+			for (auto is : inputs)
+				merger->AddInput(is);
+
+			size_t count = merger->Merge(os);
+
+			merger->Release();
+
+			os->Close();
+
+			_tprintf(_T("merged %zu inputs into %s, %zu blocks\n"), inputs.size(), outname, count);
+		}
+		else
+		{
+			_ftprintf(stderr, _T("unable to create %s\n"), outname);
+			ret = -1;
+		}
+
+		os->Release();
+	}
+
+	for (auto is : inputs)
+		is->Release();
+
+	return ret;
+}
+
+
+// ************************************************************************
+// diff / patch
+
+// Both take "-out file" and exactly two inputs
+static bool ParseDiffArgs(int argc, TCHAR **argv, const TCHAR *&outname, const TCHAR *&first, const TCHAR *&second)
+{
+	outname = first = second = nullptr;
+
+	for (int i = 0; i < argc; i++)
+	{
+		if (!_tcsicmp(argv[i], _T("-out")) && (i < (argc - 1)))
+			outname = argv[++i];
+		else if (!first)
+			first = argv[i];
+		else if (!second)
+			second = argv[i];
+		else
+			return false;
+	}
+
+	return (outname && first && second);
+}
+
+
+static genio::IInputStream *OpenInput(const TCHAR *name, uint64_t mode)
+{
+	genio::IInputStream *is = genio::IInputStream::Create();
+	is->SetModeFlags(is->GetModeFlags() | mode);
+
+	if (is->Assign(name) && is->Open() && is->CanAccess())
+		return is;
+
+	_ftprintf(stderr, _T("unable to open %s\n"), name);
+	is->Release();
+
+	return nullptr;
+}
+
+
+static int Diff(int argc, TCHAR **argv)
+{
+	const TCHAR *outname, *oldname, *newname;
+	if (!ParseDiffArgs(argc, argv, outname, oldname, newname))
+	{
+		_ftprintf(stderr, _T("diff needs an output file, the old file and the new file\n"));
+		return -1;
+	}
+
+	int ret = -1;
+
+	genio::IInputStream *oldis = OpenInput(oldname, STRMMODE_MAPPED);
+	genio::IInputStream *newis = OpenInput(newname, STRMMODE_MAPPED);
+
+	if (oldis && newis)
+	{
+		genio::IOutputStream *os = genio::IOutputStream::Create();
+		if (os->Assign(outname) && os->Open())
+		{
+			os->SetModeFlags(os->GetModeFlags() | STRMMODE_COMPRESS | STRMMODE_WRITEBUFFER);
+
+			genio::IStreamDiff *diff = genio::IStreamDiff::Create();
+			if (diff->Diff(oldis, newis, os))
+			{
+				genio::SPatchStats stats;
+				diff->GetStats(stats);
+
+				_tprintf(_T("%llu bytes copied in %llu runs, %llu bytes added in %llu runs\n"),
+					stats.m_BytesCopied, stats.m_Copies, stats.m_BytesAdded, stats.m_Additions);
+
+				ret = 0;
+			}
+			else
+			{
+				_ftprintf(stderr, _T("unable to diff %s and %s\n"), oldname, newname);
+			}
+
+			diff->Release();
+
+			os->Close();
+		}
+		else
+		{
+			_ftprintf(stderr, _T("unable to create %s\n"), outname);
+		}
+
+		os->Release();
+	}
+
+	if (oldis)
+		oldis->Release();
+
+	if (newis)
+		newis->Release();
+
+	return ret;
+}
+
+
+static int Patch(int argc, TCHAR **argv)
+{
+	const TCHAR *outname, *oldname, *patchname;
+	if (!ParseDiffArgs(argc, argv, outname, oldname, patchname))
+	{
+		_ftprintf(stderr, _T("patch needs an output file, the old file and the patch\n"));
+		return -1;
+	}
+
+	int ret = -1;
+
+	genio::IInputStream *oldis = OpenInput(oldname, STRMMODE_MAPPED);
+	genio::IInputStream *patchis = OpenInput(patchname, 0);
+
+	if (oldis && patchis)
+	{
+		genio::IOutputStream *os = genio::IOutputStream::Create();
+		if (os->Assign(outname) && os->Open())
+		{
+			os->SetModeFlags(os->GetModeFlags() | STRMMODE_WRITEBUFFER);
+
+			genio::IStreamDiff *diff = genio::IStreamDiff::Create();
+			if (diff->Apply(oldis, patchis, os))
+			{
+				_tprintf(_T("wrote %s\n"), outname);
+				ret = 0;
+			}
+			else
+			{
+				_ftprintf(stderr, _T("%s doesn't apply to %s\n"), patchname, oldname);
+			}
+
+			diff->Release();
+
+			os->Close();
+		}
+		else
+		{
+			_ftprintf(stderr, _T("unable to create %s\n"), outname);
+		}
+
+		os->Release();
+	}
+
+	if (oldis)
+		oldis->Release();
+
+	if (patchis)
+		patchis->Release();
+
+	return ret;
+}
+
+
+// ************************************************************************
+
+int _tmain(int argc, TCHAR **argv)
+{
+	if (argc < 2)
+	{
+		_ftprintf(stderr, _T("usage: GenIOTool <command> [options]; the commands are listed at the top of Tools/GenIOTool.cpp\n"));
+		return -1;
+	}
+
+	if (!_tcsicmp(argv[1], _T("merge")))
+		return Merge(argc - 2, argv + 2);
+
+	if (!_tcsicmp(argv[1], _T("diff")))
+		return Diff(argc - 2, argv + 2);
+
+	if (!_tcsicmp(argv[1], _T("patch")))
+		return Patch(argc - 2, argv + 2);
+
+	_ftprintf(stderr, _T("unknown command %s\n"), argv[1]);
+	return -1;
+}